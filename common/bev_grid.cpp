@@ -0,0 +1,183 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <limits>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+#include "bev_grid.h"
+
+/*** Macro ***/
+static constexpr float kNoHeight = -std::numeric_limits<float>::max();
+static constexpr float kNoDistance = std::numeric_limits<float>::max();
+
+
+/*** Function ***/
+BevGrid::BevGrid(const Config& config)
+    : config_(config)
+{
+    cols_ = (std::max)(1, static_cast<int32_t>(std::ceil((config_.x_max - config_.x_min) / config_.cell_size)));
+    rows_ = (std::max)(1, static_cast<int32_t>(std::ceil((config_.z_max - config_.z_min) / config_.cell_size)));
+    height_map_ = cv::Mat::zeros(rows_, cols_, CV_32FC1);
+    count_map_ = cv::Mat::zeros(rows_, cols_, CV_32SC1);
+    distance_map_ = cv::Mat::zeros(rows_, cols_, CV_32FC1);
+}
+
+bool BevGrid::ConvertWorld2Cell(float x, float z, int32_t& col, int32_t& row) const
+{
+    const float u = (x - config_.x_min) / config_.cell_size;
+    const float v = (config_.z_max - z) / config_.cell_size;
+    if (!(u >= 0 && u < cols_ && v >= 0 && v < rows_)) return false;     /* also rejects NaN */
+    col = static_cast<int32_t>(u);
+    row = static_cast<int32_t>(v);
+    return true;
+}
+
+bool BevGrid::Build(const std::vector<cv::Point3f>& object_point_list, CameraModel& camera)
+{
+    std::array<float, 3> rvec_deg;
+    std::array<float, 3> tvec;
+    camera.GetExtrinsic(rvec_deg, tvec, true);
+    return Build(object_point_list, cv::Point3f(tvec[0], tvec[1], tvec[2]));
+}
+
+bool BevGrid::Build(const std::vector<cv::Point3f>& object_point_list, const cv::Point3f& camera_position)
+{
+    if (config_.cell_size <= 0) {
+        printf("[BevGrid::Build] invalid config\n");
+        return false;
+    }
+    camera_position_ = camera_position;
+    const int32_t cell_num = cols_ * rows_;
+    const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+
+#ifdef _OPENMP
+    const int32_t chunk_num = (std::max)(1, (std::min)(omp_get_max_threads(), point_num));
+#else
+    const int32_t chunk_num = 1;
+#endif
+    if (static_cast<int32_t>(partial_grid_list_.size()) < chunk_num) partial_grid_list_.resize(chunk_num);
+
+    /*** Bin the points of each chunk into its own partial grid ***/
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t c = 0; c < chunk_num; c++) {
+        PartialGrid& grid = partial_grid_list_[c];
+        grid.height_max.assign(cell_num, kNoHeight);
+        grid.count.assign(cell_num, 0);
+        grid.distance_min.assign(cell_num, kNoDistance);
+        const int32_t i_start = static_cast<int32_t>(static_cast<int64_t>(point_num) * c / chunk_num);
+        const int32_t i_end = static_cast<int32_t>(static_cast<int64_t>(point_num) * (c + 1) / chunk_num);
+        for (int32_t i = i_start; i < i_end; i++) {
+            const cv::Point3f& p = object_point_list[i];
+            const float height = -p.y;
+            if (!(height <= config_.height_max)) continue;
+            int32_t col, row;
+            if (!ConvertWorld2Cell(p.x, p.z, col, row)) continue;
+            const int32_t index = row * cols_ + col;
+            const float dx = p.x - camera_position.x;
+            const float dz = p.z - camera_position.z;
+            grid.height_max[index] = (std::max)(grid.height_max[index], height);
+            grid.count[index]++;
+            grid.distance_min[index] = (std::min)(grid.distance_min[index], dx * dx + dz * dz);
+        }
+    }
+
+    /*** Merge ***/
+    float* height_map = height_map_.ptr<float>(0);
+    int32_t* count_map = count_map_.ptr<int32_t>(0);
+    float* distance_map = distance_map_.ptr<float>(0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t index = 0; index < cell_num; index++) {
+        float height = kNoHeight;
+        int32_t count = 0;
+        float distance_sq = kNoDistance;
+        for (int32_t c = 0; c < chunk_num; c++) {
+            const PartialGrid& grid = partial_grid_list_[c];
+            height = (std::max)(height, grid.height_max[index]);
+            count += grid.count[index];
+            distance_sq = (std::min)(distance_sq, grid.distance_min[index]);
+        }
+        height_map[index] = (count > 0) ? height : 0.0f;
+        count_map[index] = count;
+        distance_map[index] = (count > 0) ? std::sqrt(distance_sq) : 0.0f;
+    }
+    return true;
+}
+
+bool BevGrid::IsObstacle(int32_t index) const
+{
+    return count_map_.ptr<int32_t>(0)[index] >= config_.obstacle_point_num && height_map_.ptr<float>(0)[index] >= config_.obstacle_height;
+}
+
+void BevGrid::GetObstacleMap(cv::Mat& mat_obstacle) const
+{
+    mat_obstacle = cv::Mat::zeros(rows_, cols_, CV_8UC1);
+    uint8_t* obstacle = mat_obstacle.ptr<uint8_t>(0);
+    for (int32_t index = 0; index < rows_ * cols_; index++) {
+        if (IsObstacle(index)) obstacle[index] = 255;
+    }
+}
+
+float BevGrid::GetNearestObstacleDistance() const
+{
+    float distance_nearest = 0;
+    const float* distance_map = distance_map_.ptr<float>(0);
+    for (int32_t index = 0; index < rows_ * cols_; index++) {
+        if (IsObstacle(index) && (distance_nearest == 0 || distance_map[index] < distance_nearest)) distance_nearest = distance_map[index];
+    }
+    return distance_nearest;
+}
+
+void BevGrid::Draw(cv::Mat& image, int32_t px_per_cell) const
+{
+    /* height 0 - height_max -> 0 - 255 */
+    cv::Mat mat_height255;
+    height_map_.convertTo(mat_height255, CV_8UC1, 255.0 / config_.height_max);
+    cv::Mat image_height;
+    cv::applyColorMap(mat_height255, image_height, cv::COLORMAP_JET);
+
+    cv::Mat image_cell = cv::Mat::zeros(rows_, cols_, CV_8UC3);
+    const int32_t* count_map = count_map_.ptr<int32_t>(0);
+    for (int32_t index = 0; index < rows_ * cols_; index++) {
+        if (IsObstacle(index)) {
+            image_cell.at<cv::Vec3b>(index) = image_height.at<cv::Vec3b>(index);
+        } else if (count_map[index] > 0) {
+            image_cell.at<cv::Vec3b>(index) = cv::Vec3b(128, 128, 128);
+        }
+    }
+    cv::resize(image_cell, image, cv::Size(cols_ * px_per_cell, rows_ * px_per_cell), 0, 0, cv::INTER_NEAREST);
+
+    int32_t col, row;
+    if (ConvertWorld2Cell(camera_position_.x, (std::max)(camera_position_.z, config_.z_min + config_.cell_size * 0.5f), col, row)) {
+        cv::circle(image, cv::Point((col * 2 + 1) * px_per_cell / 2, (row * 2 + 1) * px_per_cell / 2), 4, cv::Scalar(255, 255, 255), -1);
+    }
+}
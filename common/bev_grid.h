@@ -0,0 +1,94 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef BEV_GRID_
+#define BEV_GRID_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+
+/***
+* Bird's-eye-view grid (obstacle map) from a point cloud in world coordinate (e.g. ConvertImage2World)
+*   - The ground plane is Y = 0 (world coordinate. Y+ = down), so the height of a point is -Y
+*   - Each cell keeps the max height, the number of points and the min horizontal distance from the camera
+*   - One pass over the points: the points are split into chunks, and each chunk is binned into its own partial grid
+*     (no atomics), then the partial grids are merged cell by cell
+*   - Map: row 0 = far (z_max), col 0 = left (x_min), the same direction as a top view
+*   - A cell is an obstacle when it has enough points higher than obstacle_height
+***/
+class BevGrid
+{
+public:
+    typedef struct Config_ {
+        float x_min;            /* [m] */
+        float x_max;
+        float z_min;
+        float z_max;
+        float cell_size;        /* [m] */
+        float height_max;       /* [m] points higher than this are ignored (e.g. ceiling, sky) */
+        float obstacle_height;  /* [m] */
+        int32_t obstacle_point_num;
+        Config_() : x_min(-10.0f), x_max(10.0f), z_min(0.0f), z_max(30.0f), cell_size(0.1f), height_max(3.0f), obstacle_height(0.2f), obstacle_point_num(3) {}
+    } Config;
+
+public:
+    BevGrid(const Config& config = Config());
+    ~BevGrid() {}
+
+    /* The camera position is taken from camera (for the distance) */
+    bool Build(const std::vector<cv::Point3f>& object_point_list, CameraModel& camera);
+    bool Build(const std::vector<cv::Point3f>& object_point_list, const cv::Point3f& camera_position);
+
+    /* Empty cell: count = 0, height = 0, distance = 0 */
+    const cv::Mat& GetHeightMap() const { return height_map_; }         /* CV_32FC1 [m] */
+    const cv::Mat& GetCountMap() const { return count_map_; }           /* CV_32SC1 */
+    const cv::Mat& GetDistanceMap() const { return distance_map_; }     /* CV_32FC1 [m] */
+    /* CV_8UC1. 255 = obstacle */
+    void GetObstacleMap(cv::Mat& mat_obstacle) const;
+    /* Min distance to the obstacle cells. 0 if there is no obstacle */
+    float GetNearestObstacleDistance() const;
+    /* CV_8UC3. Obstacle: color by height, ground: gray, unknown: black. The camera is drawn as a circle */
+    void Draw(cv::Mat& image, int32_t px_per_cell = 2) const;
+
+    /* world (x, z) -> cell (col, row). false if out of the grid */
+    bool ConvertWorld2Cell(float x, float z, int32_t& col, int32_t& row) const;
+
+private:
+    typedef struct PartialGrid_ {
+        std::vector<float> height_max;
+        std::vector<int32_t> count;
+        std::vector<float> distance_min;
+    } PartialGrid;
+
+    bool IsObstacle(int32_t index) const;
+
+private:
+    Config config_;
+    int32_t cols_;
+    int32_t rows_;
+    cv::Point3f camera_position_;
+    std::vector<PartialGrid> partial_grid_list_;    /* kept to avoid allocation at every frame */
+    cv::Mat height_map_;
+    cv::Mat count_map_;
+    cv::Mat distance_map_;
+};
+
+#endif
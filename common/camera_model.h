@@ -30,6 +30,9 @@ limitations under the License.
 #include <omp.h>
 #endif
 
+#include "simd_kernel.h"
+#include "pose.h"
+
 #ifndef M_PI
 #define M_PI 3.141592653f
 #endif
@@ -63,6 +66,18 @@ class CameraModel {
     ***/
 
 public:
+    /* number of points processed by a kernel call (a unit of parallelization) */
+    static constexpr int32_t kKernelBlockSize = 4096;
+
+    /* object point for the image point which doesn't hit the ground / plane (e.g. sky) */
+    static constexpr float kNoIntersection = 999.0f;
+
+    /* the ray LUT (width x height) is built only when the number of points > width * height / ratio */
+    static constexpr int32_t kRayLutPointRatio = 8;
+
+    /* 3 x 4, row major: p' = M * [p, 1] */
+    typedef std::array<float, 12> TransformMat;
+
     /*** Intrinsic parameters ***/
     /* float, 3 x 3 */
     cv::Mat K;
@@ -75,11 +90,7 @@ public:
     cv::Mat dist_coeff;
 
     /*** Extrinsic parameters ***/
-    /* float, 3 x 1, pitch(rx),  yaw(ry), roll(rz) [rad] */
-    cv::Mat rvec;
-
-    /* float, 3 x 1, (tx, ty, tz): horizontal, vertical, depth (Camera location: Ow - Oc in camera coordinate) */
-    cv::Mat tvec;
+    /* Stored as Pose (quaternion and t). rvec / tvec for OpenCV functions are made by GetRvec / GetTvec */
 
 public:
     CameraModel() {
@@ -91,20 +102,39 @@ public:
     }
 
     /*** Accessor for camera parameters ***/
-    float& rx() { return rvec.at<float>(0); }   /* pitch */
-    float& ry() { return rvec.at<float>(1); }   /* yaw */
-    float& rz() { return rvec.at<float>(2); }   /* roll */
-    float& tx() { return tvec.at<float>(0); }
-    float& ty() { return tvec.at<float>(1); }
-    float& tz() { return tvec.at<float>(2); }
+    /* rotation vector [rad]: pitch(rx), yaw(ry), roll(rz) (converted from the quaternion) */
+    float rx() const { float r[3]; GetRotationVector(r); return r[0]; }
+    float ry() const { float r[3]; GetRotationVector(r); return r[1]; }
+    float rz() const { float r[3]; GetRotationVector(r); return r[2]; }
+    /* (tx, ty, tz): horizontal, vertical, depth (Camera location: Ow - Oc in camera coordinate) */
+    float tx() const { return pose_.t().x; }
+    float ty() const { return pose_.t().y; }
+    float tz() const { return pose_.t().z; }
     float& fx() { return K.at<float>(0); }
     float& cx() { return K.at<float>(2); }
     float& fy() { return K.at<float>(4); }
     float& cy() { return K.at<float>(5); }
 
+    /* float, 3 x 1 (for cv::projectPoints, cv::solvePnP, etc.) */
+    cv::Mat GetRvec() const
+    {
+        float r[3];
+        GetRotationVector(r);
+        return (cv::Mat_<float>(3, 1) << r[0], r[1], r[2]);
+    }
+
+    cv::Mat GetTvec() const
+    {
+        return (cv::Mat_<float>(3, 1) << pose_.t().x, pose_.t().y, pose_.t().z);
+    }
+
 
     /*** Methods for camera parameters ***/
     void SetIntrinsic(int32_t width, int32_t height, float focal_length) {
+        if (rolling_shutter_.is_enabled && height != this->height) {
+            /* the pose table is made for the number of rows */
+            DisableRollingShutter();
+        }
         this->width = width;
         this->height = height;
         this->K = (cv::Mat_<float>(3, 3) <<
@@ -128,86 +158,125 @@ public:
 
     void SetExtrinsic(const std::array<float, 3>& rvec_deg, const std::array<float, 3>& tvec, bool is_t_on_world = true)
     {
-        this->rvec = (cv::Mat_<float>(3, 1) << Deg2Rad(rvec_deg[0]), Deg2Rad(rvec_deg[1]), Deg2Rad(rvec_deg[2]));
-        this->tvec = (cv::Mat_<float>(3, 1) << tvec[0], tvec[1], tvec[2]);
+        pose_ = Pose(Quaternion::FromRotationVector(Deg2Rad(rvec_deg[0]), Deg2Rad(rvec_deg[1]), Deg2Rad(rvec_deg[2])), cv::Point3f(tvec[0], tvec[1], tvec[2]));
 
         /*
             is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
             is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
         */
         if (is_t_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            this->tvec = -R * this->tvec;   /* t = -RT */
+            pose_.SetTranslation(-pose_.q().Rotate(pose_.t()));   /* t = -RT */
         }
     }
 
     void GetExtrinsic(std::array<float, 3>& rvec_deg, std::array<float, 3>& tvec, bool is_t_on_world = true)
     {
-        rvec_deg = { Rad2Deg(this->rvec.at<float>(0)), Rad2Deg(this->rvec.at<float>(1)) , Rad2Deg(this->rvec.at<float>(2)) };
-        tvec = { this->tvec.at<float>(0), this->tvec.at<float>(1), this->tvec.at<float>(2) };
+        float r[3];
+        GetRotationVector(r);
+        rvec_deg = { Rad2Deg(r[0]), Rad2Deg(r[1]), Rad2Deg(r[2]) };
         /*
             is_t_on_world == true: tvec = T (Oc - Ow in world coordinate)
             is_t_on_world == false: tvec = tvec (Ow - Oc in camera coordinate)
         */
         if (is_t_on_world) {
             /* t = -RT -> T = -R^1 t */
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            cv::Mat R_inv;
-            cv::invert(R, R_inv);
-            cv::Mat T = -R_inv * this->tvec;
-            tvec = { T.at<float>(0), T.at<float>(1), T.at<float>(2) };
+            cv::Point3f T = -pose_.q().Conjugate().Rotate(pose_.t());
+            tvec = { T.x, T.y, T.z };
         } else {
-            tvec = { this->tvec.at<float>(0), this->tvec.at<float>(1), this->tvec.at<float>(2) };
+            tvec = { pose_.t().x, pose_.t().y, pose_.t().z };
         }
         
     }
 
+    /*** Pose (world -> camera): Mc = R * Mw + t ***/
+    const Pose& GetPose() const { return pose_; }
+    void SetPose(const Pose& pose) { pose_ = pose; }
+
     void SetCameraPos(float tx, float ty, float tz, bool is_on_world = true)    /* Oc - Ow */
     {
-        this->tvec = (cv::Mat_<float>(3, 1) << tx, ty, tz);
+        cv::Point3f T(tx, ty, tz);
         if (is_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            this->tvec = -R * this->tvec;   /* t = -RT */
+            pose_.SetTranslation(-pose_.q().Rotate(T));    /* t = -RT */
         } else {
             /* Oc - Ow -> Ow - Oc */
-            this->tvec *= -1;
+            pose_.SetTranslation(-T);
         }
     }
 
     void MoveCameraPos(float dtx, float dty, float dtz, bool is_on_world = true)    /* Oc - Ow */
     {
-        cv::Mat tvec_delta = (cv::Mat_<float>(3, 1) << dtx, dty, dtz);
+        cv::Point3f tvec_delta(dtx, dty, dtz);
         if (is_on_world) {
-            cv::Mat R = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-            tvec_delta = -R * tvec_delta;
+            tvec_delta = -pose_.q().Rotate(tvec_delta);
         } else {
             /* Oc - Ow -> Ow - Oc */
-            tvec_delta *= -1;
+            tvec_delta = -tvec_delta;
         }
-        this->tvec += tvec_delta;
+        pose_.SetTranslation(pose_.t() + tvec_delta);
     }
 
     void SetCameraAngle(float pitch_deg, float yaw_deg, float roll_deg)
     {
-        /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
-        cv::Mat R_old = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        cv::Mat T = -R_old.inv() * this->tvec;      /* T is tvec in world coordinate.  t = -RT */
-        this->rvec = (cv::Mat_<float>(3, 1) << Deg2Rad(pitch_deg), Deg2Rad(yaw_deg), Deg2Rad(roll_deg));
-        cv::Mat R_new = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        this->tvec = -R_new * T;   /* t = -RT */
+        /* t vec is vector in camera coordinate, so need to re-calculate it when the rotation is updated */
+        /* t_new = -R_new * T = -R_new * (-R_old^-1 * t_old) = (R_new * R_old^-1) * t_old */
+        const Quaternion q_old = pose_.q();
+        const Quaternion q_new = Quaternion::FromRotationVector(Deg2Rad(pitch_deg), Deg2Rad(yaw_deg), Deg2Rad(roll_deg));
+        pose_ = Pose(q_new, (q_new * q_old.Conjugate()).Rotate(pose_.t()));
     }
 
     void RotateCameraAngle(float dpitch_deg, float dyaw_deg, float droll_deg)
     {
-        /* t vec is vector in camera coordinate, so need to re-calculate it when rvec is updated */
-        cv::Mat R_old = MakeRotationMat(Rad2Deg(rx()), Rad2Deg(ry()), Rad2Deg(rz()));
-        cv::Mat T = -R_old.inv() * this->tvec;      /* T is tvec in world coordinate.  t = -RT */
-        cv::Mat R_delta = MakeRotationMat(dpitch_deg, dyaw_deg, droll_deg);
-        cv::Mat R_new = R_delta * R_old;
-        this->tvec = -R_new * T;   /* t = -RT */
-        cv::Rodrigues(R_new, this->rvec); /* Rotation matrix -> rvec */
+        /* R_new = R_delta * R_old, t_new = -R_new * T = R_delta * t_old (the camera position T doesn't change) */
+        Pose pose_delta(Quaternion::FromRotationVector(Deg2Rad(dpitch_deg), Deg2Rad(dyaw_deg), Deg2Rad(droll_deg)), cv::Point3f(0, 0, 0));
+        pose_ = pose_delta * pose_;
+    }
+
+    /*** Rolling shutter ***/
+    /* Rows are exposed one by one from the first row to the last row, and each row has its own pose */
+    /* The pose of each row is interpolated (camera rotation: slerp, camera position: linear) and stored in a table */
+    /* The pose of the camera is set to the pose of the middle row. Call this again when the poses of the frame change */
+    void SetRollingShutter(const Pose& pose_first_row, const Pose& pose_last_row)
+    {
+        /* Interpolate camera -> world to interpolate the camera position */
+        Pose pose_inv_first = pose_first_row.Inverse();
+        Pose pose_inv_last = pose_last_row.Inverse();
+        rolling_shutter_.is_enabled = true;
+        rolling_shutter_.Rt_table.resize(this->height * 12);
+        rolling_shutter_.Rt_inv_table.resize(this->height * 12);
+        for (int32_t y = 0; y < this->height; y++) {
+            float ratio = (this->height > 1) ? static_cast<float>(y) / (this->height - 1) : 0.0f;
+            Pose pose_inv = Pose::Interpolate(pose_inv_first, pose_inv_last, ratio);
+            MakePoseMat(pose_inv.Inverse(), &rolling_shutter_.Rt_table[y * 12]);
+            MakePoseMat(pose_inv, &rolling_shutter_.Rt_inv_table[y * 12]);
+        }
+        pose_ = Pose::Interpolate(pose_inv_first, pose_inv_last, 0.5f).Inverse();
+    }
+
+    /* Motion of the camera during readout. The current pose is the pose of the middle row */
+    /*   angular_velocity [rad/s]: rotation vector per second in camera coordinate */
+    /*   linear_velocity [m/s]: movement of the camera (Oc) in world coordinate */
+    /*   readout_time [s]: time from the first row to the last row */
+    void SetRollingShutterVelocity(const cv::Point3f& angular_velocity, const cv::Point3f& linear_velocity, float readout_time)
+    {
+        Pose pose_inv_mid = pose_.Inverse();
+        const float half = readout_time * 0.5f;
+        /* R(dt) = exp(w * dt) * R, Oc(dt) = Oc + v * dt  ->  camera -> world: R^-1(dt) = R^-1 * exp(-w * dt) */
+        Pose pose_inv_first = pose_inv_mid * Pose(Quaternion::FromRotationVector(angular_velocity.x * half, angular_velocity.y * half, angular_velocity.z * half), cv::Point3f(0, 0, 0));
+        Pose pose_inv_last = pose_inv_mid * Pose(Quaternion::FromRotationVector(-angular_velocity.x * half, -angular_velocity.y * half, -angular_velocity.z * half), cv::Point3f(0, 0, 0));
+        pose_inv_first.SetTranslation(pose_inv_mid.t() - linear_velocity * half);
+        pose_inv_last.SetTranslation(pose_inv_mid.t() + linear_velocity * half);
+        SetRollingShutter(pose_inv_first.Inverse(), pose_inv_last.Inverse());
+    }
+
+    void DisableRollingShutter()
+    {
+        rolling_shutter_.is_enabled = false;
+        rolling_shutter_.Rt_table.clear();
+        rolling_shutter_.Rt_inv_table.clear();
     }
 
+    bool IsRollingShutter() const { return rolling_shutter_.is_enabled; }
+
     /*** Methods for projection ***/
     void ConvertWorld2Image(const cv::Point3f& object_point, cv::Point2f& image_point)
     {
@@ -224,86 +293,66 @@ public:
 #if 1
         /*** Projection ***/
         /* s[x, y, 1] = K * [R t] * [M, 1] = K * M_from_cam */
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat Rt = (cv::Mat_<float>(3, 4) <<
-            R.at<float>(0), R.at<float>(1), R.at<float>(2), this->tx(),
-            R.at<float>(3), R.at<float>(4), R.at<float>(5), this->ty(),
-            R.at<float>(6), R.at<float>(7), R.at<float>(8), this->tz());
+        TransformMat Rt;
+        MakePoseMat(pose_, Rt.data());
+
+        SimdKernel::ProjectionParam param;
+        MakeProjectionParam(Rt.data(), param);
 
         image_point_list.resize(object_point_list.size());
 
+        /* the kernel (SIMD) runs on each block in parallel */
+        /* In rolling shutter mode, the row of each point is searched starting from the pose of the middle row (= the current pose) */
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+        const int32_t block_num = (point_num + kKernelBlockSize - 1) / kKernelBlockSize;
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& object_point = object_point_list[i];
-            auto& image_point = image_point_list[i];
-            cv::Mat Mw = (cv::Mat_<float>(4, 1) << object_point.x, object_point.y, object_point.z, 1);
-            cv::Mat Mc = Rt * Mw;
-            float Zc = Mc.at<float>(2);
-            if (Zc <= 0) {
-                /* Do not project points behind the camera */
-                image_point = cv::Point2f(-1, -1);
-                continue;
-            }
-
-            cv::Mat XY = K * Mc;
-            float x = XY.at<float>(0);
-            float y = XY.at<float>(1);
-            float s = XY.at<float>(2);
-            x /= s;
-            y /= s;
-
-            if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-                image_point.x = x;
-                image_point.y = y;
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t num = (index + kKernelBlockSize < point_num) ? kKernelBlockSize : point_num - index;
+            if (rolling_shutter_.is_enabled) {
+                kernel.ProjectPointsRollingShutter(param, rolling_shutter_.Rt_table.data(), this->height, &object_point_list[index].x, &image_point_list[index].x, num);
             } else {
-                /*** Distort ***/
-                float u = (x - this->cx()) / this->fx();  /* from optical center*/
-                float v = (y - this->cy()) / this->fy();  /* from optical center*/
-                float r2 = u * u + v * v;
-                float r4 = r2 * r2;
-                float k1 = this->dist_coeff.at<float>(0);
-                float k2 = this->dist_coeff.at<float>(1);
-                float p1 = this->dist_coeff.at<float>(3);
-                float p2 = this->dist_coeff.at<float>(4);
-                u = u + u * (k1 * r2 + k2 * r4 /*+ k3 * r6 */) + (2 * p1 * u * v) + p2 * (r2 + 2 * u * u);
-                v = v + v * (k1 * r2 + k2 * r4 /*+ k3 * r6 */) + (2 * p2 * u * v) + p1 * (r2 + 2 * v * v);
-                image_point.x = u * this->fx() + this->cx();
-                image_point.y = v * this->fy() + this->cy();
+                kernel.ProjectPoints(param, &object_point_list[index].x, &image_point_list[index].x, num);
             }
         }
 #else
-        cv::projectPoints(object_point_list, this->rvec, this->tvec, this->K, this->dist_coeff, image_point_list);
+        cv::projectPoints(object_point_list, GetRvec(), GetTvec(), this->K, this->dist_coeff, image_point_list);
 #endif
     }
 
+    /* Mc -> Image (rolling shutter is not considered) */
+    void ConvertCamera2Image(const std::vector<cv::Point3f>& object_point_in_camera_list, std::vector<cv::Point2f>& image_point_list)
+    {
+        static const float kRtIdentity[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+        ProjectPointsParallel(kRtIdentity, object_point_in_camera_list, image_point_list);
+    }
+
+    /* Object -> Mw (M) -> Image in one pass: [R t] * M is used for the projection */
+    void ConvertObject2Image(const TransformMat& M, const std::vector<cv::Point3f>& object_point_list, std::vector<cv::Point2f>& image_point_list)
+    {
+        if (rolling_shutter_.is_enabled) {
+            /* the pose depends on the row, so it cannot be merged */
+            std::vector<cv::Point3f> object_point_in_world_list;
+            TransformObject(M, object_point_list, object_point_in_world_list);
+            ConvertWorld2Image(object_point_in_world_list, image_point_list);
+            return;
+        }
+        TransformMat Rt;
+        MakePoseMat(pose_, Rt.data());
+        const TransformMat Rt_M = ComposeTransformMat(Rt, M);
+        ProjectPointsParallel(Rt_M.data(), object_point_list, image_point_list);
+    }
+
     void ConvertWorld2Camera(const std::vector<cv::Point3f>& object_point_in_world_list, std::vector<cv::Point3f>& object_point_in_camera_list)
     {
         /*** Mw -> Mc ***/
         /* Mc = [R t] * [M, 1] */
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat Rt = (cv::Mat_<float>(3, 4) <<
-            R.at<float>(0), R.at<float>(1), R.at<float>(2), this->tx(),
-            R.at<float>(3), R.at<float>(4), R.at<float>(5), this->ty(),
-            R.at<float>(6), R.at<float>(7), R.at<float>(8), this->tz());
-
-        object_point_in_camera_list.resize(object_point_in_world_list.size());
-
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_in_world_list.size(); i++) {
-            const auto& object_point_in_world = object_point_in_world_list[i];
-            auto& object_point_in_camera = object_point_in_camera_list[i];
-            cv::Mat Mw = (cv::Mat_<float>(4, 1) << object_point_in_world.x, object_point_in_world.y, object_point_in_world.z, 1);
-            cv::Mat Mc = Rt * Mw;
-            object_point_in_camera.x = Mc.at<float>(0);
-            object_point_in_camera.y = Mc.at<float>(1);
-            object_point_in_camera.z = Mc.at<float>(2);
-        }
+        TransformMat Rt;
+        MakePoseMat(pose_, Rt.data());
+        TransformObject(Rt, object_point_in_world_list, object_point_in_camera_list);
     }
 
     void ConvertCamera2World(const std::vector<cv::Point3f>& object_point_in_camera_list, std::vector<cv::Point3f>& object_point_in_world_list)
@@ -312,27 +361,10 @@ public:
         /* Mc = [R t] * [Mw, 1] */
         /* -> [M, 1] = [R t]^1 * Mc <- Unable to get the inverse of [R t] because it's 4x3 */
         /* So, Mc = R * Mw + t */
-        /* -> Mw = R^1 * (Mc - t) */
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat R_inv;
-        cv::invert(R, R_inv);
-        cv::Mat t = this->tvec;
-
-
-        object_point_in_world_list.resize(object_point_in_camera_list.size());
-
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_in_camera_list.size(); i++) {
-            const auto& object_point_in_camera = object_point_in_camera_list[i];
-            auto& object_point_in_world = object_point_in_world_list[i];
-            cv::Mat Mc = (cv::Mat_<float>(3, 1) << object_point_in_camera.x, object_point_in_camera.y, object_point_in_camera.z);
-            cv::Mat Mw = R_inv * (Mc - t);
-            object_point_in_world.x = Mw.at<float>(0);
-            object_point_in_world.y = Mw.at<float>(1);
-            object_point_in_world.z = Mw.at<float>(2);
-        }
+        /* -> Mw = R^1 * (Mc - t) = [R^-1 -R^-1*t] * [Mc, 1] */
+        TransformMat Rt_inv;
+        MakePoseMat(pose_.Inverse(), Rt_inv.data());
+        TransformObject(Rt_inv, object_point_in_camera_list, object_point_in_world_list);
     }
 
     void ConvertImage2GroundPlane(const std::vector<cv::Point2f>& image_point_list, std::vector<cv::Point3f>& object_point_list)
@@ -349,117 +381,118 @@ public:
         /*   s * Rinv * Kinv * [x, y, 1] = M + R_inv * t */
         /*      where, M = (X, Y, Z), and we assume Y = 0(ground_plane) */
         /*      so , we can solve left[1] = R_inv * t[1](camera_height) */
-
+        /* The ground plane is one of the planes of ConvertImage2Plane (n = (0, 1, 0), d = 0) */
+        /* Points above the horizon (sky) are rejected before the intersection */
+        object_point_list.resize(image_point_list.size());
         if (image_point_list.size() == 0) return;
+        std::vector<cv::Point2f> ray_list;
+        ConvertImage2Ray(image_point_list, ray_list);
+
+        UpdateGroundRegion();
+        const GroundRegion& r = ground_region_;
+        const float a = r.a * this->fx();
+        const float b = r.b * this->fy();
+        const float c = r.a * this->cx() + r.b * this->cy() + r.c;   /* horizon line on the ray (Xc / Zc, Yc / Zc) */
+        std::vector<int32_t> ground_index_list;
+        ground_index_list.reserve(image_point_list.size());
+        for (int32_t i = 0; i < static_cast<int32_t>(ray_list.size()); i++) {
+            if (a * ray_list[i].x + b * ray_list[i].y + c > 0) {
+                ground_index_list.push_back(i);
+            } else {
+                object_point_list[i] = cv::Point3f(kNoIntersection, kNoIntersection, kNoIntersection);
+            }
+        }
+        if (ground_index_list.empty()) return;
 
-        cv::Mat K = this->K;
-        cv::Mat R = MakeRotationMat(Rad2Deg(this->rx()), Rad2Deg(this->ry()), Rad2Deg(this->rz()));
-        cv::Mat K_inv;
-        cv::invert(K, K_inv);
-        cv::Mat R_inv;
-        cv::invert(R, R_inv);
-        cv::Mat t = this->tvec;
-
-        /*** Undistort image point ***/
-        std::vector<cv::Point2f> image_point_undistort;
-        if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-            image_point_undistort = image_point_list;
+        const std::vector<cv::Vec4f> plane_list = { cv::Vec4f(0, 1, 0, 0) };
+        std::vector<int32_t> plane_index_list;
+        if (ground_index_list.size() == image_point_list.size()) {
+            IntersectPlanes(image_point_list, ray_list, plane_list, object_point_list, plane_index_list);
         } else {
-            cv::undistortPoints(image_point_list, image_point_undistort, this->K, this->dist_coeff, this->K);    /* don't use K_new */
+            std::vector<cv::Point2f> ground_image_point_list(ground_index_list.size());
+            std::vector<cv::Point2f> ground_ray_list(ground_index_list.size());
+            for (size_t i = 0; i < ground_index_list.size(); i++) {
+                ground_image_point_list[i] = image_point_list[ground_index_list[i]];
+                ground_ray_list[i] = ray_list[ground_index_list[i]];
+            }
+            std::vector<cv::Point3f> ground_object_point_list;
+            IntersectPlanes(ground_image_point_list, ground_ray_list, plane_list, ground_object_point_list, plane_index_list);
+            for (size_t i = 0; i < ground_index_list.size(); i++) {
+                object_point_list[ground_index_list[i]] = ground_object_point_list[i];
+            }
         }
-
-        object_point_list.resize(image_point_list.size());
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& image_point = image_point_list[i];
+        for (int32_t i : ground_index_list) {
             auto& object_point = object_point_list[i];
+            if (object_point.x == kNoIntersection) continue;
+            object_point.y = 0;
+            if (object_point.z < 0) object_point.z = kNoIntersection;
+        }
+    }
 
-            float x = image_point_undistort[i].x;
-            float y = image_point_undistort[i].y;
-            if (y < EstimateVanishmentY()) {
-                object_point.x = 999;
-                object_point.y = 999;
-                object_point.z = 999;
-                continue;
-            }
-
-            cv::Mat XY = (cv::Mat_<float>(3, 1) << x, y, 1);
-
-            /* calculate s */
-            cv::Mat LEFT_WO_S = R_inv * K_inv * XY;
-            cv::Mat RIGHT_WO_M = R_inv * t;         /* no need to add M because M[1] = 0 (ground plane)*/
-            float s = RIGHT_WO_M.at<float>(1) / LEFT_WO_S.at<float>(1);
-
-            /* calculate M */
-            cv::Mat TEMP = R_inv * (s * K_inv * XY - t);
+    /*** Image -> Mw on planes ***/
+    /* plane_list: (nx, ny, nz, d) * plane_num (n^T * Mw + d = 0) */
+    /* Each image point is converted to the nearest plane in front of the camera (e.g. ground, walls, ramps) */
+    /* plane_index_list: index of the plane. -1 if no plane is hit (the object point is (999, 999, 999)) */
+    void ConvertImage2Plane(const std::vector<cv::Point2f>& image_point_list, const std::vector<cv::Vec4f>& plane_list,
+        std::vector<cv::Point3f>& object_point_list, std::vector<int32_t>& plane_index_list)
+    {
+        /*** Undistort image point (ray: Xc / Zc, Yc / Zc) ***/
+        std::vector<cv::Point2f> ray_list;
+        ConvertImage2Ray(image_point_list, ray_list);
+        IntersectPlanes(image_point_list, ray_list, plane_list, object_point_list, plane_index_list);
+    }
 
-            object_point.x = TEMP.at<float>(0);
-            object_point.y = TEMP.at<float>(1);
-            object_point.z = TEMP.at<float>(2);
-            if (object_point.z < 0) object_point.z = 999;
-        }
+    void ConvertImage2Plane(const std::vector<cv::Point2f>& image_point_list, const cv::Point3f& plane_normal, float plane_d, std::vector<cv::Point3f>& object_point_list)
+    {
+        std::vector<cv::Vec4f> plane_list = { cv::Vec4f(plane_normal.x, plane_normal.y, plane_normal.z, plane_d) };
+        std::vector<int32_t> plane_index_list;
+        ConvertImage2Plane(image_point_list, plane_list, object_point_list, plane_index_list);
     }
 
     void ConvertImage2Camera(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list)
     {
         /*** Image -> Mc ***/
-        if (image_point_list.size() == 0) {
-            /* Convert for all pixels on image, when image_point_list = empty */
-            if (z_list.size() != this->width * this->height) {
-                printf("[ConvertImage2Camera] Invalid z_list size\n");
-                return;
-            }
-            /* Generate the original image point mat */
-            /* todo: no need to generate every time */
-            for (int32_t y = 0; y < this->height; y++) {
-                for (int32_t x = 0; x < this->width; x++) {
-                    image_point_list.push_back(cv::Point2f(float(x), float(y)));
-                }
-            }
-        } else {
-            /* Convert for the input pixels only */
-            if (z_list.size() != image_point_list.size()) {
-                printf("[ConvertImage2Camera] Invalid z_list size\n");
-                return;
-            }
-        }
+        ConvertImage2CameraOrWorld(image_point_list, z_list, object_point_list, false);
+    }
 
-        /*** Undistort image point ***/
-        std::vector<cv::Point2f> image_point_undistort;
-        if (this->dist_coeff.empty() || this->dist_coeff.at<float>(0) == 0) {
-            image_point_undistort = image_point_list;   /* todo: redundant copy. I do this just because to make code simple */
+    void ConvertImage2World(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list)
+    {
+        /*** Image -> Mw ***/
+        if (rolling_shutter_.is_enabled) {
+            /* each point is converted using the pose of its row */
+            ConvertImage2CameraOrWorld(image_point_list, z_list, object_point_list, true);
         } else {
-            cv::undistortPoints(image_point_list, image_point_undistort, this->K, this->dist_coeff, this->K);    /* don't use K_new */
+            std::vector<cv::Point3f> object_point_in_camera_list;
+            ConvertImage2Camera(image_point_list, z_list, object_point_in_camera_list);
+            ConvertCamera2World(object_point_in_camera_list, object_point_list);
         }
+    }
 
-        object_point_list.resize(image_point_list.size());
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-        for (int32_t i = 0; i < object_point_list.size(); i++) {
-            const auto& Zc = z_list[i];
-            auto& object_point = object_point_list[i];
-
-            float x = image_point_undistort[i].x;
-            float y = image_point_undistort[i].y;
+    /*** Depth map -> XYZ map (strided views) ***/
+    /* depth: Zc (float) of rows [row_start, row_end) of the image. Each row starts at depth + (y - row_start) * depth_step [byte] */
+    /* xyz: (x, y, z) (float * 3) of each pixel. Each row starts at xyz + (y - row_start) * xyz_step [byte] */
+    /* e.g. ROI of cv::Mat, or std::vector<cv::Point3f> with xyz_step = width * sizeof(cv::Point3f) */
+    void ConvertImage2Camera(const float* depth, size_t depth_step, float* xyz, size_t xyz_step, int32_t row_start, int32_t row_end)
+    {
+        ConvertDepth2Xyz(reinterpret_cast<const uint8_t*>(depth), false, depth_step, xyz, xyz_step, row_start, row_end, false);
+    }
 
-            float u = x - this->cx();
-            float v = y - this->cy();
-            float Xc = Zc * u / this->fx();
-            float Yc = Zc * v / this->fy();
-            object_point.x = Xc;
-            object_point.y = Yc;
-            object_point.z = Zc;
-        }
+    void ConvertImage2World(const float* depth, size_t depth_step, float* xyz, size_t xyz_step, int32_t row_start, int32_t row_end)
+    {
+        ConvertDepth2Xyz(reinterpret_cast<const uint8_t*>(depth), false, depth_step, xyz, xyz_step, row_start, row_end, true);
     }
 
-    void ConvertImage2World(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list)
+    /* mat_depth: CV_32FC1 or CV_16FC1 (rows from row_start of the image, width) -> mat_xyz: CV_32FC3 (allocated if the size or type is different) */
+    /* CV_16FC1 halves the read of the depth map. Each row is converted to float in a small buffer (F16C) */
+    void ConvertImage2Camera(const cv::Mat& mat_depth, cv::Mat& mat_xyz, int32_t row_start = 0)
     {
-        /*** Image -> Mw ***/
-        std::vector<cv::Point3f> object_point_in_camera_list;
-        ConvertImage2Camera(image_point_list, z_list, object_point_in_camera_list);
-        ConvertCamera2World(object_point_in_camera_list, object_point_list);
+        ConvertDepth2Xyz(mat_depth, mat_xyz, row_start, false);
     }
 
+    void ConvertImage2World(const cv::Mat& mat_depth, cv::Mat& mat_xyz, int32_t row_start = 0)
+    {
+        ConvertDepth2Xyz(mat_depth, mat_xyz, row_start, true);
+    }
 
     /* tan(theta) = delta / f */
     float EstimatePitch(float vanishment_y)
@@ -493,6 +526,121 @@ public:
     }
 
 
+    /*** Ground region (below the horizon) ***/
+    /* Calculated only when the camera parameters are changed. Coordinates are on the undistorted image */
+    /* Horizon line: a * x + b * y + c = 0. Ground: a * x + b * y + c > 0 */
+    void GetHorizonLine(float& a, float& b, float& c)
+    {
+        UpdateGroundRegion();
+        a = ground_region_.a;
+        b = ground_region_.b;
+        c = ground_region_.c;
+    }
+
+    bool IsGround(float x, float y)
+    {
+        UpdateGroundRegion();
+        return ground_region_.a * x + ground_region_.b * y + ground_region_.c > 0;
+    }
+
+    /* Rows which contain the ground: [row_start, row_end). margin extends the range (e.g. for lens distortion) */
+    void GetGroundRowRange(int32_t& row_start, int32_t& row_end, int32_t margin = 0)
+    {
+        UpdateGroundRegion();
+        row_start = (std::max)(0, ground_region_.row_start - margin);
+        row_end = (std::min)(this->height, ground_region_.row_end + margin);
+    }
+
+    /* CV_8UC1, height x width. 255 = ground, 0 = sky */
+    const cv::Mat& GetGroundMask()
+    {
+        UpdateGroundRegion();
+        if (ground_region_.mask.empty()) {
+            ground_region_.mask = cv::Mat::zeros(this->height, this->width, CV_8UC1);
+            const GroundRegion& r = ground_region_;
+            for (int32_t y = r.row_start; y < r.row_end; y++) {
+                /* a * x > -(b * y + c) */
+                float right = -(r.b * y + r.c);
+                int32_t x_start = 0;
+                int32_t x_end = this->width;
+                if (r.a > 0) {
+                    x_start = static_cast<int32_t>(std::floor(right / r.a)) + 1;
+                } else if (r.a < 0) {
+                    x_end = static_cast<int32_t>(std::ceil(right / r.a));
+                }
+                x_start = (std::max)(0, x_start);
+                x_end = (std::min)(this->width, x_end);
+                if (x_start < x_end) {
+                    ground_region_.mask.row(y).colRange(x_start, x_end).setTo(255);
+                }
+            }
+        }
+        return ground_region_.mask;
+    }
+
+
+    /*** Plane-induced homography ***/
+    /* Calculated directly from the camera parameters (exact for any plane). Lens distortion is not included */
+    /* Plane in world coordinate: n^T * Mw + d = 0 */
+    /* Homography from this image to the image of camera_dst: x_dst ~ H * x_src (CV_64FC1, 3 x 3) */
+    /*   H = K_dst * (R - t * n1^T / d1) * K_src^-1 */
+    /*   [R t]: this camera -> camera_dst, n1, d1: the plane in this camera coordinate */
+    /* Empty if the plane passes through the camera center (the plane is seen as a line, no homography) */
+    cv::Mat GetPlaneHomography(CameraModel& camera_dst, const cv::Point3f& normal, float distance)
+    {
+        const Pose& pose_src = pose_;
+        const Pose pose_src2dst = camera_dst.GetPose() * pose_src.Inverse();
+        const std::array<float, 9>& R = pose_src2dst.R();
+        const cv::Point3f& t = pose_src2dst.t();
+
+        /* n^T * Mw + d = 0, Mw = R_src^-1 * (Mc - t_src)  ->  n1 = R_src * n, d1 = d - n1^T * t_src */
+        const cv::Point3f n1 = pose_src.q().Rotate(normal);
+        const double d1 = distance - n1.dot(pose_src.t());
+        if (std::abs(d1) < 1e-9) {
+            /* the plane passes through the camera center */
+            return cv::Mat();
+        }
+        const double n1_d[3] = { n1.x / d1, n1.y / d1, n1.z / d1 };
+        const double t_d[3] = { t.x, t.y, t.z };
+        cv::Mat H = cv::Mat(3, 3, CV_64FC1);
+        for (int32_t i = 0; i < 3; i++) {
+            for (int32_t j = 0; j < 3; j++) {
+                H.at<double>(i, j) = R[i * 3 + j] - t_d[i] * n1_d[j];
+            }
+        }
+        cv::Mat K_src, K_dst;
+        this->K.convertTo(K_src, CV_64FC1);
+        camera_dst.K.convertTo(K_dst, CV_64FC1);
+        H = K_dst * H * K_src.inv();
+        if (std::abs(H.at<double>(2, 2)) > 1e-12) {
+            H /= H.at<double>(2, 2);
+        }
+        return H;
+    }
+
+    /* Homography from a texture image on a plane to this image: x ~ H * [u, v, 1] (CV_64FC1, 3 x 3) */
+    /*   Mw = origin + u * axis_u + v * axis_v  (u, v: pixel position on the texture, axis: world length of a texture pixel) */
+    /*   H = K * [R * axis_u, R * axis_v, R * origin + t] */
+    cv::Mat GetTextureHomography(const cv::Point3f& origin, const cv::Point3f& axis_u, const cv::Point3f& axis_v)
+    {
+        const Pose& pose = pose_;
+        const cv::Point3f col[3] = { pose.q().Rotate(axis_u), pose.q().Rotate(axis_v), pose.Transform(origin) };
+        cv::Mat H = cv::Mat(3, 3, CV_64FC1);
+        for (int32_t j = 0; j < 3; j++) {
+            H.at<double>(0, j) = col[j].x;
+            H.at<double>(1, j) = col[j].y;
+            H.at<double>(2, j) = col[j].z;
+        }
+        cv::Mat K;
+        this->K.convertTo(K, CV_64FC1);
+        H = K * H;
+        if (std::abs(H.at<double>(2, 2)) > 1e-12) {
+            H /= H.at<double>(2, 2);
+        }
+        return H;
+    }
+
+
     /*** Other methods ***/
     template <typename T = float>
     static void PRINT_MAT_FLOAT(const cv::Mat& mat, int32_t size)
@@ -535,25 +683,461 @@ public:
         return R;
     }
 
-    static void RotateObject(float x_deg, float y_deg, float z_deg, std::vector<cv::Point3f>& object_point_list)
+    /*** Rigid / affine transform of object points ***/
+    /* Rotation, translation and scale are applied in one pass of M (SIMD, parallel) */
+    /* p' = R * p * scale + t  (R: rotation vector [deg]) */
+    static TransformMat MakeTransformMat(float x_deg, float y_deg, float z_deg, float tx = 0, float ty = 0, float tz = 0, float scale = 1.0f)
+    {
+        float R[9];
+        Quaternion::FromRotationVector(Deg2Rad(x_deg), Deg2Rad(y_deg), Deg2Rad(z_deg)).ToRotationMat(R);
+        return TransformMat{ {
+            R[0] * scale, R[1] * scale, R[2] * scale, tx,
+            R[3] * scale, R[4] * scale, R[5] * scale, ty,
+            R[6] * scale, R[7] * scale, R[8] * scale, tz } };
+    }
+
+    /* (a * b)(p) = a(b(p)) */
+    static TransformMat ComposeTransformMat(const TransformMat& a, const TransformMat& b)
+    {
+        TransformMat M;
+        for (int32_t r = 0; r < 3; r++) {
+            for (int32_t c = 0; c < 4; c++) {
+                M[r * 4 + c] = a[r * 4 + 0] * b[0 * 4 + c] + a[r * 4 + 1] * b[1 * 4 + c] + a[r * 4 + 2] * b[2 * 4 + c];
+            }
+            M[r * 4 + 3] += a[r * 4 + 3];
+        }
+        return M;
+    }
+
+    /* in-place */
+    static void TransformObject(const TransformMat& M, std::vector<cv::Point3f>& object_point_list)
+    {
+        if (object_point_list.empty()) return;
+        TransformPointsParallel(M.data(), &object_point_list[0].x, &object_point_list[0].x, static_cast<int32_t>(object_point_list.size()));
+    }
+
+    static void TransformObject(const TransformMat& M, const std::vector<cv::Point3f>& src_list, std::vector<cv::Point3f>& dst_list)
+    {
+        dst_list.resize(src_list.size());
+        if (src_list.empty()) return;
+        TransformPointsParallel(M.data(), &src_list[0].x, &dst_list[0].x, static_cast<int32_t>(src_list.size()));
+    }
+
+    /* SoA. src_* == dst_* is allowed */
+    static void TransformObject(const TransformMat& M, const float* src_x, const float* src_y, const float* src_z, float* dst_x, float* dst_y, float* dst_z, int32_t num)
     {
-        cv::Mat R = MakeRotationMat(x_deg, y_deg, z_deg);
-        for (auto& object_point : object_point_list) {
-            cv::Mat p = (cv::Mat_<float>(3, 1) << object_point.x, object_point.y, object_point.z);
-            p = R * p;
-            object_point.x = p.at<float>(0);
-            object_point.y = p.at<float>(1);
-            object_point.z = p.at<float>(2);
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t block_num = (num + kKernelBlockSize - 1) / kKernelBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t block_size = (index + kKernelBlockSize < num) ? kKernelBlockSize : num - index;
+            kernel.TransformPointsSoA(M.data(), src_x + index, src_y + index, src_z + index, dst_x + index, dst_y + index, dst_z + index, block_size);
         }
     }
 
+    static void RotateObject(float x_deg, float y_deg, float z_deg, std::vector<cv::Point3f>& object_point_list)
+    {
+        TransformObject(MakeTransformMat(x_deg, y_deg, z_deg), object_point_list);
+    }
+
     static void MoveObject(float x, float y, float z, std::vector<cv::Point3f>& object_point_list)
     {
-        for (auto& object_point : object_point_list) {
-            object_point.x += x;
-            object_point.y += y;
-            object_point.z += z;
+        TransformObject(MakeTransformMat(0, 0, 0, x, y, z), object_point_list);
+    }
+
+private:
+    /* is_world = true: Image -> Mw using the pose of each row (rolling shutter) */
+    void ConvertImage2CameraOrWorld(std::vector<cv::Point2f>& image_point_list, const std::vector<float>& z_list, std::vector<cv::Point3f>& object_point_list, bool is_world)
+    {
+        if (image_point_list.size() == 0) {
+            /* Convert for all pixels on image, when image_point_list = empty */
+            if (z_list.size() != this->width * this->height) {
+                printf("[ConvertImage2Camera] Invalid z_list size\n");
+                return;
+            }
+            /* Generate the original image point mat */
+            /* todo: no need to generate every time */
+            for (int32_t y = 0; y < this->height; y++) {
+                for (int32_t x = 0; x < this->width; x++) {
+                    image_point_list.push_back(cv::Point2f(float(x), float(y)));
+                }
+            }
+        } else {
+            /* Convert for the input pixels only */
+            if (z_list.size() != image_point_list.size()) {
+                printf("[ConvertImage2Camera] Invalid z_list size\n");
+                return;
+            }
+        }
+
+        /*** Undistort image point ***/
+        std::vector<cv::Point2f> image_point_undistort;
+        const std::vector<cv::Point2f>* image_point_undistort_ptr = &image_point_list;
+        if (IsDistorted()) {
+            cv::undistortPoints(image_point_list, image_point_undistort, this->K, this->dist_coeff, this->K);    /* don't use K_new */
+            image_point_undistort_ptr = &image_point_undistort;
+        }
+
+        object_point_list.resize(image_point_list.size());
+
+        /* the kernel (SIMD) runs on each block in parallel */
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+        const int32_t block_num = (point_num + kKernelBlockSize - 1) / kKernelBlockSize;
+        const float fx = this->fx();
+        const float fy = this->fy();
+        const float cx = this->cx();
+        const float cy = this->cy();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t num = (index + kKernelBlockSize < point_num) ? kKernelBlockSize : point_num - index;
+            if (is_world) {
+                kernel.UnprojectPointsRollingShutter(fx, fy, cx, cy, rolling_shutter_.Rt_inv_table.data(), this->height,
+                    &(*image_point_undistort_ptr)[index].x, &image_point_list[index].x, &z_list[index], &object_point_list[index].x, num);
+            } else {
+                kernel.UnprojectPoints(fx, fy, cx, cy, &(*image_point_undistort_ptr)[index].x, &z_list[index], &object_point_list[index].x, num);
+            }
+        }
+    }
+
+    /* ray_list: undistorted image_point_list (Xc / Zc, Yc / Zc) */
+    void IntersectPlanes(const std::vector<cv::Point2f>& image_point_list, const std::vector<cv::Point2f>& ray_list, const std::vector<cv::Vec4f>& plane_list,
+        std::vector<cv::Point3f>& object_point_list, std::vector<int32_t>& plane_index_list)
+    {
+        object_point_list.resize(image_point_list.size());
+        plane_index_list.resize(image_point_list.size());
+        if (image_point_list.size() == 0) return;
+
+        /* [R^-1 C] is taken from the row of the point in rolling shutter mode */
+        float Rt_inv[12];
+        const float* row_Rt_inv_table = Rt_inv;
+        int32_t row_num = 1;
+        if (rolling_shutter_.is_enabled) {
+            row_Rt_inv_table = rolling_shutter_.Rt_inv_table.data();
+            row_num = this->height;
+        } else {
+            MakePoseMat(pose_.Inverse(), Rt_inv);
+        }
+
+        /* the kernel (SIMD) runs on each block in parallel */
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t point_num = static_cast<int32_t>(image_point_list.size());
+        const int32_t block_num = (point_num + kKernelBlockSize - 1) / kKernelBlockSize;
+        const int32_t plane_num = static_cast<int32_t>(plane_list.size());
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t num = (index + kKernelBlockSize < point_num) ? kKernelBlockSize : point_num - index;
+            kernel.IntersectPlanes(row_Rt_inv_table, row_num, &ray_list[index].x, &image_point_list[index].x,
+                plane_num > 0 ? &plane_list[0][0] : nullptr, plane_num, &object_point_list[index].x, &plane_index_list[index], num);
+        }
+    }
+
+    /* image point -> (Xc / Zc, Yc / Zc) */
+    /* With lens distortion, a few points are undistorted directly. For many points (or when the LUT is already built), */
+    /* a LUT of each pixel is used (bilinear). Points outside the image are undistorted one by one */
+    void ConvertImage2Ray(const std::vector<cv::Point2f>& image_point_list, std::vector<cv::Point2f>& ray_list)
+    {
+        ray_list.resize(image_point_list.size());
+        const int32_t point_num = static_cast<int32_t>(image_point_list.size());
+        if (!IsDistorted()) {
+            const float fx_inv = 1.0f / this->fx();
+            const float fy_inv = 1.0f / this->fy();
+            const float cx = this->cx();
+            const float cy = this->cy();
+            for (int32_t i = 0; i < point_num; i++) {
+                ray_list[i].x = (image_point_list[i].x - cx) * fx_inv;
+                ray_list[i].y = (image_point_list[i].y - cy) * fy_inv;
+            }
+            return;
+        }
+
+        if (!IsRayLutValid() && static_cast<int64_t>(point_num) * kRayLutPointRatio < static_cast<int64_t>(this->width) * this->height) {
+            /* Building the LUT (width x height points) costs more than these points */
+            if (point_num > 0) cv::undistortPoints(image_point_list, ray_list, this->K, this->dist_coeff);   /* normalized (no P) */
+            return;
+        }
+        UpdateRayLut();
+        const int32_t w = this->width;
+        const int32_t h = this->height;
+        std::vector<int32_t> outside_index_list;
+        for (int32_t i = 0; i < point_num; i++) {
+            const float x = image_point_list[i].x;
+            const float y = image_point_list[i].y;
+            if (!(x >= 0 && y >= 0 && x <= w - 1 && y <= h - 1)) {
+                outside_index_list.push_back(i);
+                continue;
+            }
+            const int32_t x0 = static_cast<int32_t>(x);
+            const int32_t y0 = static_cast<int32_t>(y);
+            const int32_t x1 = (std::min)(x0 + 1, w - 1);
+            const int32_t y1 = (std::min)(y0 + 1, h - 1);
+            const float ax = x - x0;
+            const float ay = y - y0;
+            const cv::Point2f* lut = ray_lut_.ray.data();
+            const cv::Point2f& r00 = lut[y0 * w + x0];
+            const cv::Point2f& r01 = lut[y0 * w + x1];
+            const cv::Point2f& r10 = lut[y1 * w + x0];
+            const cv::Point2f& r11 = lut[y1 * w + x1];
+            ray_list[i].x = (r00.x * (1 - ax) + r01.x * ax) * (1 - ay) + (r10.x * (1 - ax) + r11.x * ax) * ay;
+            ray_list[i].y = (r00.y * (1 - ax) + r01.y * ax) * (1 - ay) + (r10.y * (1 - ax) + r11.y * ax) * ay;
+        }
+
+        if (!outside_index_list.empty()) {
+            std::vector<cv::Point2f> outside_point_list;
+            for (int32_t i : outside_index_list) outside_point_list.push_back(image_point_list[i]);
+            std::vector<cv::Point2f> outside_ray_list;
+            cv::undistortPoints(outside_point_list, outside_ray_list, this->K, this->dist_coeff);   /* normalized (no P) */
+            for (size_t i = 0; i < outside_index_list.size(); i++) ray_list[outside_index_list[i]] = outside_ray_list[i];
+        }
+    }
+
+    std::array<float, 11> MakeRayLutKey()
+    {
+        return std::array<float, 11>{ {
+            this->fx(), this->fy(), this->cx(), this->cy(), static_cast<float>(this->width), static_cast<float>(this->height),
+            this->dist_coeff.at<float>(0), this->dist_coeff.at<float>(1), this->dist_coeff.at<float>(2), this->dist_coeff.at<float>(3), this->dist_coeff.at<float>(4) } };
+    }
+
+    bool IsRayLutValid()
+    {
+        return MakeRayLutKey() == ray_lut_.key;
+    }
+
+    /* Built lazily by dense callers (depth map conversion or many points) */
+    void UpdateRayLut()
+    {
+        const std::array<float, 11> key = MakeRayLutKey();
+        if (key == ray_lut_.key) return;
+        ray_lut_.key = key;
+
+        std::vector<cv::Point2f> image_point_list(this->width * this->height);
+        for (int32_t y = 0; y < this->height; y++) {
+            for (int32_t x = 0; x < this->width; x++) {
+                image_point_list[y * this->width + x] = cv::Point2f(static_cast<float>(x), static_cast<float>(y));
+            }
+        }
+        cv::undistortPoints(image_point_list, ray_lut_.ray, this->K, this->dist_coeff);
+    }
+
+    void ConvertDepth2Xyz(const cv::Mat& mat_depth, cv::Mat& mat_xyz, int32_t row_start, bool is_world)
+    {
+        const bool is_half = mat_depth.type() == CV_16FC1;
+        if ((mat_depth.type() != CV_32FC1 && !is_half) || mat_depth.cols != this->width || row_start < 0 || row_start + mat_depth.rows > this->height) {
+            printf("[ConvertDepth2Xyz] Invalid depth map\n");
+            return;
+        }
+        mat_xyz.create(mat_depth.size(), CV_32FC3);
+        ConvertDepth2Xyz(mat_depth.ptr<uint8_t>(), is_half, mat_depth.step, mat_xyz.ptr<float>(), mat_xyz.step, row_start, row_start + mat_depth.rows, is_world);
+    }
+
+    /* depth: float, or half (is_half) */
+    void ConvertDepth2Xyz(const uint8_t* depth, bool is_half, size_t depth_step, float* xyz, size_t xyz_step, int32_t row_start, int32_t row_end, bool is_world)
+    {
+        if (row_start < 0 || row_end > this->height || row_start > row_end) {
+            /* the ray LUT and the pose table have rows of the image only */
+            printf("[ConvertDepth2Xyz] Invalid row range (%d - %d)\n", row_start, row_end);
+            return;
+        }
+
+        /* Mc = Zc * [u, v, 1], Mw = [R^-1 C] * [Mc, 1] */
+        TransformMat M = { { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 } };
+        if (is_world && !rolling_shutter_.is_enabled) {
+            MakePoseMat(pose_.Inverse(), M.data());
+        }
+
+        /* ray LUT is used for lens distortion (the same as cv::undistortPoints) */
+        const bool is_distorted = IsDistorted();
+        if (is_distorted) UpdateRayLut();
+
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const float fx = this->fx();
+        const float fy = this->fy();
+        const float cx = this->cx();
+        const float cy = this->cy();
+        const int32_t width = this->width;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            std::vector<float> depth_row_buffer(is_half ? width : 0);     /* a half row is converted here (stays in L1) */
+#ifdef _OPENMP
+#pragma omp for
+#endif
+            for (int32_t y = row_start; y < row_end; y++) {
+                const uint8_t* depth_row_raw = depth + (y - row_start) * depth_step;
+                const float* depth_row = reinterpret_cast<const float*>(depth_row_raw);
+                if (is_half) {
+                    kernel.ConvertHalfToFloat(reinterpret_cast<const uint16_t*>(depth_row_raw), depth_row_buffer.data(), width);
+                    depth_row = depth_row_buffer.data();
+                }
+                float* xyz_row = reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(xyz) + (y - row_start) * xyz_step);
+                const float* ray_row = is_distorted ? &ray_lut_.ray[y * width].x : nullptr;
+                /* the pose of the row in rolling shutter mode */
+                const float* M_row = (is_world && rolling_shutter_.is_enabled) ? &rolling_shutter_.Rt_inv_table[y * 12] : M.data();
+                kernel.UnprojectDepthRow(M_row, ray_row, fx, fy, cx, cy, y, depth_row, xyz_row, width);
+            }
+        }
+    }
+
+    static void TransformPointsParallel(const float* M, const float* src, float* dst, int32_t num)
+    {
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t block_num = (num + kKernelBlockSize - 1) / kKernelBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t block_size = (index + kKernelBlockSize < num) ? kKernelBlockSize : num - index;
+            kernel.TransformPoints(M, src + index * 3, dst + index * 3, block_size);
+        }
+    }
+
+    void ProjectPointsParallel(const float* Rt, const std::vector<cv::Point3f>& object_point_list, std::vector<cv::Point2f>& image_point_list)
+    {
+        SimdKernel::ProjectionParam param;
+        MakeProjectionParam(Rt, param);
+
+        image_point_list.resize(object_point_list.size());
+        const SimdKernel::Table& kernel = SimdKernel::GetTable();
+        const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+        const int32_t block_num = (point_num + kKernelBlockSize - 1) / kKernelBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t block = 0; block < block_num; block++) {
+            const int32_t index = block * kKernelBlockSize;
+            const int32_t num = (index + kKernelBlockSize < point_num) ? kKernelBlockSize : point_num - index;
+            kernel.ProjectPoints(param, &object_point_list[index].x, &image_point_list[index].x, num);
+        }
+    }
+
+    void MakeProjectionParam(const float* Rt, SimdKernel::ProjectionParam& param)
+    {
+        for (int32_t i = 0; i < 12; i++) param.Rt[i] = Rt[i];
+        param.fx = this->fx();
+        param.fy = this->fy();
+        param.cx = this->cx();
+        param.cy = this->cy();
+        param.is_distorted = IsDistorted();
+        if (param.is_distorted) {
+            param.k1 = this->dist_coeff.at<float>(0);
+            param.k2 = this->dist_coeff.at<float>(1);
+            param.p1 = this->dist_coeff.at<float>(3);
+            param.p2 = this->dist_coeff.at<float>(4);
+        } else {
+            param.k1 = param.k2 = param.p1 = param.p2 = 0;
+        }
+    }
+
+    /* Any of k1, k2, p1, p2, k3 is not zero */
+    bool IsDistorted() const
+    {
+        return !this->dist_coeff.empty() && cv::countNonZero(this->dist_coeff) > 0;
+    }
+
+    /* [R t] (3 x 4, row major) */
+    static void MakePoseMat(const Pose& pose, float* Rt)
+    {
+        const std::array<float, 9>& R = pose.R();
+        const cv::Point3f& t = pose.t();
+        Rt[0] = R[0]; Rt[1] = R[1]; Rt[2] = R[2]; Rt[3] = t.x;
+        Rt[4] = R[3]; Rt[5] = R[4]; Rt[6] = R[5]; Rt[7] = t.y;
+        Rt[8] = R[6]; Rt[9] = R[7]; Rt[10] = R[8]; Rt[11] = t.z;
+    }
+
+    void GetRotationVector(float r[3]) const { pose_.q().ToRotationVector(r[0], r[1], r[2]); }
+
+    Pose pose_;     /* world -> camera */
+
+    typedef struct GroundRegion_ {
+        std::array<float, 13> key;  /* camera parameters used for the calculation */
+        float a, b, c;              /* horizon line */
+        int32_t row_start;
+        int32_t row_end;
+        cv::Mat mask;               /* created when requested */
+        GroundRegion_() : a(0), b(0), c(0), row_start(0), row_end(0) { key.fill(std::nanf("")); }
+    } GroundRegion;
+
+    GroundRegion ground_region_;
+
+    typedef struct RayLut_ {
+        std::array<float, 11> key;      /* camera parameters used for the calculation */
+        std::vector<cv::Point2f> ray;   /* (Xc / Zc, Yc / Zc) * width * height */
+        RayLut_() { key.fill(std::nanf("")); }
+    } RayLut;
+
+    RayLut ray_lut_;
+
+    typedef struct RollingShutter_ {
+        bool is_enabled;
+        std::vector<float> Rt_table;        /* world -> camera of each row: [R t] (3 x 4) * height */
+        std::vector<float> Rt_inv_table;    /* camera -> world of each row: [R^-1 C] (3 x 4) * height */
+        RollingShutter_() : is_enabled(false) {}
+    } RollingShutter;
+
+    RollingShutter rolling_shutter_;
+
+    void UpdateGroundRegion()
+    {
+        const Quaternion& q = pose_.q();
+        const std::array<float, 13> key = {
+            q.w, q.x, q.y, q.z, pose_.t().x, pose_.t().y, pose_.t().z,
+            this->fx(), this->fy(), this->cx(), this->cy(), static_cast<float>(this->width), static_cast<float>(this->height) };
+        if (key == ground_region_.key) return;
+        ground_region_.key = key;
+        ground_region_.mask.release();
+
+        /***
+        * A ray to a pixel p(x, y, 1) in world coordinate: d = R^-1 * K^-1 * p
+        * The ray hits the ground plane (Y = 0) when d_y has the same sign as the camera height (Y+ = down)
+        *   d_y = n^T * R^T * K^-1 * p = (K^-T * R * n)^T * p  (n = (0, 1, 0))
+        * So, the horizon line is l = K^-T * (2nd column of R) multiplied by the sign of the camera height
+        ***/
+        const Pose& pose = pose_;
+        const std::array<float, 9>& R = pose.R();
+        float r0 = R[1];
+        float r1 = R[4];
+        float r2 = R[7];
+        /* T = -R^-1 * t. Camera height = -T_y */
+        float camera_height = r0 * pose.t().x + r1 * pose.t().y + r2 * pose.t().z;
+        GroundRegion& r = ground_region_;
+        if (std::abs(camera_height) < 1e-6f) {
+            /* The camera is on the plane. Treat the whole image as valid */
+            r.a = 0;
+            r.b = 0;
+            r.c = 1;
+        } else {
+            float sign = camera_height > 0 ? 1.0f : -1.0f;
+            r.a = sign * r0 / this->fx();
+            r.b = sign * r1 / this->fy();
+            r.c = sign * (r2 - this->cx() * r0 / this->fx() - this->cy() * r1 / this->fy());
+        }
+
+        /* Row y contains the ground if a * x + b * y + c > 0 for some x in [0, width - 1] */
+        float max_ax = (std::max)(0.0f, r.a * (this->width - 1));
+        if (r.b > 0) {
+            r.row_start = static_cast<int32_t>((std::max)(-1.0f, std::floor((-r.c - max_ax) / r.b))) + 1;
+            r.row_end = this->height;
+        } else if (r.b < 0) {
+            r.row_start = 0;
+            r.row_end = static_cast<int32_t>((std::min)(static_cast<float>(this->height), std::ceil((-r.c - max_ax) / r.b)));
+        } else {
+            bool is_ground = max_ax + r.c > 0;
+            r.row_start = 0;
+            r.row_end = is_ground ? this->height : 0;
         }
+        r.row_start = (std::min)(r.row_start, this->height);
+        r.row_end = (std::max)(r.row_end, r.row_start);
     }
 };
 
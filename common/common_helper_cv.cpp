@@ -23,6 +23,7 @@ limitations under the License.
 #include <array>
 #include <algorithm>
 #include <chrono>
+#include <fstream>
 
 /* for OpenCV */
 #include <opencv2/opencv.hpp>
@@ -192,3 +193,20 @@ bool CommonHelper::InputKeyCommand(cv::VideoCapture& cap)
 
     return ret_to_quit;
 }
+
+bool CommonHelper::ReadBinaryFile(const std::string& filename, std::vector<uint8_t>& buffer)
+{
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        printf("Unable to open file: %s\n", filename.c_str());
+        return false;
+    }
+    std::streamsize size = ifs.tellg();
+    ifs.seekg(0, std::ios::beg);
+    buffer.resize(static_cast<size_t>(size));
+    if (!ifs.read(reinterpret_cast<char*>(buffer.data()), size)) {
+        printf("Unable to read file: %s\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
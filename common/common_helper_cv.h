@@ -40,6 +40,7 @@ void CropResizeCvt(const cv::Mat& org, cv::Mat& dst, int32_t& crop_x, int32_t& c
 std::string CreateGStreamerPipeline(int capture_width, int capture_height, int display_width, int display_height, int framerate, int flip_method);
 bool FindSourceImage(const std::string& input_name, cv::VideoCapture& cap, int32_t width = 640, int32_t height = 480);
 bool InputKeyCommand(cv::VideoCapture& cap);
+bool ReadBinaryFile(const std::string& filename, std::vector<uint8_t>& buffer);
 
 }
 
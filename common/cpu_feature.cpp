@@ -0,0 +1,137 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_FEATURE_X86
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPU_FEATURE_X86
+#endif
+
+#include "cpu_feature.h"
+
+/*** Macro ***/
+static constexpr char kEnvIsa[] = "OPENCV_SAMPLE_CPU_ISA";
+
+
+/*** Function ***/
+#ifdef CPU_FEATURE_X86
+static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t reg[4])
+{
+#ifdef _MSC_VER
+    int32_t reg_int[4];
+    __cpuidex(reg_int, static_cast<int32_t>(leaf), static_cast<int32_t>(subleaf));
+    for (int32_t i = 0; i < 4; i++) reg[i] = static_cast<uint32_t>(reg_int[i]);
+#else
+    __cpuid_count(leaf, subleaf, reg[0], reg[1], reg[2], reg[3]);
+#endif
+}
+
+static uint64_t Xgetbv()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CpuFeature::Feature CpuFeature::Detect()
+{
+    Feature feature;
+    memset(&feature, 0, sizeof(feature));
+#ifdef CPU_FEATURE_X86
+    uint32_t reg[4];    /* eax, ebx, ecx, edx */
+    Cpuid(0, 0, reg);
+    const uint32_t max_leaf = reg[0];
+    if (max_leaf < 1) return feature;
+
+    Cpuid(1, 0, reg);
+    const bool has_osxsave = (reg[2] >> 27) & 1;
+    feature.has_sse42 = (reg[2] >> 20) & 1;
+
+    /* The OS must save YMM (bit 1, 2) and ZMM / opmask (bit 5, 6, 7) registers at context switch */
+    const uint64_t xcr0 = has_osxsave ? Xgetbv() : 0;
+    const bool is_os_ymm = (xcr0 & 0x06) == 0x06;
+    const bool is_os_zmm = (xcr0 & 0xE6) == 0xE6;
+    feature.has_avx = is_os_ymm && ((reg[2] >> 28) & 1);
+    feature.has_fma = feature.has_avx && ((reg[2] >> 12) & 1);
+    feature.has_f16c = feature.has_avx && ((reg[2] >> 29) & 1);
+
+    if (max_leaf >= 7) {
+        Cpuid(7, 0, reg);
+        feature.has_avx2 = feature.has_avx && ((reg[1] >> 5) & 1);
+        const bool has_avx512f = (reg[1] >> 16) & 1;
+        const bool has_avx512dq = (reg[1] >> 17) & 1;
+        const bool has_avx512bw = (reg[1] >> 30) & 1;
+        const bool has_avx512vl = (reg[1] >> 31) & 1;
+        feature.has_avx512 = is_os_zmm && has_avx512f && has_avx512dq && has_avx512bw && has_avx512vl;
+    }
+#endif
+    return feature;
+}
+
+int32_t CpuFeature::SelectIsa(const Feature& feature)
+{
+    int32_t isa = kIsaScalar;
+    if (feature.has_sse42) isa = kIsaSse42;
+    if (isa == kIsaSse42 && feature.has_avx2 && feature.has_fma && feature.has_f16c) isa = kIsaAvx2;
+    if (isa == kIsaAvx2 && feature.has_avx512) isa = kIsaAvx512;
+
+    const char* env_isa = getenv(kEnvIsa);
+    if (env_isa) {
+        int32_t isa_limit = kIsaNum;
+        if (strcmp(env_isa, "scalar") == 0) isa_limit = kIsaScalar;
+        else if (strcmp(env_isa, "sse42") == 0) isa_limit = kIsaSse42;
+        else if (strcmp(env_isa, "avx2") == 0) isa_limit = kIsaAvx2;
+        else if (strcmp(env_isa, "avx512") == 0) isa_limit = kIsaAvx512;
+        else printf("[CpuFeature] Unknown %s: %s\n", kEnvIsa, env_isa);
+        if (isa > isa_limit) isa = isa_limit;
+    }
+    return isa;
+}
+
+const CpuFeature::Feature& CpuFeature::Get()
+{
+    static const Feature s_feature = Detect();
+    return s_feature;
+}
+
+int32_t CpuFeature::GetIsa()
+{
+    static const int32_t s_isa = SelectIsa(Get());
+    return s_isa;
+}
+
+const char* CpuFeature::GetIsaName(int32_t isa)
+{
+    switch (isa) {
+    case kIsaScalar: return "Scalar";
+    case kIsaSse42: return "SSE4.2";
+    case kIsaAvx2: return "AVX2";
+    case kIsaAvx512: return "AVX-512";
+    default: return "Unknown";
+    }
+}
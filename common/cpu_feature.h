@@ -0,0 +1,59 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef CPU_FEATURE_
+#define CPU_FEATURE_
+
+/* for general */
+#include <cstdint>
+
+
+/***
+* CPU features detected at runtime (CPUID + XGETBV)
+*   - An ISA is reported as available only when both the CPU and the OS (saved register state) support it
+*   - Environment variable OPENCV_SAMPLE_CPU_ISA (scalar, sse42, avx2, avx512) caps the level, e.g. to compare code paths
+*   - Non-x86 hosts always report kIsaScalar
+***/
+class CpuFeature
+{
+public:
+    /* ISA levels used to select kernels (each level includes the lower ones) */
+    enum {
+        kIsaScalar = 0,
+        kIsaSse42,
+        kIsaAvx2,       /* AVX2 + FMA + F16C */
+        kIsaAvx512,     /* AVX-512 F, DQ, BW, VL */
+        kIsaNum,
+    };
+
+    typedef struct Feature_ {
+        bool has_sse42;
+        bool has_avx;
+        bool has_avx2;
+        bool has_fma;
+        bool has_f16c;
+        bool has_avx512;
+    } Feature;
+
+public:
+    static const Feature& Get();
+    static int32_t GetIsa();
+    static const char* GetIsaName(int32_t isa);
+
+private:
+    static Feature Detect();
+    static int32_t SelectIsa(const Feature& feature);
+};
+
+#endif
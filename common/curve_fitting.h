@@ -27,6 +27,8 @@ limitations under the License.
 
 #include <opencv2/opencv.hpp>
 
+#include "simd_kernel.h"
+
 class CurveFitting
 {
 public:
@@ -45,11 +47,14 @@ public:
         x_avg /= point_list.size();
         y_avg /= point_list.size();
 
+        /* Sum around the mean (sum(x*y) - n*x_avg*y_avg cancels catastrophically when |x_avg| >> spread of x) */
         double s_xy = 0;
         double s_xx = 0;
         for (const auto& p : point_list) {
-            s_xy += (p.x - x_avg) * (p.y - y_avg);
-            s_xx += (p.x - x_avg) * (p.x - x_avg);
+            double dx = p.x - x_avg;
+            double dy = p.y - y_avg;
+            s_xy += dx * dy;
+            s_xx += dx * dx;
         }
 
         a = s_xy / s_xx;
@@ -95,29 +100,16 @@ public:
         | sum(x^3) sum(x^2) sum(x^1) | * | b | = | sum(x*y)   |
         | sum(x^2) sum(x^1) sum(x^0) |   | c |   | sum(y)     |
         */
-        double sum_x4 = 0;
-        double sum_x3 = 0;
-        double sum_x2 = 0;
-        double sum_x1 = 0;
+        std::array<double, SimdKernel::kMomentNum> moment;
+        CalculateMoments(point_list, moment);
+        double sum_x4 = moment[SimdKernel::kMomentXXXX];
+        double sum_x3 = moment[SimdKernel::kMomentXXX];
+        double sum_x2 = moment[SimdKernel::kMomentXX];
+        double sum_x1 = moment[SimdKernel::kMomentX];
         double sum_x0 = static_cast<double>(point_list.size());
-        double sum_xxy = 0;
-        double sum_xy = 0;
-        double sum_y = 0;
-        for (const auto& p : point_list) {
-            sum_y += p.y;
-            double xy = p.x * p.y;
-            sum_xy += xy;
-            sum_xxy += p.x * xy;
-
-            double x1 = p.x;
-            double x2 = x1 * x1;
-            double x3 = x1 * x2;
-            double x4 = x2 * x2;
-            sum_x1 += x1;
-            sum_x2 += x2;
-            sum_x3 += x3;
-            sum_x4 += x4;
-        }
+        double sum_xxy = moment[SimdKernel::kMomentXXY];
+        double sum_xy = moment[SimdKernel::kMomentXY];
+        double sum_y = moment[SimdKernel::kMomentY];
 
         cv::Mat LEFT = (cv::Mat_<double>(3, 3) << sum_x4, sum_x3, sum_x2, sum_x3, sum_x2, sum_x1, sum_x2, sum_x1, sum_x0);
         cv::Mat RIGHT = (cv::Mat_<double>(3, 1) << sum_xxy, sum_xy, sum_y);
@@ -159,6 +151,35 @@ public:
 
         return error;
     }
+
+private:
+    template <typename T>
+    static void CalculateMoments(const std::vector<cv::Point_<T>>& point_list, std::array<double, SimdKernel::kMomentNum>& moment)
+    {
+        moment.fill(0);
+        for (const auto& p : point_list) {
+            double x = p.x;
+            double y = p.y;
+            double xx = x * x;
+            moment[SimdKernel::kMomentX] += x;
+            moment[SimdKernel::kMomentY] += y;
+            moment[SimdKernel::kMomentXX] += xx;
+            moment[SimdKernel::kMomentXXX] += xx * x;
+            moment[SimdKernel::kMomentXXXX] += xx * xx;
+            moment[SimdKernel::kMomentXY] += x * y;
+            moment[SimdKernel::kMomentXXY] += xx * y;
+        }
+    }
+
+    /* cv::Point2f can be used as interleaved float array by the kernel (SIMD) */
+    static void CalculateMoments(const std::vector<cv::Point2f>& point_list, std::array<double, SimdKernel::kMomentNum>& moment)
+    {
+        if (point_list.empty()) {
+            moment.fill(0);
+            return;
+        }
+        SimdKernel::GetTable().CalculateMoments(&point_list[0].x, static_cast<int32_t>(point_list.size()), moment.data());
+    }
 };
 
 
@@ -0,0 +1,233 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "depth_query.h"
+
+
+/*** Function ***/
+static inline bool IsValidDepth(float d)
+{
+    return d > 0 && std::isfinite(d);
+}
+
+bool DepthQuery::Build(const cv::Mat& mat_depth, const cv::Size& image_size)
+{
+    if (mat_depth.type() != CV_32FC1 || mat_depth.empty() || tile_size_ <= 0 || bin_num_ <= 0) {
+        printf("[DepthQuery::Build] invalid input\n");
+        return false;
+    }
+    const int32_t rows = mat_depth.rows;
+    const int32_t cols = mat_depth.cols;
+    depth_size_ = mat_depth.size();
+    scale_x_ = (image_size.width > 0) ? static_cast<float>(cols) / image_size.width : 1.0f;
+    scale_y_ = (image_size.height > 0) ? static_cast<float>(rows) / image_size.height : 1.0f;
+
+    /*** Summed-area tables ***/
+    /* Prefix sum along each row (rows are independent), then along each column (columns are independent) */
+    sat_sum_.create(rows + 1, cols + 1, CV_64FC1);
+    sat_sum_sq_.create(rows + 1, cols + 1, CV_64FC1);
+    sat_count_.create(rows + 1, cols + 1, CV_32SC1);
+    std::fill_n(sat_sum_.ptr<double>(0), cols + 1, 0.0);
+    std::fill_n(sat_sum_sq_.ptr<double>(0), cols + 1, 0.0);
+    std::fill_n(sat_count_.ptr<int32_t>(0), cols + 1, 0);
+    float depth_min = 0;
+    float depth_max = 0;
+    bool is_first = true;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        float local_min = 0;
+        float local_max = 0;
+        bool is_local_first = true;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int32_t y = 0; y < rows; y++) {
+            const float* src = mat_depth.ptr<float>(y);
+            double* sum = sat_sum_.ptr<double>(y + 1);
+            double* sum_sq = sat_sum_sq_.ptr<double>(y + 1);
+            int32_t* count = sat_count_.ptr<int32_t>(y + 1);
+            sum[0] = 0;
+            sum_sq[0] = 0;
+            count[0] = 0;
+            for (int32_t x = 0; x < cols; x++) {
+                const float d = src[x];
+                const bool is_valid = IsValidDepth(d);
+                const double v = is_valid ? d : 0.0;
+                sum[x + 1] = sum[x] + v;
+                sum_sq[x + 1] = sum_sq[x] + v * v;
+                count[x + 1] = count[x] + (is_valid ? 1 : 0);
+                if (is_valid) {
+                    if (is_local_first || d < local_min) local_min = d;
+                    if (is_local_first || d > local_max) local_max = d;
+                    is_local_first = false;
+                }
+            }
+        }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+        if (!is_local_first) {
+            if (is_first || local_min < depth_min) depth_min = local_min;
+            if (is_first || local_max > depth_max) depth_max = local_max;
+            is_first = false;
+        }
+    }
+    /* Split columns into blocks so that each thread reads rows contiguously */
+    static constexpr int32_t kColumnBlockSize = 256;
+    const int32_t column_block_num = (cols + 1 + kColumnBlockSize - 1) / kColumnBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t block = 0; block < column_block_num; block++) {
+        const int32_t x_start = block * kColumnBlockSize;
+        const int32_t x_end = (std::min)(cols + 1, x_start + kColumnBlockSize);
+        for (int32_t y = 1; y <= rows; y++) {
+            const double* sum_previous = sat_sum_.ptr<double>(y - 1);
+            const double* sum_sq_previous = sat_sum_sq_.ptr<double>(y - 1);
+            const int32_t* count_previous = sat_count_.ptr<int32_t>(y - 1);
+            double* sum = sat_sum_.ptr<double>(y);
+            double* sum_sq = sat_sum_sq_.ptr<double>(y);
+            int32_t* count = sat_count_.ptr<int32_t>(y);
+            for (int32_t x = x_start; x < x_end; x++) {
+                sum[x] += sum_previous[x];
+                sum_sq[x] += sum_sq_previous[x];
+                count[x] += count_previous[x];
+            }
+        }
+    }
+    depth_min_ = depth_min;
+    depth_max_ = depth_max;
+
+    /*** Histogram of each tile, then summed-area table over tiles ***/
+    tile_cols_ = (cols + tile_size_ - 1) / tile_size_;
+    tile_rows_ = (rows + tile_size_ - 1) / tile_size_;
+    const int32_t bin_num = bin_num_;
+    const size_t stride_row = static_cast<size_t>(tile_cols_ + 1) * bin_num;
+    sat_histogram_.assign((tile_rows_ + 1) * stride_row, 0);
+    const float range = depth_max - depth_min;
+    const float bin_per_depth = (range > 0) ? bin_num / range : 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t ty = 0; ty < tile_rows_; ty++) {
+        int32_t* histogram_row = sat_histogram_.data() + (ty + 1) * stride_row;
+        const int32_t y_end = (std::min)(rows, (ty + 1) * tile_size_);
+        for (int32_t y = ty * tile_size_; y < y_end; y++) {
+            const float* src = mat_depth.ptr<float>(y);
+            for (int32_t x = 0; x < cols; x++) {
+                const float d = src[x];
+                if (!IsValidDepth(d)) continue;
+                const int32_t bin = (std::min)(bin_num - 1, static_cast<int32_t>((d - depth_min) * bin_per_depth));
+                histogram_row[(x / tile_size_ + 1) * bin_num + bin]++;
+            }
+        }
+        /* Prefix along tiles in the row */
+        for (int32_t tx = 1; tx <= tile_cols_; tx++) {
+            for (int32_t b = 0; b < bin_num; b++) histogram_row[tx * bin_num + b] += histogram_row[(tx - 1) * bin_num + b];
+        }
+    }
+    for (int32_t ty = 1; ty <= tile_rows_; ty++) {
+        int32_t* histogram_row = sat_histogram_.data() + ty * stride_row;
+        const int32_t* histogram_row_previous = histogram_row - stride_row;
+        for (size_t i = 0; i < stride_row; i++) histogram_row[i] += histogram_row_previous[i];
+    }
+    return true;
+}
+
+bool DepthQuery::ConvertRect(const cv::Rect& rect, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const
+{
+    /* [x0, x1) x [y0, y1) in the depth map */
+    x0 = (std::max)(0, static_cast<int32_t>(std::floor(rect.x * scale_x_)));
+    y0 = (std::max)(0, static_cast<int32_t>(std::floor(rect.y * scale_y_)));
+    x1 = (std::min)(depth_size_.width, static_cast<int32_t>(std::ceil((rect.x + rect.width) * scale_x_)));
+    y1 = (std::min)(depth_size_.height, static_cast<int32_t>(std::ceil((rect.y + rect.height) * scale_y_)));
+    return x0 < x1 && y0 < y1;
+}
+
+DepthQuery::Stat DepthQuery::GetStat(const cv::Rect& rect) const
+{
+    Stat stat = { 0.0f, 0.0f, 0 };
+    int32_t x0, y0, x1, y1;
+    if (sat_sum_.empty() || !ConvertRect(rect, x0, y0, x1, y1)) return stat;
+    const int32_t count = sat_count_.at<int32_t>(y1, x1) - sat_count_.at<int32_t>(y0, x1) - sat_count_.at<int32_t>(y1, x0) + sat_count_.at<int32_t>(y0, x0);
+    if (count <= 0) return stat;
+    const double sum = sat_sum_.at<double>(y1, x1) - sat_sum_.at<double>(y0, x1) - sat_sum_.at<double>(y1, x0) + sat_sum_.at<double>(y0, x0);
+    const double sum_sq = sat_sum_sq_.at<double>(y1, x1) - sat_sum_sq_.at<double>(y0, x1) - sat_sum_sq_.at<double>(y1, x0) + sat_sum_sq_.at<double>(y0, x0);
+    const double mean = sum / count;
+    stat.mean = static_cast<float>(mean);
+    stat.variance = static_cast<float>((std::max)(0.0, sum_sq / count - mean * mean));
+    stat.valid_num = count;
+    return stat;
+}
+
+float DepthQuery::GetMedian(const cv::Rect& rect) const
+{
+    int32_t x0, y0, x1, y1;
+    if (sat_histogram_.empty() || !ConvertRect(rect, x0, y0, x1, y1)) return 0.0f;
+
+    /* Snap to the tiles whose center is in the rectangle. Use the tile at the center if the rectangle is smaller than a tile */
+    const int32_t half = tile_size_ / 2;
+    int32_t tx0 = (x0 + half) / tile_size_;
+    int32_t ty0 = (y0 + half) / tile_size_;
+    int32_t tx1 = (std::min)(tile_cols_, (x1 + half) / tile_size_);
+    int32_t ty1 = (std::min)(tile_rows_, (y1 + half) / tile_size_);
+    if (tx0 >= tx1) {
+        tx0 = (std::min)(tile_cols_ - 1, ((x0 + x1) / 2) / tile_size_);
+        tx1 = tx0 + 1;
+    }
+    if (ty0 >= ty1) {
+        ty0 = (std::min)(tile_rows_ - 1, ((y0 + y1) / 2) / tile_size_);
+        ty1 = ty0 + 1;
+    }
+
+    const int32_t bin_num = bin_num_;
+    const size_t stride_row = static_cast<size_t>(tile_cols_ + 1) * bin_num;
+    const int32_t* h00 = sat_histogram_.data() + ty0 * stride_row + tx0 * bin_num;
+    const int32_t* h01 = sat_histogram_.data() + ty0 * stride_row + tx1 * bin_num;
+    const int32_t* h10 = sat_histogram_.data() + ty1 * stride_row + tx0 * bin_num;
+    const int32_t* h11 = sat_histogram_.data() + ty1 * stride_row + tx1 * bin_num;
+    int32_t total = 0;
+    for (int32_t b = 0; b < bin_num; b++) total += h11[b] - h01[b] - h10[b] + h00[b];
+    if (total <= 0) return 0.0f;
+
+    const float bin_width = (depth_max_ - depth_min_) / bin_num;
+    const float half_total = total * 0.5f;
+    int32_t cumulative = 0;
+    for (int32_t b = 0; b < bin_num; b++) {
+        const int32_t count = h11[b] - h01[b] - h10[b] + h00[b];
+        if (cumulative + count >= half_total) {
+            const float ratio = (count > 0) ? (half_total - cumulative) / count : 0.5f;
+            return depth_min_ + (b + ratio) * bin_width;
+        }
+        cumulative += count;
+    }
+    return depth_max_;
+}
@@ -0,0 +1,78 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef DEPTH_QUERY_
+#define DEPTH_QUERY_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Depth statistics of rectangles (e.g. detection boxes) in O(1) per query
+*   - Build once per depth frame: summed-area tables of sum, sum of squares and valid count
+*   - Mean / variance of any rectangle = 4 lookups in each table
+*   - Approximate median: histograms of tiles (tile_size x tile_size) are also accumulated as a summed-area table over tiles,
+*     so the histogram of a rectangle (snapped to tiles) costs bin_num lookups
+*   - Invalid depth (<= 0, NaN, Inf) is ignored
+*   - Rectangles are in the coordinate of image_size (e.g. the input image of the detector), and scaled to the depth map
+***/
+class DepthQuery
+{
+public:
+    static constexpr int32_t kDefaultTileSize = 8;      /* [px] in the depth map */
+    static constexpr int32_t kDefaultBinNum = 64;
+
+    typedef struct Stat_ {
+        float mean;
+        float variance;
+        int32_t valid_num;      /* 0: no valid depth in the rectangle (mean and variance are 0) */
+    } Stat;
+
+public:
+    DepthQuery(int32_t tile_size = kDefaultTileSize, int32_t bin_num = kDefaultBinNum)
+        : tile_size_(tile_size), bin_num_(bin_num), depth_min_(0), depth_max_(0), tile_cols_(0), tile_rows_(0) {}
+    ~DepthQuery() {}
+
+    /* mat_depth: CV_32FC1. image_size: the coordinate of the query rectangles (empty = the same as mat_depth) */
+    bool Build(const cv::Mat& mat_depth, const cv::Size& image_size = cv::Size());
+    Stat GetStat(const cv::Rect& rect) const;
+    /* Interpolated in the bin. Resolution is (max - min) / bin_num. Returns 0 if there is no valid depth */
+    float GetMedian(const cv::Rect& rect) const;
+
+private:
+    bool ConvertRect(const cv::Rect& rect, int32_t& x0, int32_t& y0, int32_t& x1, int32_t& y1) const;
+
+private:
+    int32_t tile_size_;
+    int32_t bin_num_;
+    cv::Size depth_size_;
+    float scale_x_;             /* image -> depth map */
+    float scale_y_;
+    float depth_min_;
+    float depth_max_;
+
+    cv::Mat sat_sum_;           /* CV_64FC1, (rows + 1) x (cols + 1) */
+    cv::Mat sat_sum_sq_;        /* CV_64FC1 */
+    cv::Mat sat_count_;         /* CV_32SC1 */
+    int32_t tile_cols_;
+    int32_t tile_rows_;
+    std::vector<int32_t> sat_histogram_;   /* (tile_rows + 1) x (tile_cols + 1) x bin_num */
+};
+
+#endif
@@ -0,0 +1,211 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "simd_kernel.h"
+#include "depth_upsampler.h"
+
+
+/*** Function ***/
+bool DepthUpsampler::Process(const cv::Mat& mat_depth, const cv::Mat& image_guide, cv::Mat& mat_depth_upsampled, int32_t output_type)
+{
+    if (mat_depth.type() != CV_32FC1 || image_guide.type() != CV_8UC3 || mat_depth.empty() || image_guide.empty()
+        || (output_type != CV_32FC1 && output_type != CV_16FC1)) {
+        printf("[DepthUpsampler::Process] invalid input\n");
+        return false;
+    }
+
+    /*** Subsample the guide and the depth (mat_depth is not read after this, so it can be the output) ***/
+    const int32_t ratio = (std::max)(1, subsample_ratio_);
+    const cv::Size size_small((std::max)(1, image_guide.cols / ratio), (std::max)(1, image_guide.rows / ratio));
+    cv::resize(image_guide, guide_, size_small, 0, 0, cv::INTER_AREA);
+    guide_.convertTo(guide_, CV_32FC3, 1.0 / 255);
+    cv::resize(mat_depth, depth_, size_small, 0, 0, cv::INTER_LINEAR);
+
+    /*** Products for mean, variance and covariance ***/
+    for (auto& product : product_list_) product.create(size_small, CV_32FC4);
+    product_bb_.create(size_small, CV_32FC1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < size_small.height; y++) {
+        const float* I = guide_.ptr<float>(y);
+        const float* p = depth_.ptr<float>(y);
+        float* m0 = product_list_[0].ptr<float>(y);
+        float* m1 = product_list_[1].ptr<float>(y);
+        float* m2 = product_list_[2].ptr<float>(y);
+        float* m3 = product_bb_.ptr<float>(y);
+        for (int32_t x = 0; x < size_small.width; x++) {
+            /* guide_ is BGR */
+            const float b = I[3 * x + 0];
+            const float g = I[3 * x + 1];
+            const float r = I[3 * x + 2];
+            const float d = p[x];
+            m0[4 * x + 0] = r;      m0[4 * x + 1] = g;      m0[4 * x + 2] = b;      m0[4 * x + 3] = d;
+            m1[4 * x + 0] = r * d;  m1[4 * x + 1] = g * d;  m1[4 * x + 2] = b * d;  m1[4 * x + 3] = r * r;
+            m2[4 * x + 0] = r * g;  m2[4 * x + 1] = r * b;  m2[4 * x + 2] = g * g;  m2[4 * x + 3] = g * b;
+            m3[x] = b * b;
+        }
+    }
+    for (int32_t i = 0; i < 3; i++) BoxMean(product_list_[i], mean_list_[i]);
+    BoxMean(product_bb_, mean_bb_);
+
+    /*** Solve (Sigma + eps * E) * a = cov(I, p), b = mean(p) - a^T * mean(I) in each window ***/
+    coef_.create(size_small, CV_32FC4);
+    const float eps = eps_;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < size_small.height; y++) {
+        const float* m0 = mean_list_[0].ptr<float>(y);
+        const float* m1 = mean_list_[1].ptr<float>(y);
+        const float* m2 = mean_list_[2].ptr<float>(y);
+        const float* m3 = mean_bb_.ptr<float>(y);
+        float* c = coef_.ptr<float>(y);
+        for (int32_t x = 0; x < size_small.width; x++) {
+            const float mr = m0[4 * x + 0];
+            const float mg = m0[4 * x + 1];
+            const float mb = m0[4 * x + 2];
+            const float mp = m0[4 * x + 3];
+            const float v0 = m1[4 * x + 0] - mr * mp;
+            const float v1 = m1[4 * x + 1] - mg * mp;
+            const float v2 = m1[4 * x + 2] - mb * mp;
+            const float s00 = m1[4 * x + 3] - mr * mr + eps;
+            const float s01 = m2[4 * x + 0] - mr * mg;
+            const float s02 = m2[4 * x + 1] - mr * mb;
+            const float s11 = m2[4 * x + 2] - mg * mg + eps;
+            const float s12 = m2[4 * x + 3] - mg * mb;
+            const float s22 = m3[x] - mb * mb + eps;
+            /* Inverse of the symmetric 3x3 matrix by cofactors */
+            const float c00 = s11 * s22 - s12 * s12;
+            const float c01 = s02 * s12 - s01 * s22;
+            const float c02 = s01 * s12 - s02 * s11;
+            const float c11 = s00 * s22 - s02 * s02;
+            const float c12 = s01 * s02 - s00 * s12;
+            const float c22 = s00 * s11 - s01 * s01;
+            const float det_inv = 1.0f / (s00 * c00 + s01 * c01 + s02 * c02);
+            const float ar = (c00 * v0 + c01 * v1 + c02 * v2) * det_inv;
+            const float ag = (c01 * v0 + c11 * v1 + c12 * v2) * det_inv;
+            const float ab = (c02 * v0 + c12 * v1 + c22 * v2) * det_inv;
+            /* Scale a by 1/255 so that the full resolution pass can use the 8-bit guide as it is */
+            c[4 * x + 0] = ar * (1.0f / 255);
+            c[4 * x + 1] = ag * (1.0f / 255);
+            c[4 * x + 2] = ab * (1.0f / 255);
+            c[4 * x + 3] = mp - (ar * mr + ag * mg + ab * mb);
+        }
+    }
+    BoxMean(coef_, mean_coef_);
+
+    /*** q = mean(a)^T * I + mean(b) in the full resolution ***/
+    /* mean(a), mean(b) are bilinearly interpolated in the loop (the same sampling as cv::resize INTER_LINEAR) */
+    /* Each row of the coefficients is interpolated vertically into a small buffer, then horizontally for each pixel */
+    const int32_t width = image_guide.cols;
+    const int32_t width_small = size_small.width;
+    const int32_t height_small = size_small.height;
+    x0_list_.resize(width);
+    x1_list_.resize(width);
+    ax_list_.resize(width);
+    const float scale_x = static_cast<float>(width_small) / width;
+    for (int32_t x = 0; x < width; x++) {
+        const float sx = (std::min)((std::max)((x + 0.5f) * scale_x - 0.5f, 0.0f), static_cast<float>(width_small - 1));
+        const int32_t x0 = static_cast<int32_t>(sx);
+        x0_list_[x] = 4 * x0;
+        x1_list_[x] = 4 * (std::min)(x0 + 1, width_small - 1);
+        ax_list_[x] = sx - x0;
+    }
+    const float scale_y = static_cast<float>(height_small) / image_guide.rows;
+
+    /* FP16: each row is calculated in a small float buffer, then converted (F16C) */
+    const bool is_half = (output_type == CV_16FC1);
+    mat_depth_upsampled.create(image_guide.size(), output_type);
+    const SimdKernel::Table& kernel = SimdKernel::GetTable();
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> row_buffer(is_half ? width : 0);
+        std::vector<float> coef_row(4 * width_small);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (int32_t y = 0; y < image_guide.rows; y++) {
+            const float sy = (std::min)((std::max)((y + 0.5f) * scale_y - 0.5f, 0.0f), static_cast<float>(height_small - 1));
+            const int32_t y0 = static_cast<int32_t>(sy);
+            const float ay = sy - y0;
+            const float* c0 = mean_coef_.ptr<float>(y0);
+            const float* c1 = mean_coef_.ptr<float>((std::min)(y0 + 1, height_small - 1));
+            for (int32_t i = 0; i < 4 * width_small; i++) {
+                coef_row[i] = c0[i] + (c1[i] - c0[i]) * ay;
+            }
+
+            const uint8_t* I = image_guide.ptr<uint8_t>(y);
+            float* q = is_half ? row_buffer.data() : mat_depth_upsampled.ptr<float>(y);
+            for (int32_t x = 0; x < width; x++) {
+                const float* l = &coef_row[x0_list_[x]];
+                const float* r = &coef_row[x1_list_[x]];
+                const float ax = ax_list_[x];
+                const float ar = l[0] + (r[0] - l[0]) * ax;
+                const float ag = l[1] + (r[1] - l[1]) * ax;
+                const float ab = l[2] + (r[2] - l[2]) * ax;
+                const float bb = l[3] + (r[3] - l[3]) * ax;
+                q[x] = ar * I[3 * x + 2] + ag * I[3 * x + 1] + ab * I[3 * x + 0] + bb;
+            }
+            if (is_half) kernel.ConvertFloatToHalf(q, mat_depth_upsampled.ptr<uint16_t>(y), width);
+        }
+    }
+    return true;
+}
+
+void DepthUpsampler::BoxMean(const cv::Mat& src, cv::Mat& dst)
+{
+    /* Mean in (2 * radius + 1)^2 window. The window is cropped at the border (divided by the number of the pixels in it) */
+    cv::integral(src, integral_, CV_64F);
+    dst.create(src.size(), src.type());
+    const int32_t cn = src.channels();
+    const int32_t rows = src.rows;
+    const int32_t cols = src.cols;
+    const int32_t radius = radius_;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < rows; y++) {
+        const int32_t y0 = (std::max)(0, y - radius);
+        const int32_t y1 = (std::min)(rows, y + radius + 1);
+        const double* s0 = integral_.ptr<double>(y0);
+        const double* s1 = integral_.ptr<double>(y1);
+        float* d = dst.ptr<float>(y);
+        for (int32_t x = 0; x < cols; x++) {
+            const int32_t x0 = (std::max)(0, x - radius);
+            const int32_t x1 = (std::min)(cols, x + radius + 1);
+            const double area_inv = 1.0 / ((y1 - y0) * (x1 - x0));
+            for (int32_t c = 0; c < cn; c++) {
+                const double sum = s1[x1 * cn + c] - s0[x1 * cn + c] - s1[x0 * cn + c] + s0[x0 * cn + c];
+                d[x * cn + c] = static_cast<float>(sum * area_inv);
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef DEPTH_UPSAMPLER_
+#define DEPTH_UPSAMPLER_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Edge-aware depth upsampling (fast guided filter with the color image as guidance)
+*   q = a^T * I + b, where (a, b) are fitted in each window so that q follows p (depth) and its edges follow I (color)
+*   - (a, b) are calculated at 1 / subsample_ratio of the guide resolution
+*   - Window sums use integral images, so the cost doesn't depend on the radius (O(1) per pixel)
+*   - The full resolution pass is one fused loop: (a, b) are bilinearly interpolated on the fly (no full resolution coefficient image)
+*     and the 8-bit guide is read directly
+*   - The output can be stored in FP16 (CV_16FC1) to halve the traffic of the following stages (e.g. CameraModel::ConvertImage2World)
+*   - Buffers are kept across frames
+* reference: K. He, J. Sun, "Fast Guided Filter", 2015
+***/
+class DepthUpsampler
+{
+public:
+    static constexpr int32_t kDefaultRadius = 4;            /* [px] in the subsampled resolution */
+    static constexpr float kDefaultEps = 1e-3f;             /* regularization. The guide is normalized to 0.0 - 1.0 */
+    static constexpr int32_t kDefaultSubsampleRatio = 4;
+
+public:
+    DepthUpsampler(int32_t radius = kDefaultRadius, float eps = kDefaultEps, int32_t subsample_ratio = kDefaultSubsampleRatio)
+        : radius_(radius), eps_(eps), subsample_ratio_(subsample_ratio) {}
+    ~DepthUpsampler() {}
+
+    /* mat_depth: CV_32FC1 (any size), image_guide: CV_8UC3, mat_depth_upsampled: output_type (CV_32FC1 or CV_16FC1, the size of image_guide) */
+    /* mat_depth_upsampled can be mat_depth */
+    bool Process(const cv::Mat& mat_depth, const cv::Mat& image_guide, cv::Mat& mat_depth_upsampled, int32_t output_type = CV_32FC1);
+
+private:
+    void BoxMean(const cv::Mat& src, cv::Mat& dst);
+
+private:
+    int32_t radius_;
+    float eps_;
+    int32_t subsample_ratio_;
+
+    cv::Mat guide_;             /* CV_32FC3 (0.0 - 1.0), subsampled */
+    cv::Mat depth_;             /* CV_32FC1, subsampled */
+    cv::Mat product_list_[3];   /* CV_32FC4 (r, g, b, p), (rp, gp, bp, rr), (rg, rb, gg, gb) */
+    cv::Mat product_bb_;        /* CV_32FC1 */
+    cv::Mat mean_list_[3];
+    cv::Mat mean_bb_;
+    cv::Mat coef_;              /* CV_32FC4 (a_r, a_g, a_b, b) */
+    cv::Mat mean_coef_;
+    std::vector<int32_t> x0_list_;  /* offset of the left / right coefficients for each column of the output */
+    std::vector<int32_t> x1_list_;
+    std::vector<float> ax_list_;
+    cv::Mat integral_;          /* CV_64FCn */
+};
+
+#endif
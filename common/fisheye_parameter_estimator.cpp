@@ -0,0 +1,320 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "fisheye_parameter_estimator.h"
+
+/*** Macro ***/
+static constexpr double kCannyThreshold1 = 50.0;
+static constexpr double kCannyThreshold2 = 150.0;
+static constexpr float kMinChordRatio = 0.7f;       /* chord / length of a segment. Reject corners and zigzag edges */
+static constexpr int32_t kSamplePointNum = 16;      /* per segment */
+static constexpr int32_t kSampleSmoothRadius = 2;   /* average neighbouring edge pixels to reduce quantization error */
+static constexpr int32_t kMinSegmentNum = 10;
+static constexpr int32_t kCoarseGridNum = 17;       /* for each parameter (odd) */
+static constexpr int32_t kRefineGridRadius = 2;     /* (2 * radius + 1)^2 candidates per refinement */
+static constexpr int32_t kRefineIterationNum = 8;
+static constexpr float kInvalidCost = 100.0f;       /* [px^2] upper limit of the cost of a segment (it's not a line at all) */
+static constexpr double kMinCosToCenter = 0.1;      /* the virtual pinhole camera can't see points near 90 deg */
+
+
+/*** Function ***/
+/* Point on the distorted image -> point on the unit sphere (inverse of the unified projection) */
+static inline bool LiftToSphere(const cv::Point2f& image_point, const cv::Point2f& principal_point, double xi, double focal_inv, double ray[3])
+{
+    const double mx = (image_point.x - principal_point.x) * focal_inv;
+    const double my = (image_point.y - principal_point.y) * focal_inv;
+    const double r2 = mx * mx + my * my;
+    const double disc = 1.0 + (1.0 - xi * xi) * r2;
+    if (disc < 0) return false;     /* out of the field of view (xi > 1) */
+    const double factor = (xi + std::sqrt(disc)) / (r2 + 1.0);
+    ray[0] = factor * mx;
+    ray[1] = factor * my;
+    ray[2] = factor - xi;
+    return true;
+}
+
+/***
+* Mean squared distance [px^2] between the points and the image of the great circle fitted to them
+*   1. Virtual pinhole camera looking at the center of the segment (gnomonic projection: a great circle becomes a straight line)
+*   2. Line fitting on the virtual image plane -> normal of the plane of the great circle
+*   3. Distance on the distorted image = (normal . ray) / |gradient of (normal . ray) on the image|
+***/
+static float CalculateSegmentCost(const std::vector<cv::Point2f>& segment, const cv::Point2f& principal_point, double xi, double focal_inv)
+{
+    /*** Direction of the virtual camera = mean of the rays ***/
+    const int32_t point_num = static_cast<int32_t>(segment.size());
+    double ray_list[kSamplePointNum][3];
+    if (point_num > kSamplePointNum) return kInvalidCost;
+    double center[3] = { 0, 0, 0 };
+    for (int32_t i = 0; i < point_num; i++) {
+        double* ray = ray_list[i];
+        if (!LiftToSphere(segment[i], principal_point, xi, focal_inv, ray)) return kInvalidCost;
+        center[0] += ray[0];
+        center[1] += ray[1];
+        center[2] += ray[2];
+    }
+    const double center_norm = std::sqrt(center[0] * center[0] + center[1] * center[1] + center[2] * center[2]);
+    if (center_norm < 1e-12) return kInvalidCost;
+    for (auto& c : center) c /= center_norm;
+
+    /* Axes of the image plane of the virtual camera (perpendicular to center) */
+    double axis0[3];
+    if (std::abs(center[0]) < 0.9) {
+        /* axis0 = center x (1, 0, 0) */
+        axis0[0] = 0;
+        axis0[1] = center[2];
+        axis0[2] = -center[1];
+    } else {
+        /* axis0 = center x (0, 1, 0) */
+        axis0[0] = -center[2];
+        axis0[1] = 0;
+        axis0[2] = center[0];
+    }
+    const double axis0_norm = std::sqrt(axis0[0] * axis0[0] + axis0[1] * axis0[1] + axis0[2] * axis0[2]);
+    for (auto& a : axis0) a /= axis0_norm;
+    const double axis1[3] = {
+        center[1] * axis0[2] - center[2] * axis0[1],
+        center[2] * axis0[0] - center[0] * axis0[2],
+        center[0] * axis0[1] - center[1] * axis0[0],
+    };
+
+    /*** Line fitting on the virtual image plane ***/
+    double sum_a = 0, sum_b = 0, sum_aa = 0, sum_ab = 0, sum_bb = 0;
+    for (int32_t i = 0; i < point_num; i++) {
+        const double* ray = ray_list[i];
+        const double d = ray[0] * center[0] + ray[1] * center[1] + ray[2] * center[2];
+        if (d < kMinCosToCenter) return kInvalidCost;
+        const double a = (ray[0] * axis0[0] + ray[1] * axis0[1] + ray[2] * axis0[2]) / d;
+        const double b = (ray[0] * axis1[0] + ray[1] * axis1[1] + ray[2] * axis1[2]) / d;
+        sum_a += a;
+        sum_b += b;
+        sum_aa += a * a;
+        sum_ab += a * b;
+        sum_bb += b * b;
+    }
+    const double n_inv = 1.0 / point_num;
+    const double mean_a = sum_a * n_inv;
+    const double mean_b = sum_b * n_inv;
+    const double c_aa = sum_aa * n_inv - mean_a * mean_a;
+    const double c_ab = sum_ab * n_inv - mean_a * mean_b;
+    const double c_bb = sum_bb * n_inv - mean_b * mean_b;
+    const double eigen_max = (c_aa + c_bb) * 0.5 + std::sqrt((c_aa - c_bb) * (c_aa - c_bb) * 0.25 + c_ab * c_ab);
+    if (eigen_max <= 0) return kInvalidCost;
+    const double eigen_min = (std::max)(0.0, c_aa * c_bb - c_ab * c_ab) / eigen_max;   /* det / eigen_max (no cancellation) */
+
+    /* Normal of the line (eigen vector of eigen_min). Use the larger one of the two expressions for stability */
+    double line_a = c_ab;
+    double line_b = eigen_min - c_aa;
+    if (std::abs(eigen_min - c_bb) + std::abs(c_ab) > std::abs(line_a) + std::abs(line_b)) {
+        line_a = eigen_min - c_bb;
+        line_b = c_ab;
+    }
+    /* Plane through the origin which contains the line: line_a * (a - mean_a) + line_b * (b - mean_b) = 0 */
+    const double offset = line_a * mean_a + line_b * mean_b;
+    double normal[3];
+    for (int32_t k = 0; k < 3; k++) normal[k] = line_a * axis0[k] + line_b * axis1[k] - offset * center[k];
+    const double normal_norm = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (normal_norm < 1e-12) return kInvalidCost;
+    for (auto& n : normal) n /= normal_norm;
+
+    /*** Distance on the distorted image (the gradient by finite difference of 1 px) ***/
+    double sum_distance2 = 0;
+    for (int32_t i = 0; i < point_num; i++) {
+        const double* ray = ray_list[i];
+        double ray_du[3], ray_dv[3];
+        if (!LiftToSphere(segment[i] + cv::Point2f(1, 0), principal_point, xi, focal_inv, ray_du)) return kInvalidCost;
+        if (!LiftToSphere(segment[i] + cv::Point2f(0, 1), principal_point, xi, focal_inv, ray_dv)) return kInvalidCost;
+        const double value = normal[0] * ray[0] + normal[1] * ray[1] + normal[2] * ray[2];
+        const double gradient_u = normal[0] * ray_du[0] + normal[1] * ray_du[1] + normal[2] * ray_du[2] - value;
+        const double gradient_v = normal[0] * ray_dv[0] + normal[1] * ray_dv[1] + normal[2] * ray_dv[2] - value;
+        const double gradient2 = gradient_u * gradient_u + gradient_v * gradient_v;
+        if (gradient2 < 1e-24) return kInvalidCost;
+        sum_distance2 += value * value / gradient2;
+    }
+    return (std::min)(kInvalidCost, static_cast<float>(sum_distance2 * n_inv));
+}
+
+bool FisheyeParameterEstimator::Estimate(const cv::Mat& image, Result& result)
+{
+    if (image.empty()) {
+        printf("[FisheyeParameterEstimator::Estimate] invalid input\n");
+        return false;
+    }
+    DetectSegments(image, segment_list_);
+    const float diagonal = std::sqrt(static_cast<float>(image.cols * image.cols + image.rows * image.rows));
+    const cv::Point2f principal_point(image.cols / 2.0f, image.rows / 2.0f);
+    return Optimize(segment_list_, principal_point, diagonal * focal_min_ratio_, diagonal * focal_max_ratio_, result);
+}
+
+void FisheyeParameterEstimator::DetectSegments(const cv::Mat& image, std::vector<std::vector<cv::Point2f>>& segment_list) const
+{
+    segment_list.clear();
+
+    cv::Mat image_gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, image_gray, cv::COLOR_BGR2GRAY);
+    } else {
+        image_gray = image.clone();
+    }
+    cv::GaussianBlur(image_gray, image_gray, cv::Size(3, 3), 0);
+    cv::Mat image_edge;
+    cv::Canny(image_gray, image_edge, kCannyThreshold1, kCannyThreshold2);
+    std::vector<std::vector<cv::Point>> contour_list;
+    cv::findContours(image_edge, contour_list, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+
+    /*** Trace each edge once, cut it into segments, and sample a few points from each segment ***/
+    /* findContours traces a thin edge forth and back, so the pixels already traced end the chain */
+    cv::Mat mat_traced = cv::Mat::zeros(image_edge.size(), CV_8UC1);
+    std::vector<std::vector<cv::Point2f>> segment_list_all;
+    std::vector<cv::Point> chain;
+    auto CutChain = [&]() {
+        for (int32_t start = 0; start + segment_length_ <= static_cast<int32_t>(chain.size()); start += segment_length_) {
+            const int32_t end = start + segment_length_ - 1;
+            const float chord = static_cast<float>(cv::norm(chain[end] - chain[start]));
+            if (chord < kMinChordRatio * segment_length_) continue;
+
+            std::vector<cv::Point2f> segment(kSamplePointNum);
+            for (int32_t i = 0; i < kSamplePointNum; i++) {
+                const int32_t index = start + (segment_length_ - 1) * i / (kSamplePointNum - 1);
+                const int32_t index_start = (std::max)(start, index - kSampleSmoothRadius);
+                const int32_t index_end = (std::min)(end, index + kSampleSmoothRadius);
+                cv::Point2f p(0, 0);
+                for (int32_t j = index_start; j <= index_end; j++) {
+                    p.x += static_cast<float>(chain[j].x);
+                    p.y += static_cast<float>(chain[j].y);
+                }
+                segment[i] = p * (1.0f / (index_end - index_start + 1));
+            }
+            segment_list_all.push_back(segment);
+        }
+        chain.clear();
+    };
+    for (const auto& contour : contour_list) {
+        for (const auto& point : contour) {
+            uint8_t& is_traced = mat_traced.at<uint8_t>(point.y, point.x);
+            if (is_traced) {
+                CutChain();
+            } else {
+                is_traced = 1;
+                chain.push_back(point);
+            }
+        }
+        CutChain();
+    }
+
+    /* Too many segments don't improve the accuracy, so sample them evenly */
+    const int32_t segment_num_all = static_cast<int32_t>(segment_list_all.size());
+    const int32_t segment_num = (std::min)(segment_num_all, max_segment_num_);
+    for (int32_t i = 0; i < segment_num; i++) {
+        segment_list.push_back(segment_list_all[static_cast<int64_t>(i) * segment_num_all / segment_num]);
+    }
+}
+
+float FisheyeParameterEstimator::CalculateCost(const std::vector<std::vector<cv::Point2f>>& segment_list, const cv::Point2f& principal_point, float xi, float focal_length) const
+{
+    const int32_t segment_num = static_cast<int32_t>(segment_list.size());
+    if (segment_num == 0 || focal_length <= 0) return kInvalidCost;
+    std::vector<float> cost_list(segment_num);
+    const double focal_inv = 1.0 / focal_length;
+    for (int32_t i = 0; i < segment_num; i++) {
+        cost_list[i] = CalculateSegmentCost(segment_list[i], principal_point, xi, focal_inv);
+    }
+
+    /* Truncated mean: curved edges in the scene (not lines) are not straight with any parameter, so they are clamped */
+    const float outlier_cost = outlier_threshold_ * outlier_threshold_;
+    double sum = 0;
+    for (int32_t i = 0; i < segment_num; i++) sum += (std::min)(cost_list[i], outlier_cost);
+    return static_cast<float>(sum / segment_num);
+}
+
+bool FisheyeParameterEstimator::Optimize(const std::vector<std::vector<cv::Point2f>>& segment_list, const cv::Point2f& principal_point, float focal_min, float focal_max, Result& result) const
+{
+    if (static_cast<int32_t>(segment_list.size()) < kMinSegmentNum || focal_min <= 0 || focal_max < focal_min || xi_max_ < xi_min_) {
+        printf("[FisheyeParameterEstimator::Optimize] not enough segments (%zu) or invalid range\n", segment_list.size());
+        return false;
+    }
+
+    /*** Evaluate candidates (xi, log(f)) on a grid in parallel ***/
+    const double log_focal_min = std::log(focal_min);
+    const double log_focal_max = std::log(focal_max);
+    double best_xi = 0;
+    double best_log_focal = 0;
+    float best_cost = (std::numeric_limits<float>::max)();
+    int32_t evaluation_num = 0;
+    auto EvaluateGrid = [&](double xi_center, double log_focal_center, double step_xi, double step_log_focal, int32_t radius) {
+        const int32_t grid_num = 2 * radius + 1;
+        std::vector<double> xi_list(grid_num * grid_num);
+        std::vector<double> log_focal_list(grid_num * grid_num);
+        std::vector<float> cost_list(grid_num * grid_num);
+        for (int32_t i = 0; i < grid_num * grid_num; i++) {
+            xi_list[i] = (std::max)(static_cast<double>(xi_min_), (std::min)(static_cast<double>(xi_max_), xi_center + (i % grid_num - radius) * step_xi));
+            log_focal_list[i] = (std::max)(log_focal_min, (std::min)(log_focal_max, log_focal_center + (i / grid_num - radius) * step_log_focal));
+        }
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int32_t i = 0; i < grid_num * grid_num; i++) {
+            cost_list[i] = CalculateCost(segment_list, principal_point, static_cast<float>(xi_list[i]), static_cast<float>(std::exp(log_focal_list[i])));
+        }
+        for (int32_t i = 0; i < grid_num * grid_num; i++) {
+            if (cost_list[i] < best_cost) {
+                best_cost = cost_list[i];
+                best_xi = xi_list[i];
+                best_log_focal = log_focal_list[i];
+            }
+        }
+        evaluation_num += grid_num * grid_num;
+    };
+
+    /* Coarse: the whole range */
+    double step_xi = (xi_max_ - xi_min_) / (kCoarseGridNum - 1);
+    double step_log_focal = (log_focal_max - log_focal_min) / (kCoarseGridNum - 1);
+    const int32_t coarse_radius = (kCoarseGridNum - 1) / 2;
+    EvaluateGrid((xi_min_ + xi_max_) * 0.5, (log_focal_min + log_focal_max) * 0.5, step_xi, step_log_focal, coarse_radius);
+
+    /* Refine: halve the step around the best one */
+    for (int32_t iteration = 0; iteration < kRefineIterationNum; iteration++) {
+        step_xi *= 0.5;
+        step_log_focal *= 0.5;
+        EvaluateGrid(best_xi, best_log_focal, step_xi, step_log_focal, kRefineGridRadius);
+    }
+
+    result.xi = static_cast<float>(best_xi);
+    result.focal_length = static_cast<float>(std::exp(best_log_focal));
+    result.cost = best_cost;
+    result.segment_num = static_cast<int32_t>(segment_list.size());
+    result.evaluation_num = evaluation_num;
+    return true;
+}
+
+void FisheyeParameterEstimator::DrawSegments(cv::Mat& image, const std::vector<std::vector<cv::Point2f>>& segment_list)
+{
+    for (const auto& segment : segment_list) {
+        for (size_t i = 1; i < segment.size(); i++) {
+            cv::line(image, segment[i - 1], segment[i], cv::Scalar(0, 255, 0), 1);
+        }
+    }
+}
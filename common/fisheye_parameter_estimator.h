@@ -0,0 +1,86 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef FISHEYE_PARAMETER_ESTIMATOR_
+#define FISHEYE_PARAMETER_ESTIMATOR_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Automatic estimation of xi and focal length of the unified projection model from straight lines
+*   - Edges (Canny) are traced and cut into short segments. Only a few points of each segment are used
+*   - A straight line in 3D is a great circle on the unit sphere. For each candidate (xi, f), the points are lifted
+*     onto the sphere and a great circle is fitted to them
+*   - Cost = mean squared distance [px^2] between the points and the image of the great circle. It's measured on the distorted image
+*     because straightness on the sphere can be cheated by a parameter which squashes the points
+*   - Curved edges in the scene (not lines) are outliers, so the cost of each segment is clamped at outlier_threshold^2
+*   - Candidates are evaluated in parallel on a coarse grid (xi: linear, f: log), then the grid is refined around the best one
+*   - Full images are never remapped, so the estimation takes only some tens of milliseconds
+*   - The principal point is the image center, and f_dist = f_undist (the same as undistortion_manual_unified_projection)
+***/
+class FisheyeParameterEstimator
+{
+public:
+    static constexpr float kDefaultXiMin = 0.01f;
+    static constexpr float kDefaultXiMax = 1.2f;
+    static constexpr float kDefaultFocalMinRatio = 0.1f;    /* relative to the image diagonal */
+    static constexpr float kDefaultFocalMaxRatio = 1.2f;
+    static constexpr int32_t kDefaultSegmentLength = 150;   /* [px] (number of edge pixels). Longer segments show the distortion better */
+    static constexpr int32_t kDefaultMaxSegmentNum = 512;
+    static constexpr float kDefaultOutlierThreshold = 1.0f; /* [px] */
+
+    typedef struct Result_ {
+        float xi;
+        float focal_length;
+        float cost;
+        int32_t segment_num;
+        int32_t evaluation_num;
+    } Result;
+
+public:
+    FisheyeParameterEstimator(float xi_min = kDefaultXiMin, float xi_max = kDefaultXiMax, float focal_min_ratio = kDefaultFocalMinRatio, float focal_max_ratio = kDefaultFocalMaxRatio,
+        int32_t segment_length = kDefaultSegmentLength, int32_t max_segment_num = kDefaultMaxSegmentNum, float outlier_threshold = kDefaultOutlierThreshold)
+        : xi_min_(xi_min), xi_max_(xi_max), focal_min_ratio_(focal_min_ratio), focal_max_ratio_(focal_max_ratio),
+        segment_length_(segment_length), max_segment_num_(max_segment_num), outlier_threshold_(outlier_threshold) {}
+    ~FisheyeParameterEstimator() {}
+
+    /* DetectSegments + Optimize */
+    bool Estimate(const cv::Mat& image, Result& result);
+    /* Edge segments of the (distorted) image. Each segment has a few points sampled along the edge */
+    void DetectSegments(const cv::Mat& image, std::vector<std::vector<cv::Point2f>>& segment_list) const;
+    bool Optimize(const std::vector<std::vector<cv::Point2f>>& segment_list, const cv::Point2f& principal_point, float focal_min, float focal_max, Result& result) const;
+    /* Cost of one candidate. Smaller is straighter */
+    float CalculateCost(const std::vector<std::vector<cv::Point2f>>& segment_list, const cv::Point2f& principal_point, float xi, float focal_length) const;
+
+    const std::vector<std::vector<cv::Point2f>>& GetSegmentList() const { return segment_list_; }
+    static void DrawSegments(cv::Mat& image, const std::vector<std::vector<cv::Point2f>>& segment_list);
+
+private:
+    float xi_min_;
+    float xi_max_;
+    float focal_min_ratio_;
+    float focal_max_ratio_;
+    int32_t segment_length_;
+    int32_t max_segment_num_;
+    float outlier_threshold_;
+    std::vector<std::vector<cv::Point2f>> segment_list_;    /* detected by the last Estimate */
+};
+
+#endif
@@ -0,0 +1,156 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <array>
+#include <chrono>
+
+#include "instrumentation.h"
+#include "frame_scheduler.h"
+
+/*** Macro ***/
+static constexpr int32_t kMaxConsecutiveSkipNum = 30;   /* to avoid starvation when every frame is late */
+
+
+/*** Function ***/
+FrameScheduler::FrameScheduler(double target_latency_ms, Instrumentation* instrumentation)
+    : target_latency_ms_(target_latency_ms), instrumentation_(instrumentation)
+{
+    mode_ = kModeFull;
+    frame_cnt_since_change_ = 0;
+    frame_cnt_since_refresh_ = 0;
+    consecutive_skip_num_ = 0;
+    latency_ewma_ms_ = 0;
+    cost_ewma_ms_list_.fill(0);
+    is_processing_ = false;
+    processing_mode_ = kModeFull;
+}
+
+const char* FrameScheduler::GetModeName(int32_t mode)
+{
+    switch (mode) {
+    case kModeFull: return "Full";
+    case kModeReducedInput: return "ReducedInput";
+    case kModeRoiOnly: return "RoiOnly";
+    case kModeTrack: return "Track";
+    default: return "Unknown";
+    }
+}
+
+FrameScheduler::Decision FrameScheduler::BeginFrame(Clock::time_point capture_time)
+{
+    const Clock::time_point time_now = Clock::now();
+    const double wait_ms = std::chrono::duration<double, std::milli>(time_now - capture_time).count();
+
+    Decision decision;
+    decision.mode = mode_;
+    decision.is_skip = false;
+    decision.model_input_scale_percent = 100;
+    decision.is_full_detection = true;
+
+    /*** Drop the frame which has already missed its deadline before processing ***/
+    if (wait_ms > target_latency_ms_ && consecutive_skip_num_ < kMaxConsecutiveSkipNum) {
+        consecutive_skip_num_++;
+        decision.is_skip = true;
+        if (instrumentation_) instrumentation_->Record("scheduler.skip_wait", wait_ms);
+        return decision;
+    }
+    consecutive_skip_num_ = 0;
+
+    /*** Adapt mode using the latency of the previous frames ***/
+    frame_cnt_since_change_++;
+    if (latency_ewma_ms_ > target_latency_ms_ && frame_cnt_since_change_ >= kDowngradeIntervalFrame && mode_ < kModeNum - 1) {
+        /* Jump to the best mode whose learned cost meets the deadline. Step by one if unknown */
+        int32_t mode_new = mode_ + 1;
+        for (int32_t mode = mode_ + 1; mode < kModeNum; mode++) {
+            if (cost_ewma_ms_list_[mode] > 0 && cost_ewma_ms_list_[mode] < target_latency_ms_ * kHeadroomRatio) {
+                mode_new = mode;
+                break;
+            }
+        }
+        char text[128];
+        snprintf(text, sizeof(text), "latency %.1f > target %.1f [ms]", latency_ewma_ms_, target_latency_ms_);
+        ChangeMode(mode_new, text);
+    } else if (latency_ewma_ms_ > 0 && latency_ewma_ms_ < target_latency_ms_ * kHeadroomRatio && frame_cnt_since_change_ >= kUpgradeIntervalFrame && mode_ > kModeFull) {
+        /* Restore quality only when the better mode is expected to meet the deadline. Probe it once in a while because the cost may change */
+        double cost_better = cost_ewma_ms_list_[mode_ - 1];
+        if (cost_better < target_latency_ms_ || frame_cnt_since_change_ >= kUpgradeIntervalFrame * 4) {
+            char text[128];
+            snprintf(text, sizeof(text), "latency %.1f < headroom %.1f [ms]", latency_ewma_ms_, target_latency_ms_ * kHeadroomRatio);
+            ChangeMode(mode_ - 1, text);
+        }
+    }
+
+    decision.mode = mode_;
+    switch (mode_) {
+    case kModeFull:
+        break;
+    case kModeReducedInput:
+        decision.model_input_scale_percent = kReducedInputScalePercent;
+        break;
+    case kModeRoiOnly:
+    case kModeTrack:
+    default:
+        decision.model_input_scale_percent = kReducedInputScalePercent;
+        decision.is_full_detection = (frame_cnt_since_refresh_ >= kRefreshIntervalFrame);
+        break;
+    }
+    if (decision.is_full_detection) {
+        frame_cnt_since_refresh_ = 0;
+    } else {
+        frame_cnt_since_refresh_++;
+    }
+
+    is_processing_ = true;
+    processing_mode_ = mode_;
+    time_capture_ = capture_time;
+    time_begin_ = time_now;
+    return decision;
+}
+
+void FrameScheduler::EndFrame()
+{
+    if (!is_processing_) return;
+    is_processing_ = false;
+
+    const Clock::time_point time_end = Clock::now();
+    const double latency_ms = std::chrono::duration<double, std::milli>(time_end - time_capture_).count();
+    const double cost_ms = std::chrono::duration<double, std::milli>(time_end - time_begin_).count();
+
+    latency_ewma_ms_ = (latency_ewma_ms_ == 0) ? latency_ms : kEwmaAlpha * latency_ms + (1 - kEwmaAlpha) * latency_ewma_ms_;
+    double& cost_ewma_ms = cost_ewma_ms_list_[processing_mode_];
+    cost_ewma_ms = (cost_ewma_ms == 0) ? cost_ms : kEwmaAlpha * cost_ms + (1 - kEwmaAlpha) * cost_ewma_ms;
+
+    if (instrumentation_) {
+        instrumentation_->Record("scheduler.latency", latency_ms);
+        instrumentation_->Record(std::string("scheduler.cost.") + GetModeName(processing_mode_), cost_ms);
+        instrumentation_->Record("scheduler.mode", processing_mode_);
+    }
+}
+
+void FrameScheduler::ChangeMode(int32_t mode_new, const std::string& reason)
+{
+    if (mode_new == mode_) return;
+    if (instrumentation_) {
+        instrumentation_->RecordEvent("scheduler.mode_change", std::string(GetModeName(mode_)) + " -> " + GetModeName(mode_new) + " (" + reason + ")");
+    }
+    mode_ = mode_new;
+    frame_cnt_since_change_ = 0;
+    latency_ewma_ms_ = 0;   /* the latency of the previous mode is not valid any more. The next sample reseeds it (avoid a cascade of downgrades by one spike) */
+    frame_cnt_since_refresh_ = kRefreshIntervalFrame;  /* detect on the whole image at the first frame of the new mode */
+}
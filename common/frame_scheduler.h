@@ -0,0 +1,94 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef FRAME_SCHEDULER_
+#define FRAME_SCHEDULER_
+
+/* for general */
+#include <cstdint>
+#include <string>
+#include <array>
+#include <chrono>
+
+#include "instrumentation.h"
+
+
+/***
+* Deadline-aware frame scheduler
+*   - Each frame has a deadline = capture time + target latency
+*   - When the end-to-end latency exceeds the target, the processing mode is degraded to a cheaper one
+*   - When there is enough headroom for a while, the mode is restored step by step
+*   - The processing cost of each mode is learned, so that the scheduler can jump to a mode which meets the deadline
+*   - Frames which have already missed the deadline before processing are skipped
+***/
+class FrameScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /* Degradation ladder (from the best quality to the cheapest) */
+    enum {
+        kModeFull = 0,          /* Detect on the whole image with the full model input size */
+        kModeReducedInput,      /* Detect on the whole image with a smaller model input size */
+        kModeRoiOnly,           /* Detect only around the previous results (full detection periodically) */
+        kModeTrack,             /* Track the previous results instead of detection (full detection periodically) */
+        kModeNum,
+    };
+
+    typedef struct Decision_ {
+        int32_t mode;
+        bool is_skip;               /* true: drop this frame without processing */
+        int32_t model_input_scale_percent;  /* model input size relative to the full size */
+        bool is_full_detection;     /* true: detect on the whole image even in RoiOnly/Track mode (refresh) */
+    } Decision;
+
+public:
+    FrameScheduler(double target_latency_ms, Instrumentation* instrumentation = nullptr);
+    ~FrameScheduler() {}
+
+    Decision BeginFrame(Clock::time_point capture_time);
+    void EndFrame();
+
+    int32_t GetMode() const { return mode_; }
+    double GetLatencyMs() const { return latency_ewma_ms_; }
+    static const char* GetModeName(int32_t mode);
+
+private:
+    void ChangeMode(int32_t mode_new, const std::string& reason);
+
+private:
+    static constexpr double kEwmaAlpha = 0.2;
+    static constexpr double kHeadroomRatio = 0.6;       /* restore quality when latency < target * ratio */
+    static constexpr int32_t kUpgradeIntervalFrame = 30;
+    static constexpr int32_t kDowngradeIntervalFrame = 3;
+    static constexpr int32_t kRefreshIntervalFrame = 10; /* full detection interval in RoiOnly/Track mode */
+    static constexpr int32_t kReducedInputScalePercent = 60;
+
+    double target_latency_ms_;
+    Instrumentation* instrumentation_;
+
+    int32_t mode_;
+    int32_t frame_cnt_since_change_;
+    int32_t frame_cnt_since_refresh_;
+    int32_t consecutive_skip_num_;
+    double latency_ewma_ms_;                             /* 0 = no sample since the last mode change */
+    std::array<double, kModeNum> cost_ewma_ms_list_;     /* 0 = unknown */
+
+    bool is_processing_;
+    int32_t processing_mode_;
+    Clock::time_point time_capture_;
+    Clock::time_point time_begin_;
+};
+
+#endif
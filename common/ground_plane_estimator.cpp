@@ -0,0 +1,242 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+#include "pose.h"
+#include "ground_plane_estimator.h"
+
+/*** Macro ***/
+static constexpr int32_t kMinSampleNum = 30;
+static constexpr int32_t kRefineIterationNum = 2;
+
+
+/*** Function ***/
+/* xorshift32. Each hypothesis has its own seed, so the result doesn't depend on the number of threads */
+static inline uint32_t NextRandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* Rotation vector [rad] which rotates (0, -1, 0) (world up) to normal */
+static void ConvertNormal2RotationVector(const cv::Point3f& normal, float& rx, float& rz)
+{
+    /* axis = (0, -1, 0) x normal = (-nz, 0, nx), angle = acos(-ny) */
+    const float s = std::sqrt(normal.x * normal.x + normal.z * normal.z);
+    const float theta = std::acos((std::max)(-1.0f, (std::min)(1.0f, -normal.y)));
+    if (s < 1e-8f) {
+        rx = 0;
+        rz = 0;
+        return;
+    }
+    rx = -normal.z / s * theta;
+    rz = normal.x / s * theta;
+}
+
+/* Yaw [rad] of the rotation (world -> camera): heading of the forward axis (Zc) projected onto the ground plane */
+/* The same as ry of R = R_yaw(ry). The right axis (Xc) is used if the camera looks straight up or down */
+static float GetYaw(const Quaternion& q)
+{
+    const Quaternion q_inv = q.Conjugate();
+    const cv::Point3f forward = q_inv.Rotate(cv::Point3f(0, 0, 1));
+    if (forward.x * forward.x + forward.z * forward.z > 1e-6f) {
+        return std::atan2(-forward.x, forward.z);
+    }
+    const cv::Point3f right = q_inv.Rotate(cv::Point3f(1, 0, 0));
+    return std::atan2(right.z, right.x);
+}
+
+bool GroundPlaneEstimator::Estimate(CameraModel& camera, const cv::Mat& mat_depth, Result& result)
+{
+    if (mat_depth.type() != CV_32FC1 || mat_depth.empty() || sample_stride_ <= 0) {
+        printf("[GroundPlaneEstimator::Estimate] invalid input\n");
+        return false;
+    }
+
+    /*** Sample pixels below the horizon ***/
+    const float scale_x = static_cast<float>(mat_depth.cols) / camera.width;
+    const float scale_y = static_cast<float>(mat_depth.rows) / camera.height;
+    int32_t row_start, row_end;
+    camera.GetGroundRowRange(row_start, row_end);
+    std::vector<cv::Point2f> image_point_list;
+    std::vector<float> depth_list;
+    for (int32_t y = row_start + sample_stride_ / 2; y < row_end; y += sample_stride_) {
+        const float* depth_row = mat_depth.ptr<float>((std::min)(static_cast<int32_t>(y * scale_y), mat_depth.rows - 1));
+        for (int32_t x = sample_stride_ / 2; x < camera.width; x += sample_stride_) {
+            if (!camera.IsGround(static_cast<float>(x), static_cast<float>(y))) continue;
+            const float depth = depth_row[(std::min)(static_cast<int32_t>(x * scale_x), mat_depth.cols - 1)];
+            if (depth > 0 && depth < max_depth_) {
+                image_point_list.push_back(cv::Point2f(static_cast<float>(x), static_cast<float>(y)));
+                depth_list.push_back(depth);
+            }
+        }
+    }
+
+    /*** Px, Py, Zc -> Mc ***/
+    std::vector<cv::Point3f> object_point_in_camera_list;
+    camera.ConvertImage2Camera(image_point_list, depth_list, object_point_in_camera_list);
+
+    const cv::Point3f normal_expected = camera.GetPose().q().Rotate(cv::Point3f(0, -1, 0));
+    return Estimate(object_point_in_camera_list, normal_expected, result);
+}
+
+bool GroundPlaneEstimator::Estimate(const std::vector<cv::Point3f>& object_point_in_camera_list, const cv::Point3f& normal_expected, Result& result)
+{
+    const std::vector<cv::Point3f>& point_list = object_point_in_camera_list;
+    const int32_t point_num = static_cast<int32_t>(point_list.size());
+    result.sample_num = point_num;
+    result.inlier_num = 0;
+    if (point_num < kMinSampleNum || iteration_num_ <= 0) {
+        printf("[GroundPlaneEstimator::Estimate] not enough points (%d)\n", point_num);
+        return false;
+    }
+    const float cos_max_tilt = std::cos(Deg2Rad(max_tilt_deg_));
+    const float threshold_sq = inlier_threshold_ * inlier_threshold_;
+
+    /*** RANSAC: each hypothesis is scored independently ***/
+    std::vector<double> cost_list(iteration_num_, std::numeric_limits<double>::max());
+    std::vector<cv::Vec4f> plane_list(iteration_num_);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 8)
+#endif
+    for (int32_t i = 0; i < iteration_num_; i++) {
+        uint32_t state = 0x9E3779B9u * (i + 1);
+        const cv::Point3f& p0 = point_list[NextRandom(state) % point_num];
+        const cv::Point3f& p1 = point_list[NextRandom(state) % point_num];
+        const cv::Point3f& p2 = point_list[NextRandom(state) % point_num];
+        cv::Point3f normal = (p1 - p0).cross(p2 - p0);
+        const float norm = std::sqrt(normal.dot(normal));
+        if (norm < 1e-9f) continue;     /* degenerate */
+        normal = normal * (1.0f / norm);
+        float distance = -normal.dot(p0);
+        if (distance < 0) {
+            normal = -normal;
+            distance = -distance;
+        }
+        if (normal.dot(normal_expected) < cos_max_tilt) continue;
+
+        double cost = 0;
+        for (const auto& p : point_list) {
+            const float r = normal.dot(p) + distance;
+            cost += (std::min)(r * r, threshold_sq);
+        }
+        cost_list[i] = cost;
+        plane_list[i] = cv::Vec4f(normal.x, normal.y, normal.z, distance);
+    }
+    const int32_t best = static_cast<int32_t>(std::min_element(cost_list.begin(), cost_list.end()) - cost_list.begin());
+    if (cost_list[best] == std::numeric_limits<double>::max()) {
+        printf("[GroundPlaneEstimator::Estimate] no valid plane\n");
+        return false;
+    }
+    cv::Point3f normal(plane_list[best][0], plane_list[best][1], plane_list[best][2]);
+    float distance = plane_list[best][3];
+
+    /*** Least-squares refinement with the inliers ***/
+    std::vector<uint8_t> is_inlier_list(point_num);
+    for (int32_t iteration = 0; iteration <= kRefineIterationNum; iteration++) {
+        int32_t inlier_num = 0;
+        for (int32_t i = 0; i < point_num; i++) {
+            is_inlier_list[i] = std::abs(normal.dot(point_list[i]) + distance) < inlier_threshold_;
+            inlier_num += is_inlier_list[i];
+        }
+        result.inlier_num = inlier_num;
+        if (iteration == kRefineIterationNum || inlier_num < 3) break;
+        if (!FitPlane(point_list, is_inlier_list, normal, distance)) break;
+    }
+
+    result.normal = normal;
+    result.distance = distance;
+    float rx, rz;
+    ConvertNormal2RotationVector(normal, rx, rz);
+    result.pitch_deg = Rad2Deg(rx);
+    result.roll_deg = Rad2Deg(rz);
+    return true;
+}
+
+bool GroundPlaneEstimator::FitPlane(const std::vector<cv::Point3f>& point_list, const std::vector<uint8_t>& is_inlier_list, cv::Point3f& normal, float& distance) const
+{
+    /* The normal is the eigenvector of the smallest eigenvalue of the covariance */
+    double sum[3] = { 0, 0, 0 };
+    int32_t num = 0;
+    for (size_t i = 0; i < point_list.size(); i++) {
+        if (!is_inlier_list[i]) continue;
+        sum[0] += point_list[i].x;
+        sum[1] += point_list[i].y;
+        sum[2] += point_list[i].z;
+        num++;
+    }
+    const double mean[3] = { sum[0] / num, sum[1] / num, sum[2] / num };
+    cv::Mat cov = cv::Mat::zeros(3, 3, CV_64FC1);
+    double* c = cov.ptr<double>(0);
+    for (size_t i = 0; i < point_list.size(); i++) {
+        if (!is_inlier_list[i]) continue;
+        const double d[3] = { point_list[i].x - mean[0], point_list[i].y - mean[1], point_list[i].z - mean[2] };
+        for (int32_t r = 0; r < 3; r++) {
+            for (int32_t col = r; col < 3; col++) c[r * 3 + col] += d[r] * d[col];
+        }
+    }
+    c[3] = c[1];
+    c[6] = c[2];
+    c[7] = c[5];
+
+    cv::Mat eigen_value_list, eigen_vector_list;
+    if (!cv::eigen(cov, eigen_value_list, eigen_vector_list)) return false;
+    const double* e = eigen_vector_list.ptr<double>(2);     /* descending order */
+    cv::Point3f normal_new(static_cast<float>(e[0]), static_cast<float>(e[1]), static_cast<float>(e[2]));
+    if (normal_new.dot(normal) < 0) normal_new = -normal_new;
+    const float distance_new = -static_cast<float>(normal_new.x * mean[0] + normal_new.y * mean[1] + normal_new.z * mean[2]);
+    if (distance_new <= 0) return false;    /* the camera must be above the ground */
+    normal = normal_new;
+    distance = distance_new;
+    return true;
+}
+
+void GroundPlaneEstimator::ApplyToCamera(const Result& result, CameraModel& camera, bool is_height_update)
+{
+    /* R = R_tilt * R_yaw, so that R * (0, -1, 0) = normal and yaw is kept */
+    /* R_yaw doesn't change the normal. R_tilt adds its own yaw, so R_yaw takes the rest */
+    float rx, rz;
+    ConvertNormal2RotationVector(result.normal, rx, rz);
+    const Quaternion q_tilt = Quaternion::FromRotationVector(rx, 0, rz);
+    const float yaw = GetYaw(camera.GetPose().q()) - GetYaw(q_tilt);
+    const Quaternion q = q_tilt * Quaternion::FromRotationVector(0, yaw, 0);
+    float rx_new, ry_new, rz_new;
+    q.ToRotationVector(rx_new, ry_new, rz_new);
+    camera.SetCameraAngle(Rad2Deg(rx_new), Rad2Deg(ry_new), Rad2Deg(rz_new));
+
+    if (is_height_update) {
+        std::array<float, 3> rvec_deg;
+        std::array<float, 3> tvec;
+        camera.GetExtrinsic(rvec_deg, tvec, true);
+        camera.SetCameraPos(tvec[0], -result.distance, tvec[2], true);
+    }
+}
@@ -0,0 +1,80 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef GROUND_PLANE_ESTIMATOR_
+#define GROUND_PLANE_ESTIMATOR_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+
+/***
+* Self-calibration of the camera height and pitch / roll from a reconstructed point cloud
+*   - Only pixels below the horizon of the current camera parameters are sampled (strided)
+*   - RANSAC (MSAC cost) over plane hypotheses in parallel, then least-squares refinement using the inliers
+*   - Hypotheses tilted too much from the current ground normal are rejected (e.g. walls)
+*   - The plane is in the camera coordinate: normal . Mc + distance = 0, normal points to the camera (up)
+*     so distance is the camera height, and the rotation from (0, -1, 0) to the normal gives pitch and roll
+*   - Yaw is not observable from the ground plane, so it's kept
+***/
+class GroundPlaneEstimator
+{
+public:
+    static constexpr int32_t kDefaultSampleStride = 8;          /* [px] */
+    static constexpr float kDefaultInlierThreshold = 0.05f;     /* [unit of depth] */
+    static constexpr int32_t kDefaultIterationNum = 200;
+    static constexpr float kDefaultMaxDepth = 20.0f;            /* [unit of depth] far points are noisy */
+    static constexpr float kDefaultMaxTiltDeg = 30.0f;          /* from the current ground normal */
+
+    typedef struct Result_ {
+        cv::Point3f normal;     /* unit vector in camera coordinate (toward the camera) */
+        float distance;         /* camera height */
+        float pitch_deg;        /* with yaw = 0 */
+        float roll_deg;
+        int32_t sample_num;
+        int32_t inlier_num;
+    } Result;
+
+public:
+    GroundPlaneEstimator(int32_t sample_stride = kDefaultSampleStride, float inlier_threshold = kDefaultInlierThreshold, int32_t iteration_num = kDefaultIterationNum,
+        float max_depth = kDefaultMaxDepth, float max_tilt_deg = kDefaultMaxTiltDeg)
+        : sample_stride_(sample_stride), inlier_threshold_(inlier_threshold), iteration_num_(iteration_num), max_depth_(max_depth), max_tilt_deg_(max_tilt_deg) {}
+    ~GroundPlaneEstimator() {}
+
+    /* mat_depth: CV_32FC1 (Zc), any size (scaled to the image size of camera) */
+    bool Estimate(CameraModel& camera, const cv::Mat& mat_depth, Result& result);
+    /* normal_expected: the current ground normal in camera coordinate */
+    bool Estimate(const std::vector<cv::Point3f>& object_point_in_camera_list, const cv::Point3f& normal_expected, Result& result);
+
+    /* SetCameraAngle (pitch, roll) and SetCameraPos (height). The height is meaningful only when the depth is metric by itself */
+    static void ApplyToCamera(const Result& result, CameraModel& camera, bool is_height_update = true);
+
+private:
+    bool FitPlane(const std::vector<cv::Point3f>& point_list, const std::vector<uint8_t>& is_inlier_list, cv::Point3f& normal, float& distance) const;
+
+private:
+    int32_t sample_stride_;
+    float inlier_threshold_;
+    int32_t iteration_num_;
+    float max_depth_;
+    float max_tilt_deg_;
+};
+
+#endif
@@ -0,0 +1,307 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+#include "pose.h"
+#include "icp_registration.h"
+
+/*** Macro ***/
+static constexpr int32_t kBlockSize = 4096;         /* points per partial sum of the normal equations */
+static constexpr int32_t kMinInlierNum = 64;
+static constexpr float kDepthEdgeRatio = 1.1f;      /* neighbors are not on the same surface if the depth ratio is larger than this */
+static constexpr double kConvergenceThreshold = 1e-5;
+
+/* Iterations for each level (level 0 = the finest) */
+static inline int32_t GetIterationNum(int32_t level)
+{
+    return (level == 0) ? 4 : (level == 1) ? 5 : 10;
+}
+
+
+/*** Function ***/
+static inline bool IsValidDepth(float d)
+{
+    return d > 0 && std::isfinite(d);
+}
+
+static inline bool IsSameSurface(float d0, float d1)
+{
+    return (std::max)(d0, d1) <= (std::min)(d0, d1) * kDepthEdgeRatio;
+}
+
+/* 2x2 average. A block across a depth discontinuity is invalid (not to make points in the air) */
+static void DownsampleDepth(const cv::Mat& mat_depth, cv::Mat& mat_depth_half)
+{
+    mat_depth_half = cv::Mat(mat_depth.rows / 2, mat_depth.cols / 2, CV_32FC1);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < mat_depth_half.rows; y++) {
+        const float* src0 = mat_depth.ptr<float>(y * 2);
+        const float* src1 = mat_depth.ptr<float>(y * 2 + 1);
+        float* dst = mat_depth_half.ptr<float>(y);
+        for (int32_t x = 0; x < mat_depth_half.cols; x++) {
+            const float d[4] = { src0[x * 2], src0[x * 2 + 1], src1[x * 2], src1[x * 2 + 1] };
+            float sum = 0, d_min = 0, d_max = 0;
+            int32_t num = 0;
+            for (float v : d) {
+                if (!IsValidDepth(v)) continue;
+                d_min = (num == 0) ? v : (std::min)(d_min, v);
+                d_max = (num == 0) ? v : (std::max)(d_max, v);
+                sum += v;
+                num++;
+            }
+            dst[x] = (num > 0 && IsSameSurface(d_min, d_max)) ? sum / num : 0.0f;
+        }
+    }
+}
+
+bool IcpRegistration::MakeFrame(CameraModel& camera, const cv::Mat& mat_depth, Frame& frame) const
+{
+    if (mat_depth.empty() || (mat_depth.type() != CV_32FC1 && mat_depth.type() != CV_16FC1) || level_num_ < 1) {
+        printf("[IcpRegistration::MakeFrame] invalid input\n");
+        return false;
+    }
+    cv::Mat mat_depth_level = mat_depth;
+    if (mat_depth.type() == CV_16FC1) mat_depth.convertTo(mat_depth_level, CV_32FC1);
+
+    frame.resize(level_num_);
+    for (int32_t l = 0; l < level_num_; l++) {
+        if (l > 0) DownsampleDepth(cv::Mat(mat_depth_level), mat_depth_level);
+        Level& level = frame[l];
+        level.cols = mat_depth_level.cols;
+        level.rows = mat_depth_level.rows;
+        if (level.cols < 2 || level.rows < 2) {
+            printf("[IcpRegistration::MakeFrame] depth map is too small for %d levels\n", level_num_);
+            return false;
+        }
+        level.scale_x = static_cast<float>(camera.width) / level.cols;
+        level.scale_y = static_cast<float>(camera.height) / level.rows;
+
+        /*** Vertex map: px, py, Zc -> Mc (the center of the pixel of this level in the image) ***/
+        const int32_t point_num = level.cols * level.rows;
+        std::vector<cv::Point2f> image_point_list(point_num);
+        std::vector<float> z_list(point_num);
+        for (int32_t y = 0; y < level.rows; y++) {
+            const float* depth_row = mat_depth_level.ptr<float>(y);
+            for (int32_t x = 0; x < level.cols; x++) {
+                const int32_t i = y * level.cols + x;
+                image_point_list[i] = cv::Point2f((x + 0.5f) * level.scale_x - 0.5f, (y + 0.5f) * level.scale_y - 0.5f);
+                z_list[i] = IsValidDepth(depth_row[x]) ? depth_row[x] : 0.0f;
+            }
+        }
+        camera.ConvertImage2Camera(image_point_list, z_list, level.vertex_list);
+        for (int32_t i = 0; i < point_num; i++) {
+            if (z_list[i] == 0) level.vertex_list[i] = cv::Point3f(0, 0, 0);
+        }
+
+        /*** Normal map: cross product of the differences to the right and lower neighbors ***/
+        level.normal_list.assign(point_num, cv::Point3f(0, 0, 0));
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+        for (int32_t y = 0; y < level.rows - 1; y++) {
+            for (int32_t x = 0; x < level.cols - 1; x++) {
+                const int32_t i = y * level.cols + x;
+                const cv::Point3f& v = level.vertex_list[i];
+                const cv::Point3f& v_right = level.vertex_list[i + 1];
+                const cv::Point3f& v_down = level.vertex_list[i + level.cols];
+                if (v.z <= 0 || v_right.z <= 0 || v_down.z <= 0 || !IsSameSurface(v.z, v_right.z) || !IsSameSurface(v.z, v_down.z)) continue;
+                cv::Point3f n = (v_right - v).cross(v_down - v);
+                const float norm = std::sqrt(n.dot(n));
+                if (norm < 1e-12f) continue;
+                n = n * ((n.dot(v) > 0) ? -1.0f / norm : 1.0f / norm);
+                level.normal_list[i] = n;
+            }
+        }
+    }
+    return true;
+}
+
+bool IcpRegistration::AlignFrame(CameraModel& camera, const Frame& frame_source, const Frame& frame_target, const Pose& pose_initial, Result& result) const
+{
+    const float cos_angle_threshold = std::cos(Deg2Rad(angle_threshold_deg_));
+    Pose pose = pose_initial;
+    result.inlier_num = 0;
+    result.rmse = 0;
+    result.iteration_num = 0;
+
+    for (int32_t l = level_num_ - 1; l >= 0; l--) {
+        const Level& source = frame_source[l];
+        const Level& target = frame_target[l];
+        const float distance_threshold = distance_threshold_ * (1 << l);
+        const float distance_threshold_sq = distance_threshold * distance_threshold;
+
+        /* Source points which have a normal */
+        std::vector<cv::Point3f> point_list;
+        std::vector<cv::Point3f> normal_list;
+        for (size_t i = 0; i < source.vertex_list.size(); i++) {
+            if (source.normal_list[i].z == 0 && source.normal_list[i].x == 0 && source.normal_list[i].y == 0) continue;
+            point_list.push_back(source.vertex_list[i]);
+            normal_list.push_back(source.normal_list[i]);
+        }
+        const int32_t point_num = static_cast<int32_t>(point_list.size());
+        const int32_t block_num = (point_num + kBlockSize - 1) / kBlockSize;
+        std::vector<cv::Point3f> point_transformed_list(point_num);
+        std::vector<cv::Point2f> image_point_list;
+        /* per block: A (upper triangle, 21), b (6), sum of squared error, inlier num */
+        std::vector<std::array<double, 29>> partial_sum_list(block_num);
+
+        for (int32_t iteration = 0; iteration < GetIterationNum(l); iteration++) {
+            /*** Projective data association ***/
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int32_t i = 0; i < point_num; i++) {
+                point_transformed_list[i] = pose.Transform(point_list[i]);
+            }
+            camera.ConvertCamera2Image(point_transformed_list, image_point_list);
+
+            /*** Normal equations of the point-to-plane error: r = n . (p - q), J = [p x n, n] ***/
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+            for (int32_t b = 0; b < block_num; b++) {
+                std::array<double, 29>& s = partial_sum_list[b];
+                s.fill(0);
+                const int32_t i_end = (std::min)(point_num, (b + 1) * kBlockSize);
+                for (int32_t i = b * kBlockSize; i < i_end; i++) {
+                    const cv::Point3f& p = point_transformed_list[i];
+                    if (p.z <= 0) continue;
+                    const int32_t x = static_cast<int32_t>(std::floor((image_point_list[i].x + 0.5f) / target.scale_x));
+                    const int32_t y = static_cast<int32_t>(std::floor((image_point_list[i].y + 0.5f) / target.scale_y));
+                    if (x < 0 || x >= target.cols || y < 0 || y >= target.rows) continue;
+                    const int32_t index = y * target.cols + x;
+                    const cv::Point3f& q = target.vertex_list[index];
+                    const cv::Point3f& n = target.normal_list[index];
+                    if (q.z <= 0 || (n.x == 0 && n.y == 0 && n.z == 0)) continue;
+                    const cv::Point3f diff = p - q;
+                    if (diff.dot(diff) > distance_threshold_sq) continue;
+                    if (n.dot(pose.q().Rotate(normal_list[i])) < cos_angle_threshold) continue;
+
+                    const double r = n.dot(diff);
+                    const cv::Point3f c = p.cross(n);
+                    const double J[6] = { c.x, c.y, c.z, n.x, n.y, n.z };
+                    int32_t k = 0;
+                    for (int32_t row = 0; row < 6; row++) {
+                        for (int32_t col = row; col < 6; col++) s[k++] += J[row] * J[col];
+                        s[21 + row] += J[row] * r;
+                    }
+                    s[27] += r * r;
+                    s[28] += 1;
+                }
+            }
+            std::array<double, 29> sum;
+            sum.fill(0);
+            for (const auto& s : partial_sum_list) {
+                for (int32_t k = 0; k < 29; k++) sum[k] += s[k];
+            }
+
+            const int32_t inlier_num = static_cast<int32_t>(sum[28]);
+            if (inlier_num < kMinInlierNum) {
+                printf("[IcpRegistration::AlignFrame] not enough correspondences (%d) at level %d\n", inlier_num, l);
+                return false;
+            }
+            result.inlier_num = inlier_num;
+            result.rmse = static_cast<float>(std::sqrt(sum[27] / inlier_num));
+            result.iteration_num++;
+
+            /*** Solve A * x = -b, then update the pose by the small motion x = (rotation vector, translation) ***/
+            cv::Mat A(6, 6, CV_64FC1);
+            cv::Mat b(6, 1, CV_64FC1);
+            int32_t k = 0;
+            for (int32_t row = 0; row < 6; row++) {
+                for (int32_t col = row; col < 6; col++) {
+                    A.at<double>(row, col) = sum[k];
+                    A.at<double>(col, row) = sum[k];
+                    k++;
+                }
+                b.at<double>(row) = -sum[21 + row];
+            }
+            cv::Mat x;
+            if (!cv::solve(A, b, x, cv::DECOMP_CHOLESKY)) {
+                printf("[IcpRegistration::AlignFrame] degenerate geometry at level %d\n", l);
+                return false;
+            }
+            const double* dx = x.ptr<double>(0);
+            const Pose pose_delta(Quaternion::FromRotationVector(static_cast<float>(dx[0]), static_cast<float>(dx[1]), static_cast<float>(dx[2])),
+                cv::Point3f(static_cast<float>(dx[3]), static_cast<float>(dx[4]), static_cast<float>(dx[5])));
+            pose = pose_delta * pose;
+
+            double update = 0;
+            for (int32_t j = 0; j < 6; j++) update += dx[j] * dx[j];
+            if (update < kConvergenceThreshold * kConvergenceThreshold) break;
+        }
+    }
+    result.pose = pose;
+    return true;
+}
+
+bool IcpRegistration::Align(CameraModel& camera, const cv::Mat& mat_depth_source, const cv::Mat& mat_depth_target, const Pose& pose_initial, Result& result)
+{
+    Frame frame_source;
+    Frame frame_target;
+    if (!MakeFrame(camera, mat_depth_source, frame_source) || !MakeFrame(camera, mat_depth_target, frame_target)) return false;
+    return AlignFrame(camera, frame_source, frame_target, pose_initial, result);
+}
+
+bool IcpRegistration::Register(CameraModel& camera, const cv::Mat& mat_depth, Result& result)
+{
+    result.pose = Pose();
+    result.inlier_num = 0;
+    result.rmse = 0;
+    result.iteration_num = 0;
+    Frame frame;
+    if (!MakeFrame(camera, mat_depth, frame)) return false;
+    if (frame_previous_.empty()) {
+        frame_previous_.swap(frame);
+        return false;
+    }
+
+    /* Constant velocity: the previous motion is the initial guess */
+    const bool is_aligned = AlignFrame(camera, frame, frame_previous_, pose_velocity_, result);
+    pose_velocity_ = is_aligned ? result.pose : Pose();
+    frame_previous_.swap(frame);
+    return is_aligned;
+}
+
+void IcpRegistration::Reset()
+{
+    frame_previous_.clear();
+    pose_velocity_ = Pose();
+}
+
+void IcpRegistration::ConvertPose2Extrinsic(const Pose& pose, std::array<float, 3>& rvec_deg, std::array<float, 3>& tvec)
+{
+    float rx, ry, rz;
+    pose.q().ToRotationVector(rx, ry, rz);
+    rvec_deg = { Rad2Deg(rx), Rad2Deg(ry), Rad2Deg(rz) };
+    tvec = { pose.t().x, pose.t().y, pose.t().z };
+}
@@ -0,0 +1,93 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef ICP_REGISTRATION_
+#define ICP_REGISTRATION_
+
+/* for general */
+#include <cstdint>
+#include <array>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+#include "pose.h"
+
+
+/***
+* Frame-to-frame registration of organized point clouds (point-to-plane ICP)
+*   - Each frame is a depth map (Zc) of the same camera. Vertex and normal maps are made for each level of a pyramid (x1/2 per level)
+*   - Correspondence: the point of the source frame is transformed by the current pose and projected with CameraModel
+*     to the pixel of the target frame (projective data association, no KD-tree)
+*   - The 6x6 normal equations of the linearized point-to-plane error are reduced in parallel (blocks), then solved
+*   - Coarse to fine: a few iterations on each level from the coarsest one
+*   - Register() is for video: the frame becomes the target of the next call, and the previous motion is the initial guess
+*
+* Result pose: source camera -> target camera (Mc_target = R * Mc_source + t)
+*   The pose of the source camera (world -> camera) = pose.Inverse() * (pose of the target camera)
+***/
+class IcpRegistration
+{
+public:
+    static constexpr int32_t kDefaultLevelNum = 3;
+    static constexpr float kDefaultDistanceThreshold = 0.1f;    /* [unit of depth] at level 0 (x2 per level) */
+    static constexpr float kDefaultAngleThresholdDeg = 30.0f;   /* between normals */
+
+    typedef struct Result_ {
+        Pose pose;
+        int32_t inlier_num;     /* at the last iteration of level 0 */
+        float rmse;             /* point-to-plane */
+        int32_t iteration_num;  /* total */
+    } Result;
+
+public:
+    IcpRegistration(int32_t level_num = kDefaultLevelNum, float distance_threshold = kDefaultDistanceThreshold, float angle_threshold_deg = kDefaultAngleThresholdDeg)
+        : level_num_(level_num), distance_threshold_(distance_threshold), angle_threshold_deg_(angle_threshold_deg) {}
+    ~IcpRegistration() {}
+
+    /* mat_depth: CV_32FC1 or CV_16FC1, any size (scaled to the image size of camera). Subsampled depth is enough */
+    /* false: the first frame, or not converged (the frame is kept as the next target in either case) */
+    bool Register(CameraModel& camera, const cv::Mat& mat_depth, Result& result);
+    bool Align(CameraModel& camera, const cv::Mat& mat_depth_source, const cv::Mat& mat_depth_target, const Pose& pose_initial, Result& result);
+    void Reset();
+
+    /* rvec [deg] and tvec (Ow - Oc in camera coordinate) for CameraModel::SetExtrinsic(rvec_deg, tvec, false) */
+    static void ConvertPose2Extrinsic(const Pose& pose, std::array<float, 3>& rvec_deg, std::array<float, 3>& tvec);
+
+private:
+    typedef struct Level_ {
+        int32_t cols;
+        int32_t rows;
+        float scale_x;                          /* pixel of this level -> pixel of the image */
+        float scale_y;
+        std::vector<cv::Point3f> vertex_list;   /* Mc. Invalid: z = 0 */
+        std::vector<cv::Point3f> normal_list;   /* toward the camera. Invalid: (0, 0, 0) */
+    } Level;
+    typedef std::vector<Level> Frame;
+
+    bool MakeFrame(CameraModel& camera, const cv::Mat& mat_depth, Frame& frame) const;
+    bool AlignFrame(CameraModel& camera, const Frame& frame_source, const Frame& frame_target, const Pose& pose_initial, Result& result) const;
+
+private:
+    int32_t level_num_;
+    float distance_threshold_;
+    float angle_threshold_deg_;
+
+    Frame frame_previous_;
+    Pose pose_velocity_;    /* the previous motion */
+};
+
+#endif
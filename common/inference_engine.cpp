@@ -0,0 +1,137 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "instrumentation.h"
+#include "simd_kernel.h"
+#include "inference_engine.h"
+
+
+/*** Function ***/
+void InferenceEngine::SetInstrumentation(Instrumentation* instrumentation, const std::string& name)
+{
+    instrumentation_ = instrumentation;
+    name_pre_process_ = name + ".pre_process";
+    name_inference_ = name + ".inference";
+}
+
+bool InferenceEngine::InitializeEngine(const std::string& model_filename, const std::vector<cv::String>& output_name_list, const Config& config)
+{
+    /*  Read Model */
+    try {
+        net_ = cv::dnn::readNetFromONNX(model_filename);
+    } catch (std::exception &e) {
+        printf("%s\n", e.what());
+        return false;
+    }
+
+    if (net_.empty() == true) {
+        printf("Failed to create inference engine (%s)\n", model_filename.c_str());
+        return false;
+    }
+
+    return InitializeNet(output_name_list, config);
+}
+
+bool InferenceEngine::InitializeEngine(const std::vector<uchar>& model_buffer, const std::vector<cv::String>& output_name_list, const Config& config)
+{
+    /*  Read Model from memory */
+    try {
+        net_ = cv::dnn::readNetFromONNX(model_buffer);
+    } catch (std::exception &e) {
+        printf("%s\n", e.what());
+        return false;
+    }
+
+    if (net_.empty() == true) {
+        printf("Failed to create inference engine from buffer\n");
+        return false;
+    }
+
+    return InitializeNet(output_name_list, config);
+}
+
+bool InferenceEngine::InitializeNet(const std::vector<cv::String>& output_name_list, const Config& config)
+{
+    /*  Set backend */
+    net_.setPreferableBackend(config.backend);
+    net_.setPreferableTarget(config.target);
+
+    /* Display model information */
+    for (const auto& layer_name : net_.getUnconnectedOutLayersNames()) {
+        printf("Output layer: %s\n", layer_name.c_str());
+    }
+
+    output_name_list_ = output_name_list;
+    output_mat_list_.clear();
+    blob_input_.release();
+    return true;
+}
+
+bool InferenceEngine::RunInference(const cv::Mat& image_input)
+{
+    if (net_.empty()) {
+        printf("[InferenceEngine::RunInference] not initialized\n");
+        return false;
+    }
+
+    const auto& t0 = std::chrono::steady_clock::now();
+    if (!PreProcess(image_input, blob_input_)) {
+        printf("[InferenceEngine::RunInference] PreProcess failed\n");
+        return false;
+    }
+    const auto& t1 = std::chrono::steady_clock::now();
+
+    /* forward writes into output_mat_list_ in place when the shapes are the same as the previous call */
+    net_.setInput(blob_input_);
+    net_.forward(output_mat_list_, output_name_list_);
+    const auto& t2 = std::chrono::steady_clock::now();
+
+    if (instrumentation_) {
+        instrumentation_->Record(name_pre_process_, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        instrumentation_->Record(name_inference_, std::chrono::duration<double, std::milli>(t2 - t1).count());
+    }
+    return output_mat_list_.size() == output_name_list_.size();
+}
+
+bool InferenceEngine::ConvertImageToBlob(const cv::Mat& image_input, const cv::Size& input_size, const float scale[3], const float bias[3], bool is_swap_rb, cv::Mat& blob_input)
+{
+    /* the kernel reads 3 interleaved uint8 channels per pixel */
+    if (image_input.type() != CV_8UC3 || image_input.empty()) {
+        printf("[InferenceEngine::ConvertImageToBlob] invalid input (type = %d)\n", image_input.type());
+        return false;
+    }
+
+    const cv::Mat* image_src = &image_input;
+    if (image_input.size() != input_size) {
+        cv::resize(image_input, image_resized_, input_size);
+        image_src = &image_resized_;
+    }
+
+    /* create does nothing if the shape is the same */
+    const int32_t blob_size[] = { 1, 3, input_size.height, input_size.width };
+    blob_input.create(4, blob_size, CV_32F);
+    SimdKernel::GetTable().ConvertImageToBlob(image_src->data, static_cast<int32_t>(image_src->step), image_src->cols, image_src->rows, scale, bias, is_swap_rb, blob_input.ptr<float>());
+    return true;
+}
@@ -0,0 +1,80 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef INFERENCE_ENGINE_
+#define INFERENCE_ENGINE_
+
+/* for general */
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "instrumentation.h"
+
+
+/***
+* Base of the engines running a model with cv::dnn (e.g. DepthEngine, FaceDetection)
+*   - The net is created from a file or from a buffer (to share the weights read once among instances)
+*   - Backend / target are configurable
+*   - The input blob and the output list are kept across calls, so no tensor is allocated once the input size is fixed
+*   - PreProcess is a hook. ConvertImageToBlob is a fused preprocessing (resize, BGR->RGB, normalization, NHWC->NCHW)
+*   - PreProcess and Inference are timed if Instrumentation is set ("<name>.pre_process", "<name>.inference")
+***/
+class InferenceEngine
+{
+public:
+    typedef struct Config_ {
+        int32_t backend;    /* cv::dnn::Backend */
+        int32_t target;     /* cv::dnn::Target */
+        Config_() : backend(cv::dnn::DNN_BACKEND_OPENCV), target(cv::dnn::DNN_TARGET_CPU) {}
+    } Config;
+
+public:
+    InferenceEngine() : instrumentation_(nullptr) {}
+    virtual ~InferenceEngine() {}
+    void SetInstrumentation(Instrumentation* instrumentation, const std::string& name);
+
+protected:
+    bool InitializeEngine(const std::string& model_filename, const std::vector<cv::String>& output_name_list, const Config& config);
+    bool InitializeEngine(const std::vector<uchar>& model_buffer, const std::vector<cv::String>& output_name_list, const Config& config);
+
+    /* Write the input tensor into blob_input (it's kept across calls. Don't re-assign it). Return false for an unsupported input */
+    virtual bool PreProcess(const cv::Mat& image_input, cv::Mat& blob_input) = 0;
+
+    /* PreProcess + forward. The results are in output_mat_list_ (valid until the next call) */
+    bool RunInference(const cv::Mat& image_input);
+
+    /* Fused preprocessing: resize to input_size, then (x * scale[c] + bias[c]) and NHWC(CV_8UC3) -> NCHW(CV_32F) in one pass (SIMD kernel). Return false if image_input is not CV_8UC3 */
+    bool ConvertImageToBlob(const cv::Mat& image_input, const cv::Size& input_size, const float scale[3], const float bias[3], bool is_swap_rb, cv::Mat& blob_input);
+
+private:
+    bool InitializeNet(const std::vector<cv::String>& output_name_list, const Config& config);
+
+protected:
+    cv::dnn::Net net_;
+    std::vector<cv::Mat> output_mat_list_;
+
+private:
+    std::vector<cv::String> output_name_list_;
+    cv::Mat blob_input_;
+    cv::Mat image_resized_;
+    Instrumentation* instrumentation_;
+    std::string name_pre_process_;
+    std::string name_inference_;
+};
+
+#endif
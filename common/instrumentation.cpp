@@ -0,0 +1,139 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#include "instrumentation.h"
+
+
+/*** Function ***/
+Instrumentation::Instrumentation()
+{
+    time_start_ = std::chrono::steady_clock::now();
+}
+
+Instrumentation& Instrumentation::Global()
+{
+    static Instrumentation s_instrumentation;
+    return s_instrumentation;
+}
+
+void Instrumentation::Record(const std::string& name, double value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = series_map_.find(name);
+    if (it == series_map_.end()) {
+        Series series;
+        series.count = 0;
+        series.sum = 0;
+        series.min = value;
+        series.max = value;
+        series.sample_list.reserve(kMaxSampleNum);
+        series.sample_index = 0;
+        it = series_map_.insert({ name, series }).first;
+    }
+
+    Series& series = it->second;
+    series.count++;
+    series.sum += value;
+    series.min = (std::min)(series.min, value);
+    series.max = (std::max)(series.max, value);
+    if (static_cast<int32_t>(series.sample_list.size()) < kMaxSampleNum) {
+        series.sample_list.push_back(value);
+    } else {
+        series.sample_list[series.sample_index] = value;
+    }
+    series.sample_index = (series.sample_index + 1) % kMaxSampleNum;
+}
+
+void Instrumentation::RecordEvent(const std::string& name, const std::string& detail)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    double time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start_).count();
+    event_list_.push_back({ time_ms, name, detail });
+    if (static_cast<int32_t>(event_list_.size()) > kMaxEventNum) {
+        event_list_.pop_front();
+    }
+}
+
+bool Instrumentation::GetSummary(const std::string& name, Summary& summary) const
+{
+    std::vector<double> sample_list;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = series_map_.find(name);
+        if (it == series_map_.end() || it->second.count == 0) return false;
+        const Series& series = it->second;
+        summary.count = series.count;
+        summary.mean = series.sum / series.count;
+        summary.min = series.min;
+        summary.max = series.max;
+        sample_list = series.sample_list;
+    }
+
+    /* Percentiles are calculated from the latest samples only */
+    std::sort(sample_list.begin(), sample_list.end());
+    const int32_t last = static_cast<int32_t>(sample_list.size()) - 1;
+    summary.p50 = sample_list[(last * 50) / 100];
+    summary.p95 = sample_list[(last * 95) / 100];
+    summary.p99 = sample_list[(last * 99) / 100];
+    return true;
+}
+
+std::vector<std::string> Instrumentation::GetSeriesNameList() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> name_list;
+    for (const auto& series : series_map_) {
+        name_list.push_back(series.first);
+    }
+    return name_list;
+}
+
+std::vector<Instrumentation::Event> Instrumentation::GetEventList() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::vector<Event>(event_list_.begin(), event_list_.end());
+}
+
+double Instrumentation::GetElapsedTimeMs() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start_).count();
+}
+
+void Instrumentation::Print() const
+{
+    printf("%-32s %8s %9s %9s %9s %9s %9s\n", "name", "count", "mean", "min", "p50", "p95", "max");
+    for (const auto& name : GetSeriesNameList()) {
+        Summary summary;
+        if (!GetSummary(name, summary)) continue;
+        printf("%-32s %8lld %9.3f %9.3f %9.3f %9.3f %9.3f\n", name.c_str(), static_cast<long long>(summary.count), summary.mean, summary.min, summary.p50, summary.p95, summary.max);
+    }
+}
+
+void Instrumentation::Reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    series_map_.clear();
+    event_list_.clear();
+    time_start_ = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,108 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef INSTRUMENTATION_
+#define INSTRUMENTATION_
+
+/* for general */
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <chrono>
+
+
+/***
+* Thread-safe collector of named measurement series (e.g. latency [ms]) and events (e.g. scheduler decisions)
+*   - Series keep count / mean / min / max and the latest kMaxSampleNum samples for percentiles
+*   - Events keep the latest kMaxEventNum entries
+***/
+class Instrumentation
+{
+public:
+    static constexpr int32_t kMaxSampleNum = 1024;
+    static constexpr int32_t kMaxEventNum = 256;
+
+    typedef struct Summary_ {
+        int64_t count;
+        double mean;
+        double min;
+        double max;
+        double p50;
+        double p95;
+        double p99;
+    } Summary;
+
+    typedef struct Event_ {
+        double time_ms;     /* elapsed time from the creation of Instrumentation */
+        std::string name;
+        std::string detail;
+    } Event;
+
+public:
+    Instrumentation();
+    ~Instrumentation() {}
+
+    static Instrumentation& Global();
+
+    void Record(const std::string& name, double value);
+    void RecordEvent(const std::string& name, const std::string& detail);
+    bool GetSummary(const std::string& name, Summary& summary) const;
+    std::vector<std::string> GetSeriesNameList() const;
+    std::vector<Event> GetEventList() const;
+    double GetElapsedTimeMs() const;
+    void Print() const;
+    void Reset();
+
+private:
+    typedef struct Series_ {
+        int64_t count;
+        double sum;
+        double min;
+        double max;
+        std::vector<double> sample_list;    /* ring buffer */
+        int32_t sample_index;
+    } Series;
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, Series> series_map_;
+    std::deque<Event> event_list_;
+    std::chrono::steady_clock::time_point time_start_;
+};
+
+
+/* Record the elapsed time [ms] in the scope */
+class ScopedTimer
+{
+public:
+    ScopedTimer(Instrumentation* instrumentation, const std::string& name)
+        : instrumentation_(instrumentation), name_(name), time_start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer()
+    {
+        if (instrumentation_) {
+            auto time_end = std::chrono::steady_clock::now();
+            instrumentation_->Record(name_, std::chrono::duration<double, std::milli>(time_end - time_start_).count());
+        }
+    }
+
+private:
+    Instrumentation* instrumentation_;
+    std::string name_;
+    std::chrono::steady_clock::time_point time_start_;
+};
+
+#endif
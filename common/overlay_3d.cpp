@@ -0,0 +1,157 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "pose.h"
+#include "camera_model.h"
+#include "overlay_3d.h"
+
+/*** Macro ***/
+/* Corner i of a box: x = (i & 1) ? + : -, y = (i & 2) ? + : -, z = (i & 4) ? + : - */
+static constexpr int32_t kBoxCornerNum = 8;
+static constexpr int32_t kBoxEdgeNum = 12;
+static const int32_t kBoxEdgeList[kBoxEdgeNum][2] = {
+    { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },     /* along X */
+    { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },     /* along Y */
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },     /* along Z */
+};
+
+
+/*** Function ***/
+void Overlay3D::Clear()
+{
+    object_list_.clear();
+    edge_point_list_.clear();
+    image_point_list_.clear();
+    segment_list_.clear();
+}
+
+int32_t Overlay3D::AddBox(const Pose& pose, const cv::Point3f& half_size, const cv::Scalar& color)
+{
+    object_list_.push_back(Object{ kTypeBox, pose, half_size, color });
+    return static_cast<int32_t>(object_list_.size()) - 1;
+}
+
+int32_t Overlay3D::AddAxes(const Pose& pose, float length)
+{
+    object_list_.push_back(Object{ kTypeAxes, pose, cv::Point3f(length, length, length), cv::Scalar(0, 0, 0) });
+    return static_cast<int32_t>(object_list_.size()) - 1;
+}
+
+void Overlay3D::Project(CameraModel& camera, float z_near)
+{
+    edge_point_list_.clear();
+    segment_list_.clear();
+
+    /*** Object -> camera coordinate, and clip edges by the near plane ***/
+    const Pose pose_camera = camera.GetPose();
+    for (int32_t i = 0; i < static_cast<int32_t>(object_list_.size()); i++) {
+        const Object& object = object_list_[i];
+        const Pose pose = pose_camera * object.pose;    /* object -> camera */
+        if (object.type == kTypeBox) {
+            cv::Point3f corner_list[kBoxCornerNum];
+            for (int32_t c = 0; c < kBoxCornerNum; c++) {
+                cv::Point3f p((c & 1) ? object.size.x : -object.size.x, (c & 2) ? object.size.y : -object.size.y, (c & 4) ? object.size.z : -object.size.z);
+                corner_list[c] = pose.Transform(p);
+            }
+            for (int32_t e = 0; e < kBoxEdgeNum; e++) {
+                AddEdge(corner_list[kBoxEdgeList[e][0]], corner_list[kBoxEdgeList[e][1]], z_near, object.color, i);
+            }
+        } else {
+            const cv::Point3f origin = pose.Transform(cv::Point3f(0, 0, 0));
+            AddEdge(origin, pose.Transform(cv::Point3f(object.size.x, 0, 0)), z_near, cv::Scalar(0, 0, 255), i);
+            AddEdge(origin, pose.Transform(cv::Point3f(0, object.size.y, 0)), z_near, cv::Scalar(0, 255, 0), i);
+            AddEdge(origin, pose.Transform(cv::Point3f(0, 0, object.size.z)), z_near, cv::Scalar(255, 0, 0), i);
+        }
+    }
+
+    /*** Project all end points at once ***/
+    camera.ConvertCamera2Image(edge_point_list_, image_point_list_);
+
+    /*** Clip by the image border (keep only visible segments) ***/
+    const float x_max = static_cast<float>(camera.width - 1);
+    const float y_max = static_cast<float>(camera.height - 1);
+    size_t segment_num = 0;
+    for (size_t i = 0; i < segment_list_.size(); i++) {
+        Segment segment = segment_list_[i];
+        segment.p0 = image_point_list_[i * 2 + 0];
+        segment.p1 = image_point_list_[i * 2 + 1];
+        if (ClipSegment(segment.p0, segment.p1, x_max, y_max)) {
+            segment_list_[segment_num++] = segment;
+        }
+    }
+    segment_list_.resize(segment_num);
+}
+
+void Overlay3D::Draw(cv::Mat& image, int32_t thickness) const
+{
+    for (const auto& segment : segment_list_) {
+        cv::line(image, segment.p0, segment.p1, segment.color, thickness);
+    }
+}
+
+void Overlay3D::AddEdge(const cv::Point3f& p0, const cv::Point3f& p1, float z_near, const cv::Scalar& color, int32_t object_index)
+{
+    if (p0.z < z_near && p1.z < z_near) return;
+    cv::Point3f q0 = p0;
+    cv::Point3f q1 = p1;
+    if (q0.z < z_near) {
+        q0 = q1 + (q0 - q1) * ((q1.z - z_near) / (q1.z - q0.z));
+        q0.z = z_near;
+    } else if (q1.z < z_near) {
+        q1 = q0 + (q1 - q0) * ((q0.z - z_near) / (q0.z - q1.z));
+        q1.z = z_near;
+    }
+    edge_point_list_.push_back(q0);
+    edge_point_list_.push_back(q1);
+    segment_list_.push_back(Segment{ cv::Point2f(), cv::Point2f(), color, object_index });
+}
+
+bool Overlay3D::ClipSegment(cv::Point2f& p0, cv::Point2f& p1, float x_max, float y_max)
+{
+    /* Liang-Barsky: p = p0 + t * (p1 - p0), 0 <= t <= 1 */
+    const float dx = p1.x - p0.x;
+    const float dy = p1.y - p0.y;
+    const float p[4] = { -dx, dx, -dy, dy };
+    const float q[4] = { p0.x, x_max - p0.x, p0.y, y_max - p0.y };
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    for (int32_t i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return false;     /* parallel to the border and outside */
+        } else {
+            const float t = q[i] / p[i];
+            if (p[i] < 0) {
+                if (t > t1) return false;
+                if (t > t0) t0 = t;
+            } else {
+                if (t < t0) return false;
+                if (t < t1) t1 = t;
+            }
+        }
+    }
+    const cv::Point2f p_start(p0.x + t0 * dx, p0.y + t0 * dy);
+    const cv::Point2f p_end(p0.x + t1 * dx, p0.y + t1 * dy);
+    p0 = p_start;
+    p1 = p_end;
+    return true;
+}
@@ -0,0 +1,87 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef OVERLAY_3D_
+#define OVERLAY_3D_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "pose.h"
+#include "camera_model.h"
+
+
+/***
+* Batched projection of 3D annotations (oriented boxes, coordinate axes) for AR overlays
+*   - Add objects for a frame, then Project once with a shared CameraModel and Draw the 2D line segments
+*   - Edges are clipped by the near plane (in camera coordinate) and by the image border
+*   - Only the end points of each edge are projected (lens distortion doesn't bend the lines)
+*   - Buffers are kept across frames, so no allocation happens once they are large enough
+***/
+class Overlay3D
+{
+public:
+    static constexpr float kDefaultZNear = 0.01f;
+
+    typedef struct Segment_ {
+        cv::Point2f p0;
+        cv::Point2f p1;
+        cv::Scalar color;
+        int32_t object_index;
+    } Segment;
+
+public:
+    Overlay3D() {}
+    ~Overlay3D() {}
+
+    void Clear();
+
+    /* pose: object -> world. half_size: half length of each side in object coordinate. Returns the object index */
+    int32_t AddBox(const Pose& pose, const cv::Point3f& half_size, const cv::Scalar& color);
+    /* X: red, Y: green, Z: blue */
+    int32_t AddAxes(const Pose& pose, float length);
+
+    /* z_near: the same unit as the pose */
+    void Project(CameraModel& camera, float z_near = kDefaultZNear);
+    const std::vector<Segment>& GetSegmentList() const { return segment_list_; }
+    void Draw(cv::Mat& image, int32_t thickness = 2) const;
+
+private:
+    enum {
+        kTypeBox = 0,
+        kTypeAxes,
+    };
+
+    typedef struct Object_ {
+        int32_t type;
+        Pose pose;
+        cv::Point3f size;   /* half size (box), length (axes) */
+        cv::Scalar color;
+    } Object;
+
+    void AddEdge(const cv::Point3f& p0, const cv::Point3f& p1, float z_near, const cv::Scalar& color, int32_t object_index);
+    static bool ClipSegment(cv::Point2f& p0, cv::Point2f& p1, float x_max, float y_max);
+
+private:
+    std::vector<Object> object_list_;
+    std::vector<cv::Point3f> edge_point_list_;      /* in camera coordinate, 2 points per edge */
+    std::vector<cv::Point2f> image_point_list_;
+    std::vector<Segment> segment_list_;
+};
+
+#endif
@@ -0,0 +1,502 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <fstream>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "point_cloud_codec.h"
+
+/*** Macro ***/
+static constexpr uint32_t kMagic = 0x31434350;     /* "PCC1" */
+static constexpr uint32_t kVersion = 1;
+static constexpr uint64_t kInvalidCode = UINT64_MAX;
+
+/* Adaptive binary range coder (the same scheme as LZMA) */
+static constexpr int32_t kProbBits = 11;
+static constexpr uint16_t kProbInit = 1 << (kProbBits - 1);
+static constexpr int32_t kProbMoveBits = 5;
+static constexpr uint32_t kRangeTop = 1u << 24;
+
+/* Contexts: occupancy by the number of children of the previous node, color by the magnitude of the previous residual */
+static constexpr int32_t kOccupancyContextNum = 9;
+static constexpr int32_t kColorBucketNum = 4;
+
+
+/*** Function ***/
+typedef struct RangeEncoder_ {
+    std::vector<uint8_t>* stream;
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cache_size;
+
+    explicit RangeEncoder_(std::vector<uint8_t>* s) : stream(s), low(0), range(0xFFFFFFFF), cache(0), cache_size(1) {}
+
+    void ShiftLow()
+    {
+        if (static_cast<uint32_t>(low) < 0xFF000000u || (low >> 32) != 0) {
+            uint8_t temp = cache;
+            do {
+                stream->push_back(static_cast<uint8_t>(temp + static_cast<uint8_t>(low >> 32)));
+                temp = 0xFF;
+            } while (--cache_size != 0);
+            cache = static_cast<uint8_t>(static_cast<uint32_t>(low) >> 24);
+        }
+        cache_size++;
+        low = (low & 0x00FFFFFF) << 8;
+    }
+
+    void EncodeBit(uint16_t& prob, uint32_t bit)
+    {
+        const uint32_t bound = (range >> kProbBits) * prob;
+        if (bit == 0) {
+            range = bound;
+            prob += ((1 << kProbBits) - prob) >> kProbMoveBits;
+        } else {
+            low += bound;
+            range -= bound;
+            prob -= prob >> kProbMoveBits;
+        }
+        while (range < kRangeTop) {
+            range <<= 8;
+            ShiftLow();
+        }
+    }
+
+    /* 8 bits, MSB first. prob_list: 256 probabilities (binary tree) */
+    void EncodeByte(uint16_t* prob_list, uint32_t value)
+    {
+        uint32_t node = 1;
+        for (int32_t i = 7; i >= 0; i--) {
+            const uint32_t bit = (value >> i) & 1;
+            EncodeBit(prob_list[node], bit);
+            node = (node << 1) | bit;
+        }
+    }
+
+    void Flush()
+    {
+        for (int32_t i = 0; i < 5; i++) ShiftLow();
+    }
+} RangeEncoder;
+
+typedef struct RangeDecoder_ {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint32_t range;
+    uint32_t code;
+
+    RangeDecoder_(const uint8_t* d, size_t s) : data(d), size(s), pos(0), range(0xFFFFFFFF), code(0)
+    {
+        for (int32_t i = 0; i < 5; i++) code = (code << 8) | ReadByte();
+    }
+
+    uint8_t ReadByte()
+    {
+        return (pos < size) ? data[pos++] : 0;  /* broken data is decoded as garbage, but never read out of range */
+    }
+
+    uint32_t DecodeBit(uint16_t& prob)
+    {
+        const uint32_t bound = (range >> kProbBits) * prob;
+        uint32_t bit;
+        if (code < bound) {
+            range = bound;
+            prob += ((1 << kProbBits) - prob) >> kProbMoveBits;
+            bit = 0;
+        } else {
+            code -= bound;
+            range -= bound;
+            prob -= prob >> kProbMoveBits;
+            bit = 1;
+        }
+        while (range < kRangeTop) {
+            range <<= 8;
+            code = (code << 8) | ReadByte();
+        }
+        return bit;
+    }
+
+    uint32_t DecodeByte(uint16_t* prob_list)
+    {
+        uint32_t node = 1;
+        for (int32_t i = 0; i < 8; i++) node = (node << 1) | DecodeBit(prob_list[node]);
+        return node & 0xFF;
+    }
+} RangeDecoder;
+
+/* Position -> index of the voxel (v >= origin) */
+static inline uint32_t Quantize(float v, float origin, double precision_inv)
+{
+    return static_cast<uint32_t>(std::floor((static_cast<double>(v) - origin) * precision_inv + 0.5));
+}
+
+static inline uint64_t SplitBy3(uint32_t a)
+{
+    uint64_t x = a & 0x1FFFFF;
+    x = (x | x << 32) & 0x1F00000000FFFFull;
+    x = (x | x << 16) & 0x1F0000FF0000FFull;
+    x = (x | x << 8) & 0x100F00F00F00F00Full;
+    x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+static inline uint32_t CompactBy3(uint64_t x)
+{
+    x &= 0x1249249249249249ull;
+    x = (x ^ (x >> 2)) & 0x10C30C30C30C30C3ull;
+    x = (x ^ (x >> 4)) & 0x100F00F00F00F00Full;
+    x = (x ^ (x >> 8)) & 0x1F0000FF0000FFull;
+    x = (x ^ (x >> 16)) & 0x1F00000000FFFFull;
+    x = (x ^ (x >> 32)) & 0x1FFFFFull;
+    return static_cast<uint32_t>(x);
+}
+
+static inline int32_t PopCount8(uint32_t value)
+{
+    int32_t count = 0;
+    for (; value; value &= value - 1) count++;
+    return count;
+}
+
+static inline int32_t GetColorBucket(uint32_t residual)
+{
+    const int32_t a = std::abs(static_cast<int32_t>(static_cast<int8_t>(residual)));
+    return (a == 0) ? 0 : (a <= 2) ? 1 : (a <= 6) ? 2 : 3;
+}
+
+typedef struct Entry_ {
+    uint64_t code;
+    uint32_t index;
+} Entry;
+
+/* code_list: unique Morton codes in the octant (sorted) */
+static void EncodeOctant(const std::vector<uint64_t>& code_list, const std::vector<cv::Vec3b>& color_list, int32_t depth, std::vector<uint8_t>& stream)
+{
+    RangeEncoder encoder(&stream);
+
+    /*** Occupancy of the nodes at each level (in Morton order = the order the decoder finds the nodes) ***/
+    std::vector<uint16_t> prob_occupancy(kOccupancyContextNum * 256, kProbInit);
+    int32_t context = 0;
+    for (int32_t level = 1; level < depth; level++) {
+        const int32_t shift_child = 3 * (depth - level - 1);
+        uint64_t parent_previous = kInvalidCode;
+        uint32_t occupancy = 0;
+        for (uint64_t code : code_list) {
+            const uint64_t child = code >> shift_child;
+            const uint64_t parent = child >> 3;
+            if (parent != parent_previous) {
+                if (parent_previous != kInvalidCode) {
+                    encoder.EncodeByte(&prob_occupancy[context * 256], occupancy);
+                    context = PopCount8(occupancy);
+                }
+                parent_previous = parent;
+                occupancy = 0;
+            }
+            occupancy |= 1u << (child & 7);
+        }
+        if (parent_previous != kInvalidCode) {
+            encoder.EncodeByte(&prob_occupancy[context * 256], occupancy);
+            context = PopCount8(occupancy);
+        }
+    }
+
+    /*** Colors of the leaves ***/
+    if (!color_list.empty()) {
+        std::vector<uint16_t> prob_color(3 * kColorBucketNum * 256, kProbInit);
+        cv::Vec3b previous(0, 0, 0);
+        int32_t bucket[3] = { 0, 0, 0 };
+        for (const auto& color : color_list) {
+            /* BGR. G is the reference to decorrelate the channels */
+            const int32_t dg = color[1] - previous[1];
+            uint32_t residual[3];
+            residual[0] = static_cast<uint32_t>(dg) & 0xFF;
+            residual[1] = static_cast<uint32_t>(color[2] - previous[2] - dg) & 0xFF;
+            residual[2] = static_cast<uint32_t>(color[0] - previous[0] - dg) & 0xFF;
+            for (int32_t ch = 0; ch < 3; ch++) {
+                encoder.EncodeByte(&prob_color[(ch * kColorBucketNum + bucket[ch]) * 256], residual[ch]);
+                bucket[ch] = GetColorBucket(residual[ch]);
+            }
+            previous = color;
+        }
+    }
+    encoder.Flush();
+}
+
+static bool DecodeOctant(const uint8_t* stream, size_t stream_size, uint32_t octant, int32_t depth, uint32_t point_num, bool has_color,
+    std::vector<uint64_t>& code_list, std::vector<cv::Vec3b>& color_list)
+{
+    RangeDecoder decoder(stream, stream_size);
+
+    std::vector<uint16_t> prob_occupancy(kOccupancyContextNum * 256, kProbInit);
+    int32_t context = 0;
+    code_list.assign(1, octant);
+    std::vector<uint64_t> code_list_next;
+    for (int32_t level = 1; level < depth; level++) {
+        code_list_next.clear();
+        for (uint64_t node : code_list) {
+            const uint32_t occupancy = decoder.DecodeByte(&prob_occupancy[context * 256]);
+            context = PopCount8(occupancy);
+            for (uint32_t c = 0; c < 8; c++) {
+                if (occupancy & (1u << c)) code_list_next.push_back((node << 3) | c);
+            }
+            if (code_list_next.size() > point_num) return false;    /* broken data */
+        }
+        code_list.swap(code_list_next);
+    }
+    if (code_list.size() != point_num) return false;
+
+    color_list.clear();
+    if (has_color) {
+        color_list.resize(point_num);
+        std::vector<uint16_t> prob_color(3 * kColorBucketNum * 256, kProbInit);
+        cv::Vec3b previous(0, 0, 0);
+        int32_t bucket[3] = { 0, 0, 0 };
+        for (auto& color : color_list) {
+            uint32_t residual[3];
+            for (int32_t ch = 0; ch < 3; ch++) {
+                residual[ch] = decoder.DecodeByte(&prob_color[(ch * kColorBucketNum + bucket[ch]) * 256]);
+                bucket[ch] = GetColorBucket(residual[ch]);
+            }
+            color[1] = static_cast<uint8_t>(previous[1] + residual[0]);
+            color[2] = static_cast<uint8_t>(previous[2] + residual[1] + residual[0]);
+            color[0] = static_cast<uint8_t>(previous[0] + residual[2] + residual[0]);
+            previous = color;
+        }
+    }
+    return true;
+}
+
+bool PointCloudCodec::Encode(const std::vector<cv::Point3f>& object_point_list, const cv::Mat& image_color, float precision, std::vector<uint8_t>& data)
+{
+    const bool has_color = !image_color.empty();
+    if (precision <= 0 || (has_color && (image_color.type() != CV_8UC3 || !image_color.isContinuous() || image_color.total() != object_point_list.size()))) {
+        printf("[PointCloudCodec::Encode] invalid input\n");
+        return false;
+    }
+    const int32_t num = static_cast<int32_t>(object_point_list.size());
+    const cv::Vec3b* color_src = has_color ? image_color.ptr<cv::Vec3b>() : nullptr;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.flags = has_color ? kFlagColor : 0;
+    header.precision = precision;
+
+    /*** Bounding box ***/
+    float bb_min[3] = { 0, 0, 0 };
+    float bb_max[3] = { 0, 0, 0 };
+    bool is_empty = true;
+    for (const auto& p : object_point_list) {
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        const float v[3] = { p.x, p.y, p.z };
+        for (int32_t a = 0; a < 3; a++) {
+            bb_min[a] = is_empty ? v[a] : (std::min)(bb_min[a], v[a]);
+            bb_max[a] = is_empty ? v[a] : (std::max)(bb_max[a], v[a]);
+        }
+        is_empty = false;
+    }
+    /* The extent and the points are quantized by the same expression, so that the max point fits in the octree */
+    const double precision_inv = 1.0 / precision;
+    int32_t depth = 1;
+    for (int32_t a = 0; a < 3; a++) {
+        header.origin[a] = bb_min[a];
+        const double extent = static_cast<double>(Quantize(bb_max[a], bb_min[a], precision_inv)) + 1;
+        while (depth <= kMaxDepth && std::ldexp(1.0, depth) < extent) depth++;
+    }
+    if (depth > kMaxDepth) {
+        printf("[PointCloudCodec::Encode] precision is too fine for the size of the point cloud\n");
+        return false;
+    }
+    header.depth = depth;
+
+    /*** Morton code of each point ***/
+    const uint32_t q_max = (1u << depth) - 1;
+    std::vector<uint64_t> code_all(num);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const auto& p = object_point_list[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+            code_all[i] = kInvalidCode;
+            continue;
+        }
+        const uint32_t qx = (std::min)(Quantize(p.x, bb_min[0], precision_inv), q_max);
+        const uint32_t qy = (std::min)(Quantize(p.y, bb_min[1], precision_inv), q_max);
+        const uint32_t qz = (std::min)(Quantize(p.z, bb_min[2], precision_inv), q_max);
+        code_all[i] = SplitBy3(qx) | (SplitBy3(qy) << 1) | (SplitBy3(qz) << 2);
+    }
+
+    /*** Partition by the top-level octant ***/
+    const int32_t shift_octant = 3 * (depth - 1);
+    std::array<std::vector<Entry>, 8> entry_list_octant;
+    {
+        std::array<size_t, 8> count_list = { 0 };
+        for (uint64_t code : code_all) {
+            if (code != kInvalidCode) count_list[code >> shift_octant]++;
+        }
+        for (int32_t o = 0; o < 8; o++) entry_list_octant[o].reserve(count_list[o]);
+        for (int32_t i = 0; i < num; i++) {
+            if (code_all[i] != kInvalidCode) entry_list_octant[code_all[i] >> shift_octant].push_back({ code_all[i], static_cast<uint32_t>(i) });
+        }
+    }
+
+    /*** Encode each octant in parallel ***/
+    std::array<std::vector<uint8_t>, 8> stream_list;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int32_t o = 0; o < 8; o++) {
+        auto& entry_list = entry_list_octant[o];
+        if (entry_list.empty()) continue;
+        std::sort(entry_list.begin(), entry_list.end(), [](const Entry& a, const Entry& b) { return a.code < b.code; });
+
+        /* Merge the points in the same voxel (average color) */
+        std::vector<uint64_t> code_list;
+        std::vector<cv::Vec3b> color_list;
+        code_list.reserve(entry_list.size());
+        if (has_color) color_list.reserve(entry_list.size());
+        for (size_t i = 0; i < entry_list.size();) {
+            size_t j = i;
+            uint32_t sum[3] = { 0, 0, 0 };
+            for (; j < entry_list.size() && entry_list[j].code == entry_list[i].code; j++) {
+                if (has_color) {
+                    const cv::Vec3b& color = color_src[entry_list[j].index];
+                    for (int32_t ch = 0; ch < 3; ch++) sum[ch] += color[ch];
+                }
+            }
+            code_list.push_back(entry_list[i].code);
+            if (has_color) {
+                const uint32_t n = static_cast<uint32_t>(j - i);
+                color_list.push_back(cv::Vec3b(static_cast<uint8_t>((sum[0] + n / 2) / n), static_cast<uint8_t>((sum[1] + n / 2) / n), static_cast<uint8_t>((sum[2] + n / 2) / n)));
+            }
+            i = j;
+        }
+        std::vector<Entry>().swap(entry_list);
+
+        EncodeOctant(code_list, color_list, depth, stream_list[o]);
+        header.octant_point_num[o] = static_cast<uint32_t>(code_list.size());
+    }
+
+    /*** Serialize ***/
+    size_t total_size = sizeof(Header);
+    for (int32_t o = 0; o < 8; o++) {
+        header.octant_size[o] = static_cast<uint32_t>(stream_list[o].size());
+        header.point_num += header.octant_point_num[o];
+        if (header.octant_point_num[o] > 0) header.root_occupancy |= 1u << o;
+        total_size += stream_list[o].size();
+    }
+    data.resize(total_size);
+    memcpy(data.data(), &header, sizeof(Header));
+    size_t offset = sizeof(Header);
+    for (int32_t o = 0; o < 8; o++) {
+        if (!stream_list[o].empty()) memcpy(&data[offset], stream_list[o].data(), stream_list[o].size());
+        offset += stream_list[o].size();
+    }
+    return true;
+}
+
+bool PointCloudCodec::Decode(const std::vector<uint8_t>& data, std::vector<cv::Point3f>& object_point_list, std::vector<cv::Vec3b>& color_list)
+{
+    Header header;
+    if (data.size() < sizeof(Header)) {
+        printf("[PointCloudCodec::Decode] invalid size\n");
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(Header));
+    if (header.magic != kMagic || header.version != kVersion || header.depth < 1 || header.depth > static_cast<uint32_t>(kMaxDepth)) {
+        printf("[PointCloudCodec::Decode] invalid header\n");
+        return false;
+    }
+    std::array<size_t, 8> offset_list;
+    std::array<size_t, 8> point_offset_list;
+    size_t offset = sizeof(Header);
+    size_t point_num = 0;
+    for (int32_t o = 0; o < 8; o++) {
+        offset_list[o] = offset;
+        point_offset_list[o] = point_num;
+        offset += header.octant_size[o];
+        point_num += header.octant_point_num[o];
+    }
+    if (offset > data.size() || point_num != header.point_num) {
+        printf("[PointCloudCodec::Decode] truncated data\n");
+        return false;
+    }
+
+    const bool has_color = (header.flags & kFlagColor) != 0;
+    const int32_t depth = static_cast<int32_t>(header.depth);
+    object_point_list.resize(point_num);
+    color_list.resize(has_color ? point_num : 0);
+    bool is_valid = true;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int32_t o = 0; o < 8; o++) {
+        if (header.octant_point_num[o] == 0) continue;
+        std::vector<uint64_t> code_list;
+        std::vector<cv::Vec3b> color_list_octant;
+        if (!DecodeOctant(data.data() + offset_list[o], header.octant_size[o], o, depth, header.octant_point_num[o], has_color, code_list, color_list_octant)) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            is_valid = false;
+            continue;
+        }
+        const size_t point_offset = point_offset_list[o];
+        for (size_t i = 0; i < code_list.size(); i++) {
+            const uint64_t code = code_list[i];
+            cv::Point3f& p = object_point_list[point_offset + i];
+            p.x = header.origin[0] + CompactBy3(code) * header.precision;
+            p.y = header.origin[1] + CompactBy3(code >> 1) * header.precision;
+            p.z = header.origin[2] + CompactBy3(code >> 2) * header.precision;
+        }
+        if (has_color) std::copy(color_list_octant.begin(), color_list_octant.end(), color_list.begin() + point_offset);
+    }
+    if (!is_valid) {
+        printf("[PointCloudCodec::Decode] broken data\n");
+        return false;
+    }
+    return true;
+}
+
+bool PointCloudCodec::WriteFile(const std::string& filename, const std::vector<uint8_t>& data)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        printf("[PointCloudCodec::WriteFile] Failed to open %s\n", filename.c_str());
+        return false;
+    }
+    ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return ofs.good();
+}
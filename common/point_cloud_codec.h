@@ -0,0 +1,67 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef POINT_CLOUD_CODEC_
+#define POINT_CLOUD_CODEC_
+
+/* for general */
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Compressed point cloud format for archival and transfer
+*   - Positions are quantized to precision (voxel), and points in the same voxel are merged (color is averaged)
+*   - Occupancy of the octree is serialized level by level (breadth first) and entropy coded (adaptive binary range coder)
+*   - Colors are delta coded in Morton order (G, R - G, B - G) and entropy coded
+*   - Each top-level octant is an independent stream, so encoding and decoding run in parallel over the octants
+*   - Decoded points are in Morton order (not the original order). Non-finite points are dropped
+*
+* Layout: [Header][stream of octant 0]...[stream of octant 7]
+***/
+namespace PointCloudCodec
+{
+static constexpr float kDefaultPrecision = 0.001f;
+static constexpr int32_t kMaxDepth = 21;        /* bits per axis (Morton code in 63 bits) */
+
+typedef struct Header_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;             /* kFlagColor */
+    uint32_t point_num;         /* number of voxels */
+    float origin[3];            /* position of the voxel (0, 0, 0) */
+    float precision;            /* voxel size */
+    uint32_t depth;             /* octree depth (bits per axis) */
+    uint32_t root_occupancy;    /* bit i: octant i has points */
+    uint32_t octant_point_num[8];
+    uint32_t octant_size[8];    /* [byte] */
+} Header;
+
+enum {
+    kFlagColor = 1,
+};
+
+/* image_color: CV_8UC3 (BGR) which has a color for each point (e.g. the input image of the reconstruction), or empty */
+bool Encode(const std::vector<cv::Point3f>& object_point_list, const cv::Mat& image_color, float precision, std::vector<uint8_t>& data);
+/* color_list is empty if the data has no color */
+bool Decode(const std::vector<uint8_t>& data, std::vector<cv::Point3f>& object_point_list, std::vector<cv::Vec3b>& color_list);
+
+bool WriteFile(const std::string& filename, const std::vector<uint8_t>& data);
+}
+
+#endif
@@ -0,0 +1,259 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "simd_kernel.h"
+#include "point_cloud_filter.h"
+
+/*** Macro ***/
+static constexpr int32_t kRowBlockSize = 32;        /* window sums are initialized once per block of rows */
+static constexpr int32_t kCompactBlockSize = 4096;
+
+/* Voxel index (21 bits per axis) packed into a key. Far voxels may share a key, but it only costs extra distance checks */
+static constexpr int64_t kVoxelIndexOffset = 1 << 20;
+static constexpr uint64_t kVoxelIndexMask = 0x1FFFFF;
+
+
+/*** Function ***/
+static inline bool IsValidDepth(float d)
+{
+    return d > 0 && std::isfinite(d);
+}
+
+typedef struct WindowSum_ {
+    double count;
+    double sum;         /* q (= 1 / Zc) */
+    double sum_sq;      /* q^2 */
+    double sum_y;       /* y * q */
+    double sum_x;       /* x * q (only in the horizontal sum) */
+} WindowSum;
+
+/* Row y of CV_32FC1 / CV_16FC1 as float. A half row is converted into row_buffer (F16C), so the whole map is never converted */
+static inline const float* GetDepthRow(const cv::Mat& mat_depth, int32_t y, std::vector<float>& row_buffer)
+{
+    if (mat_depth.type() == CV_32FC1) return mat_depth.ptr<float>(y);
+    SimdKernel::GetTable().ConvertHalfToFloat(mat_depth.ptr<uint16_t>(y), row_buffer.data(), mat_depth.cols);
+    return row_buffer.data();
+}
+
+/* Add (sign = 1) / subtract (sign = -1) the row y to the column sums. Rows out of the image replicate the border row */
+static void UpdateColumnSum(const cv::Mat& mat_depth, int32_t y, double sign, std::vector<float>& row_buffer, std::vector<WindowSum>& column_sum_list)
+{
+    const float* depth_row = GetDepthRow(mat_depth, (std::max)(0, (std::min)(mat_depth.rows - 1, y)), row_buffer);
+    for (int32_t x = 0; x < mat_depth.cols; x++) {
+        const float d = depth_row[x];
+        if (!IsValidDepth(d)) continue;
+        const double q = 1.0 / d;
+        WindowSum& s = column_sum_list[x];
+        s.count += sign;
+        s.sum += sign * q;
+        s.sum_sq += sign * q * q;
+        s.sum_y += sign * y * q;
+    }
+}
+
+static inline void UpdateWindowSum(const WindowSum& column_sum, int32_t x, double sign, WindowSum& window_sum)
+{
+    window_sum.count += sign * column_sum.count;
+    window_sum.sum += sign * column_sum.sum;
+    window_sum.sum_sq += sign * column_sum.sum_sq;
+    window_sum.sum_y += sign * column_sum.sum_y;
+    window_sum.sum_x += sign * x * column_sum.sum;
+}
+
+bool PointCloudFilter::FilterByDepthVariance(const cv::Mat& mat_depth, int32_t radius, float threshold, std::vector<uint8_t>& is_inlier_list)
+{
+    if (mat_depth.empty() || (mat_depth.type() != CV_32FC1 && mat_depth.type() != CV_16FC1) || radius < 1 || threshold <= 0) {
+        printf("[PointCloudFilter::FilterByDepthVariance] invalid input\n");
+        return false;
+    }
+    const int32_t rows = mat_depth.rows;
+    const int32_t cols = mat_depth.cols;
+    is_inlier_list.assign(static_cast<size_t>(rows) * cols, 0);
+
+    /* dx, dy in the window are symmetric, so they are orthogonal to each other and to the constant term */
+    const int32_t window_size = 2 * radius + 1;
+    const double full_count = static_cast<double>(window_size) * window_size;
+    const double sum_dx_sq = window_size * (radius * (radius + 1) * (2.0 * radius + 1) / 3.0);   /* = sum of dy^2 */
+    const double threshold_sq = static_cast<double>(threshold) * threshold;
+
+    const int32_t block_num = (rows + kRowBlockSize - 1) / kRowBlockSize;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int32_t b = 0; b < block_num; b++) {
+        const int32_t y_start = b * kRowBlockSize;
+        const int32_t y_end = (std::min)(rows, y_start + kRowBlockSize);
+        std::vector<WindowSum> column_sum_list(cols, WindowSum{ 0, 0, 0, 0, 0 });
+        const bool is_half = mat_depth.type() == CV_16FC1;
+        std::vector<float> row_buffer(is_half ? cols : 0);          /* rows added / subtracted */
+        std::vector<float> center_row_buffer(is_half ? cols : 0);   /* row y */
+        for (int32_t y = y_start - radius; y <= y_start + radius; y++) UpdateColumnSum(mat_depth, y, 1, row_buffer, column_sum_list);
+
+        for (int32_t y = y_start; y < y_end; y++) {
+            if (y > y_start) {
+                UpdateColumnSum(mat_depth, y + radius, 1, row_buffer, column_sum_list);
+                UpdateColumnSum(mat_depth, y - radius - 1, -1, row_buffer, column_sum_list);
+            }
+            const float* depth_row = GetDepthRow(mat_depth, y, center_row_buffer);
+            uint8_t* is_inlier_row = &is_inlier_list[static_cast<size_t>(y) * cols];
+            WindowSum s = { 0, 0, 0, 0, 0 };
+            for (int32_t x = -radius; x <= radius; x++) UpdateWindowSum(column_sum_list[(std::max)(0, (std::min)(cols - 1, x))], x, 1, s);
+            for (int32_t x = 0; x < cols; x++) {
+                if (x > 0) {
+                    UpdateWindowSum(column_sum_list[(std::min)(cols - 1, x + radius)], x + radius, 1, s);
+                    UpdateWindowSum(column_sum_list[(std::max)(0, x - radius - 1)], x - radius - 1, -1, s);
+                }
+                const float d = depth_row[x];
+                if (!IsValidDepth(d)) continue;
+                /* Residual sum of squares. Linear fit only when the window is full (otherwise, variance around the mean) */
+                double ss = s.sum_sq - s.sum * s.sum / s.count;
+                if (s.count > full_count - 0.5) {
+                    const double sum_dx = s.sum_x - x * s.sum;
+                    const double sum_dy = s.sum_y - y * s.sum;
+                    ss -= (sum_dx * sum_dx + sum_dy * sum_dy) / sum_dx_sq;
+                }
+                const double q = 1.0 / d;
+                is_inlier_row[x] = (std::max)(ss, 0.0) / s.count <= threshold_sq * q * q;
+            }
+        }
+    }
+    return true;
+}
+
+bool PointCloudFilter::FilterByRadius(const std::vector<cv::Point3f>& object_point_list, float radius, int32_t min_neighbor_num, std::vector<uint8_t>& is_inlier_list)
+{
+    if (radius <= 0 || min_neighbor_num < 0) {
+        printf("[PointCloudFilter::FilterByRadius] invalid input\n");
+        return false;
+    }
+    const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+    is_inlier_list.assign(point_num, 0);
+    const float radius_inv = 1.0f / radius;
+    const float radius_sq = radius * radius;
+    auto GetVoxelKey = [](int64_t ix, int64_t iy, int64_t iz) {
+        return ((ix + kVoxelIndexOffset) & kVoxelIndexMask) | (((iy + kVoxelIndexOffset) & kVoxelIndexMask) << 21) | (((iz + kVoxelIndexOffset) & kVoxelIndexMask) << 42);
+    };
+
+    /*** Voxel hash: points are sorted by the key, and each voxel has a range of the sorted points ***/
+    std::vector<std::pair<uint64_t, int32_t>> key_list;
+    key_list.reserve(point_num);
+    for (int32_t i = 0; i < point_num; i++) {
+        const cv::Point3f& p = object_point_list[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) continue;
+        key_list.push_back({ GetVoxelKey(static_cast<int64_t>(std::floor(p.x * radius_inv)), static_cast<int64_t>(std::floor(p.y * radius_inv)), static_cast<int64_t>(std::floor(p.z * radius_inv))), i });
+    }
+    std::sort(key_list.begin(), key_list.end());
+    const int32_t valid_num = static_cast<int32_t>(key_list.size());
+    std::vector<cv::Point3f> sorted_point_list(valid_num);
+    std::unordered_map<uint64_t, std::pair<int32_t, int32_t>> voxel_map;   /* key -> [start, end) in sorted_point_list */
+    voxel_map.reserve(valid_num);
+    for (int32_t i = 0; i < valid_num; i++) {
+        sorted_point_list[i] = object_point_list[key_list[i].second];
+        if (i == 0 || key_list[i].first != key_list[i - 1].first) {
+            voxel_map[key_list[i].first] = { i, i + 1 };
+        } else {
+            voxel_map[key_list[i].first].second = i + 1;
+        }
+    }
+
+    /*** Count neighbors in the 27 voxels around each point (stop at min_neighbor_num) ***/
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1024)
+#endif
+    for (int32_t i = 0; i < valid_num; i++) {
+        const cv::Point3f& p = sorted_point_list[i];
+        const int64_t ix = static_cast<int64_t>(std::floor(p.x * radius_inv));
+        const int64_t iy = static_cast<int64_t>(std::floor(p.y * radius_inv));
+        const int64_t iz = static_cast<int64_t>(std::floor(p.z * radius_inv));
+        int32_t neighbor_num = 0;
+        for (int64_t dz = -1; dz <= 1 && neighbor_num < min_neighbor_num; dz++) {
+            for (int64_t dy = -1; dy <= 1 && neighbor_num < min_neighbor_num; dy++) {
+                for (int64_t dx = -1; dx <= 1 && neighbor_num < min_neighbor_num; dx++) {
+                    const auto& it = voxel_map.find(GetVoxelKey(ix + dx, iy + dy, iz + dz));
+                    if (it == voxel_map.end()) continue;
+                    for (int32_t j = it->second.first; j < it->second.second && neighbor_num < min_neighbor_num; j++) {
+                        if (j == i) continue;
+                        const cv::Point3f diff = sorted_point_list[j] - p;
+                        if (diff.x * diff.x + diff.y * diff.y + diff.z * diff.z <= radius_sq) neighbor_num++;
+                    }
+                }
+            }
+        }
+        is_inlier_list[key_list[i].second] = neighbor_num >= min_neighbor_num;
+    }
+    return true;
+}
+
+bool PointCloudFilter::Compact(const std::vector<cv::Point3f>& object_point_list, const cv::Mat& image_color, const std::vector<uint8_t>& is_inlier_list,
+    std::vector<cv::Point3f>& object_point_list_out, cv::Mat& image_color_out)
+{
+    const int32_t point_num = static_cast<int32_t>(object_point_list.size());
+    const bool has_color = !image_color.empty();
+    if (is_inlier_list.size() != object_point_list.size() || (has_color && (image_color.type() != CV_8UC3 || !image_color.isContinuous() || image_color.total() != object_point_list.size()))) {
+        printf("[PointCloudFilter::Compact] invalid input\n");
+        return false;
+    }
+
+    /*** Output position of each block (prefix sum of the number of inliers) ***/
+    const int32_t block_num = (point_num + kCompactBlockSize - 1) / kCompactBlockSize;
+    std::vector<int32_t> offset_list(block_num + 1, 0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t b = 0; b < block_num; b++) {
+        const int32_t i_end = (std::min)(point_num, (b + 1) * kCompactBlockSize);
+        int32_t count = 0;
+        for (int32_t i = b * kCompactBlockSize; i < i_end; i++) count += is_inlier_list[i] ? 1 : 0;
+        offset_list[b + 1] = count;
+    }
+    for (int32_t b = 0; b < block_num; b++) offset_list[b + 1] += offset_list[b];
+
+    /*** Copy (output may be the same as input, so write to new buffers) ***/
+    std::vector<cv::Point3f> object_point_list_compact(offset_list[block_num]);
+    cv::Mat image_color_compact = has_color ? cv::Mat(offset_list[block_num], 1, CV_8UC3) : cv::Mat();
+    const cv::Vec3b* color_src = has_color ? image_color.ptr<cv::Vec3b>() : nullptr;
+    cv::Vec3b* color_dst = has_color ? image_color_compact.ptr<cv::Vec3b>() : nullptr;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t b = 0; b < block_num; b++) {
+        const int32_t i_end = (std::min)(point_num, (b + 1) * kCompactBlockSize);
+        int32_t index = offset_list[b];
+        for (int32_t i = b * kCompactBlockSize; i < i_end; i++) {
+            if (!is_inlier_list[i]) continue;
+            object_point_list_compact[index] = object_point_list[i];
+            if (has_color) color_dst[index] = color_src[i];
+            index++;
+        }
+    }
+    object_point_list_out.swap(object_point_list_compact);
+    image_color_out = image_color_compact;
+    return true;
+}
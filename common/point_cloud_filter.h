@@ -0,0 +1,52 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef POINT_CLOUD_FILTER_
+#define POINT_CLOUD_FILTER_
+
+/* for general */
+#include <cstdint>
+#include <vector>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Outlier removal for point clouds (e.g. flying pixels at depth discontinuities of a depth network)
+*   - FilterByDepthVariance: organized cloud (one point per pixel of the depth map)
+*       Points on any plane have inverse depth linear in the pixel coordinate, so the residual of a local linear fit of 1/Zc
+*       is 0 on planar surfaces and large around depth discontinuities. A point is removed when the residual std in the
+*       (2 * radius + 1)^2 window exceeds threshold * (1/Zc). Window sums slide along rows and columns: O(1) per point
+*   - FilterByRadius: unorganized cloud. A point is removed when it has less than min_neighbor_num points within radius.
+*       Points are bucketed into a voxel hash (voxel size = radius), so only 27 voxels are searched per point
+*   - Compact: remove the outliers from the points and their colors (order is kept)
+*   is_inlier_list: 1 = keep, 0 = remove (one per point)
+***/
+namespace PointCloudFilter
+{
+static constexpr int32_t kDefaultVarianceRadius = 2;
+static constexpr float kDefaultVarianceThreshold = 0.01f;
+static constexpr int32_t kDefaultMinNeighborNum = 4;
+
+/* mat_depth: CV_32FC1 or CV_16FC1 (Zc). Invalid depth (<= 0, NaN, Inf) is removed */
+bool FilterByDepthVariance(const cv::Mat& mat_depth, int32_t radius, float threshold, std::vector<uint8_t>& is_inlier_list);
+bool FilterByRadius(const std::vector<cv::Point3f>& object_point_list, float radius, int32_t min_neighbor_num, std::vector<uint8_t>& is_inlier_list);
+
+/* image_color: CV_8UC3 which has a color for each point, or empty. image_color_out: N x 1. Output can be the same as input */
+bool Compact(const std::vector<cv::Point3f>& object_point_list, const cv::Mat& image_color, const std::vector<uint8_t>& is_inlier_list,
+    std::vector<cv::Point3f>& object_point_list_out, cv::Mat& image_color_out);
+}
+
+#endif
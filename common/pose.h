@@ -0,0 +1,223 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef POSE_
+#define POSE_
+
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <array>
+
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Unit quaternion (w, x, y, z) for rotation
+*   - The same rotation as rotation vector (Rodrigues) r: w = cos(|r|/2), (x, y, z) = sin(|r|/2) * r / |r|
+*   - No heap allocation (unlike cv::Mat), so it can be used for per-frame pose updates
+***/
+class Quaternion
+{
+public:
+    float w, x, y, z;
+
+public:
+    Quaternion() : w(1), x(0), y(0), z(0) {}
+    Quaternion(float w, float x, float y, float z) : w(w), x(x), y(y), z(z) {}
+
+    /* rotation vector [rad] */
+    static Quaternion FromRotationVector(float rx, float ry, float rz)
+    {
+        float theta = std::sqrt(rx * rx + ry * ry + rz * rz);
+        if (theta < 1e-8f) {
+            /* sin(theta/2) / theta ~= 1/2 */
+            return Quaternion(1.0f, rx * 0.5f, ry * 0.5f, rz * 0.5f).Normalized();
+        }
+        float s = std::sin(theta * 0.5f) / theta;
+        return Quaternion(std::cos(theta * 0.5f), rx * s, ry * s, rz * s);
+    }
+
+    /* rotation vector [rad] (|r| <= pi, the same as cv::Rodrigues) */
+    void ToRotationVector(float& rx, float& ry, float& rz) const
+    {
+        float sign = (w < 0) ? -1.0f : 1.0f;   /* q and -q are the same rotation */
+        float norm_xyz = std::sqrt(x * x + y * y + z * z);
+        if (norm_xyz < 1e-8f) {
+            rx = 2 * sign * x;
+            ry = 2 * sign * y;
+            rz = 2 * sign * z;
+            return;
+        }
+        float theta = 2 * std::atan2(norm_xyz, sign * w);
+        float s = sign * theta / norm_xyz;
+        rx = x * s;
+        ry = y * s;
+        rz = z * s;
+    }
+
+    /* R: 3 x 3, row major */
+    static Quaternion FromRotationMat(const float R[9])
+    {
+        Quaternion q;
+        float trace = R[0] + R[4] + R[8];
+        if (trace > 0) {
+            float s = 0.5f / std::sqrt(trace + 1.0f);
+            q = Quaternion(0.25f / s, (R[7] - R[5]) * s, (R[2] - R[6]) * s, (R[3] - R[1]) * s);
+        } else if (R[0] > R[4] && R[0] > R[8]) {
+            float s = 2.0f * std::sqrt(1.0f + R[0] - R[4] - R[8]);
+            q = Quaternion((R[7] - R[5]) / s, 0.25f * s, (R[1] + R[3]) / s, (R[2] + R[6]) / s);
+        } else if (R[4] > R[8]) {
+            float s = 2.0f * std::sqrt(1.0f + R[4] - R[0] - R[8]);
+            q = Quaternion((R[2] - R[6]) / s, (R[1] + R[3]) / s, 0.25f * s, (R[5] + R[7]) / s);
+        } else {
+            float s = 2.0f * std::sqrt(1.0f + R[8] - R[0] - R[4]);
+            q = Quaternion((R[3] - R[1]) / s, (R[2] + R[6]) / s, (R[5] + R[7]) / s, 0.25f * s);
+        }
+        return q.Normalized();
+    }
+
+    void ToRotationMat(float R[9]) const
+    {
+        float xx = x * x, yy = y * y, zz = z * z;
+        float xy = x * y, xz = x * z, yz = y * z;
+        float wx = w * x, wy = w * y, wz = w * z;
+        R[0] = 1 - 2 * (yy + zz); R[1] = 2 * (xy - wz);     R[2] = 2 * (xz + wy);
+        R[3] = 2 * (xy + wz);     R[4] = 1 - 2 * (xx + zz); R[5] = 2 * (yz - wx);
+        R[6] = 2 * (xz - wy);     R[7] = 2 * (yz + wx);     R[8] = 1 - 2 * (xx + yy);
+    }
+
+    /* (a * b) rotates by b, then by a */
+    Quaternion operator*(const Quaternion& b) const
+    {
+        return Quaternion(
+            w * b.w - x * b.x - y * b.y - z * b.z,
+            w * b.x + x * b.w + y * b.z - z * b.y,
+            w * b.y - x * b.z + y * b.w + z * b.x,
+            w * b.z + x * b.y - y * b.x + z * b.w);
+    }
+
+    Quaternion Conjugate() const { return Quaternion(w, -x, -y, -z); }   /* = inverse for unit quaternion */
+
+    Quaternion Normalized() const
+    {
+        float norm = std::sqrt(w * w + x * x + y * y + z * z);
+        if (norm == 0) return Quaternion();
+        return Quaternion(w / norm, x / norm, y / norm, z / norm);
+    }
+
+    cv::Point3f Rotate(const cv::Point3f& p) const
+    {
+        /* p' = p + 2w(v x p) + 2v x (v x p), v = (x, y, z) */
+        float cx = y * p.z - z * p.y;
+        float cy = z * p.x - x * p.z;
+        float cz = x * p.y - y * p.x;
+        float ccx = y * cz - z * cy;
+        float ccy = z * cx - x * cz;
+        float ccz = x * cy - y * cx;
+        return cv::Point3f(p.x + 2 * (w * cx + ccx), p.y + 2 * (w * cy + ccy), p.z + 2 * (w * cz + ccz));
+    }
+
+    /* Spherical linear interpolation. ratio = 0: q0, ratio = 1: q1 */
+    static Quaternion Slerp(const Quaternion& q0, const Quaternion& q1, float ratio)
+    {
+        float dot = q0.w * q1.w + q0.x * q1.x + q0.y * q1.y + q0.z * q1.z;
+        float sign = 1.0f;
+        if (dot < 0) {
+            /* take the shorter path */
+            dot = -dot;
+            sign = -1.0f;
+        }
+        float k0, k1;
+        if (dot > 0.9995f) {
+            /* almost the same rotation. use linear interpolation to avoid division by sin(0) */
+            k0 = 1 - ratio;
+            k1 = ratio;
+        } else {
+            float theta = std::acos(dot);
+            float sin_theta_inv = 1.0f / std::sin(theta);
+            k0 = std::sin((1 - ratio) * theta) * sin_theta_inv;
+            k1 = std::sin(ratio * theta) * sin_theta_inv;
+        }
+        k1 *= sign;
+        return Quaternion(
+            k0 * q0.w + k1 * q1.w,
+            k0 * q0.x + k1 * q1.x,
+            k0 * q0.y + k1 * q1.y,
+            k0 * q0.z + k1 * q1.z).Normalized();
+    }
+};
+
+
+/***
+* Rigid transformation SE(3): p' = R * p + t
+*   - Rotation is stored as a unit quaternion. R is calculated when q is set, so a const Pose can be shared among threads
+*   - CameraModel uses it as world -> camera (Mc = R * Mw + t)
+*   - Interpolate works on (q, t) of this transformation. To interpolate camera positions, interpolate
+*     the inverse poses (camera -> world), whose t is the camera position
+***/
+class Pose
+{
+public:
+    Pose() : t_(0, 0, 0) { q_.ToRotationMat(R_.data()); }
+    Pose(const Quaternion& q, const cv::Point3f& t) : q_(q), t_(t) { q_.ToRotationMat(R_.data()); }
+
+    const Quaternion& q() const { return q_; }
+    const cv::Point3f& t() const { return t_; }
+    void SetRotation(const Quaternion& q) { q_ = q; q_.ToRotationMat(R_.data()); }
+    void SetTranslation(const cv::Point3f& t) { t_ = t; }
+
+    /* 3 x 3, row major */
+    const std::array<float, 9>& R() const { return R_; }
+
+    cv::Point3f Transform(const cv::Point3f& p) const
+    {
+        const std::array<float, 9>& R = R_;
+        return cv::Point3f(
+            R[0] * p.x + R[1] * p.y + R[2] * p.z + t_.x,
+            R[3] * p.x + R[4] * p.y + R[5] * p.z + t_.y,
+            R[6] * p.x + R[7] * p.y + R[8] * p.z + t_.z);
+    }
+
+    /* (a * b)(p) = a(b(p)) */
+    Pose operator*(const Pose& b) const
+    {
+        cv::Point3f t = q_.Rotate(b.t_);
+        return Pose((q_ * b.q_).Normalized(), cv::Point3f(t.x + t_.x, t.y + t_.y, t.z + t_.z));
+    }
+
+    /* p = R^-1 * (p' - t) */
+    Pose Inverse() const
+    {
+        Quaternion q_inv = q_.Conjugate();
+        cv::Point3f t = q_inv.Rotate(t_);
+        return Pose(q_inv, cv::Point3f(-t.x, -t.y, -t.z));
+    }
+
+    /* ratio = 0: a, ratio = 1: b */
+    static Pose Interpolate(const Pose& a, const Pose& b, float ratio)
+    {
+        return Pose(Quaternion::Slerp(a.q_, b.q_, ratio), a.t_ + (b.t_ - a.t_) * ratio);
+    }
+
+private:
+    Quaternion q_;
+    cv::Point3f t_;
+    std::array<float, 9> R_;
+};
+
+#endif
@@ -0,0 +1,289 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <thread>
+#include <mutex>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "result_log.h"
+
+/*** Macro ***/
+static constexpr uint32_t kFileMagic = 0x474f4c52;     /* "RLOG" */
+static constexpr uint32_t kBlockMagic = 0x4d415246;    /* "FRAM" */
+static constexpr uint32_t kVersion = 1;
+
+/*** Function ***/
+template <typename T>
+static inline void Append(std::vector<uint8_t>& buffer, const T& value)
+{
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+static size_t CalculateBlockSize(uint32_t face_num, uint32_t head_pose_num, uint32_t distance_num)
+{
+    return sizeof(ResultLog::BlockHeader)
+        + face_num * (4 + 10) * sizeof(int32_t)
+        + head_pose_num * (3 + 3) * sizeof(float)
+        + distance_num * (2 + 3) * sizeof(float);
+}
+
+
+/*** Writer ***/
+bool ResultLog::Writer::Open(const std::string& filename, size_t buffer_size)
+{
+    Close();
+    fp_ = fopen(filename.c_str(), "wb");
+    if (!fp_) {
+        printf("[ResultLog] Unable to open %s\n", filename.c_str());
+        return false;
+    }
+    setvbuf(fp_, nullptr, _IONBF, 0);   /* buffering is done by this class */
+
+    FileHeader file_header = { kFileMagic, kVersion };
+    fwrite(&file_header, sizeof(file_header), 1, fp_);
+
+    buffer_size_ = buffer_size;
+    buffer_.clear();
+    buffer_.reserve(buffer_size_);
+    is_exit_ = false;
+    dropped_buffer_num_ = 0;
+    thread_ = std::thread(&ResultLog::Writer::WriterThread, this);
+    return true;
+}
+
+void ResultLog::Writer::Close()
+{
+    if (!fp_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!buffer_.empty()) {
+            pending_buffer_list_.push_back(std::move(buffer_));
+            buffer_ = std::vector<uint8_t>();
+        }
+        is_exit_ = true;
+    }
+    cond_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    fclose(fp_);
+    fp_ = nullptr;
+    free_buffer_list_.clear();
+}
+
+void ResultLog::Writer::Write(const FrameRecord& record)
+{
+    if (!fp_) return;
+    const uint32_t face_num = static_cast<uint32_t>(record.bbox_list.size());
+    const uint32_t head_pose_num = static_cast<uint32_t>((std::min)(record.rvec_list.size(), record.tvec_list.size()));
+    const uint32_t distance_num = static_cast<uint32_t>((std::min)(record.distance_image_point_list.size(), record.distance_object_point_list.size()));
+
+    BlockHeader block_header;
+    block_header.magic = kBlockMagic;
+    block_header.block_size = static_cast<uint32_t>(CalculateBlockSize(face_num, head_pose_num, distance_num));
+    block_header.frame_id = record.frame_id;
+    block_header.timestamp_ns = record.timestamp_ns;
+    block_header.face_num = face_num;
+    block_header.head_pose_num = head_pose_num;
+    block_header.distance_num = distance_num;
+    block_header.reserved = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t size_before = buffer_.size();
+    Append(buffer_, block_header);
+    for (uint32_t i = 0; i < face_num; i++) {
+        const auto& bbox = record.bbox_list[i];
+        Append(buffer_, std::array<int32_t, 4>{ bbox.x, bbox.y, bbox.width, bbox.height });
+    }
+    for (uint32_t i = 0; i < face_num; i++) {
+        std::array<int32_t, 10> landmark = { 0 };
+        if (i < record.landmark_list.size()) {
+            for (int32_t j = 0; j < 5; j++) {
+                landmark[j * 2 + 0] = record.landmark_list[i][j].x;
+                landmark[j * 2 + 1] = record.landmark_list[i][j].y;
+            }
+        }
+        Append(buffer_, landmark);
+    }
+    for (uint32_t i = 0; i < head_pose_num; i++) Append(buffer_, record.rvec_list[i]);
+    for (uint32_t i = 0; i < head_pose_num; i++) Append(buffer_, record.tvec_list[i]);
+    for (uint32_t i = 0; i < distance_num; i++) Append(buffer_, record.distance_image_point_list[i]);
+    for (uint32_t i = 0; i < distance_num; i++) Append(buffer_, record.distance_object_point_list[i]);
+    if (buffer_.size() - size_before != block_header.block_size) {
+        printf("[ResultLog] Invalid block size\n");   /* must not happen */
+    }
+
+    if (buffer_.size() >= buffer_size_) {
+        if (pending_buffer_list_.size() >= kMaxPendingBufferNum) {
+            /* The disk can't keep up. Drop the buffered frames instead of blocking the processing thread */
+            dropped_buffer_num_++;
+            buffer_.clear();
+            return;
+        }
+        pending_buffer_list_.push_back(std::move(buffer_));
+        if (!free_buffer_list_.empty()) {
+            buffer_ = std::move(free_buffer_list_.back());
+            free_buffer_list_.pop_back();
+        } else {
+            buffer_ = std::vector<uint8_t>();
+            buffer_.reserve(buffer_size_ + block_header.block_size);
+        }
+        buffer_.clear();
+        cond_.notify_one();
+    }
+}
+
+void ResultLog::Writer::WriterThread()
+{
+    while (true) {
+        std::vector<uint8_t> buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return is_exit_ || !pending_buffer_list_.empty(); });
+            if (pending_buffer_list_.empty()) {
+                if (is_exit_) break;
+                continue;
+            }
+            buffer = std::move(pending_buffer_list_.front());
+            pending_buffer_list_.pop_front();
+        }
+
+        /* Large sequential write without holding the lock */
+        if (fwrite(buffer.data(), 1, buffer.size(), fp_) != buffer.size()) {
+            printf("[ResultLog] Failed to write\n");
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer.clear();
+        free_buffer_list_.push_back(std::move(buffer));
+    }
+}
+
+
+/*** Reader ***/
+bool ResultLog::Reader::Open(const std::string& filename)
+{
+    Close();
+#ifdef USE_MMAP
+    fd_ = open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        printf("[ResultLog] Unable to open %s\n", filename.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const uint8_t*>(addr);
+#else
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        printf("[ResultLog] Unable to open %s\n", filename.c_str());
+        return false;
+    }
+    size_ = static_cast<size_t>(ifs.tellg());
+    ifs.seekg(0, std::ios::beg);
+    file_buffer_.resize(size_);
+    ifs.read(reinterpret_cast<char*>(file_buffer_.data()), size_);
+    data_ = file_buffer_.data();
+#endif
+
+    FileHeader file_header = { 0, 0 };
+    if (size_ >= sizeof(FileHeader)) memcpy(&file_header, data_, sizeof(file_header));
+    if (file_header.magic != kFileMagic || file_header.version != kVersion) {
+        printf("[ResultLog] Invalid file %s\n", filename.c_str());
+        Close();
+        return false;
+    }
+
+    /* Index blocks (only headers are touched) */
+    block_offset_list_.clear();
+    size_t offset = sizeof(FileHeader);
+    while (offset + sizeof(BlockHeader) <= size_) {
+        BlockHeader block_header;
+        memcpy(&block_header, data_ + offset, sizeof(block_header));
+        if (block_header.magic != kBlockMagic || block_header.block_size != CalculateBlockSize(block_header.face_num, block_header.head_pose_num, block_header.distance_num)) break;
+        if (offset + block_header.block_size > size_) break;  /* truncated */
+        block_offset_list_.push_back(offset);
+        offset += block_header.block_size;
+    }
+    return true;
+}
+
+void ResultLog::Reader::Close()
+{
+#ifdef USE_MMAP
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+    if (fd_ >= 0) close(fd_);
+#endif
+    fd_ = -1;
+    data_ = nullptr;
+    size_ = 0;
+    file_buffer_.clear();
+    block_offset_list_.clear();
+}
+
+bool ResultLog::Reader::GetFrame(size_t index, FrameView& view) const
+{
+    if (index >= block_offset_list_.size()) return false;
+    const uint8_t* p = data_ + block_offset_list_[index];
+    BlockHeader block_header;
+    memcpy(&block_header, p, sizeof(block_header));
+    p += sizeof(BlockHeader);
+
+    view.frame_id = block_header.frame_id;
+    view.timestamp_ns = block_header.timestamp_ns;
+    view.face_num = block_header.face_num;
+    view.head_pose_num = block_header.head_pose_num;
+    view.distance_num = block_header.distance_num;
+    view.bbox = reinterpret_cast<const int32_t*>(p);
+    p += block_header.face_num * 4 * sizeof(int32_t);
+    view.landmark = reinterpret_cast<const int32_t*>(p);
+    p += block_header.face_num * 10 * sizeof(int32_t);
+    view.rvec = reinterpret_cast<const float*>(p);
+    p += block_header.head_pose_num * 3 * sizeof(float);
+    view.tvec = reinterpret_cast<const float*>(p);
+    p += block_header.head_pose_num * 3 * sizeof(float);
+    view.distance_image = reinterpret_cast<const float*>(p);
+    p += block_header.distance_num * 2 * sizeof(float);
+    view.distance_world = reinterpret_cast<const float*>(p);
+    return true;
+}
@@ -0,0 +1,155 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef RESULT_LOG_
+#define RESULT_LOG_
+
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Append-only binary log of per-frame results for offline analytics
+*   File:  [FileHeader][Block][Block]...
+*   Block: [BlockHeader][columns]
+*       int32 bbox[face_num][4]             (x, y, width, height)
+*       int32 landmark[face_num][10]        (x0, y0, ... x4, y4)
+*       float rvec[head_pose_num][3]
+*       float tvec[head_pose_num][3]
+*       float distance_image[distance_num][2]   (image point)
+*       float distance_world[distance_num][3]   (point on ground plane in world coordinate)
+*   Each column is stored contiguously, so a reader can use it as an array without parsing
+*
+* Writer: Write() only appends to a memory buffer. A background thread writes full buffers to the file
+* Reader: mmap the file and index the blocks. A truncated last block (e.g. crash) is ignored
+***/
+namespace ResultLog
+{
+typedef struct FileHeader_ {
+    uint32_t magic;
+    uint32_t version;
+} FileHeader;
+
+typedef struct BlockHeader_ {
+    uint32_t magic;
+    uint32_t block_size;    /* including this header */
+    int64_t frame_id;
+    int64_t timestamp_ns;
+    uint32_t face_num;
+    uint32_t head_pose_num;
+    uint32_t distance_num;
+    uint32_t reserved;
+} BlockHeader;
+
+typedef struct FrameRecord_ {
+    int64_t frame_id;
+    int64_t timestamp_ns;
+    std::vector<cv::Rect> bbox_list;
+    std::vector<std::array<cv::Point, 5>> landmark_list;
+    std::vector<cv::Vec3f> rvec_list;
+    std::vector<cv::Vec3f> tvec_list;
+    std::vector<cv::Point2f> distance_image_point_list;
+    std::vector<cv::Point3f> distance_object_point_list;
+
+    void Clear()
+    {
+        bbox_list.clear();
+        landmark_list.clear();
+        rvec_list.clear();
+        tvec_list.clear();
+        distance_image_point_list.clear();
+        distance_object_point_list.clear();
+    }
+} FrameRecord;
+
+/* Pointers to the columns in the mapped file */
+typedef struct FrameView_ {
+    int64_t frame_id;
+    int64_t timestamp_ns;
+    uint32_t face_num;
+    uint32_t head_pose_num;
+    uint32_t distance_num;
+    const int32_t* bbox;            /* [face_num][4] */
+    const int32_t* landmark;        /* [face_num][10] */
+    const float* rvec;              /* [head_pose_num][3] */
+    const float* tvec;              /* [head_pose_num][3] */
+    const float* distance_image;    /* [distance_num][2] */
+    const float* distance_world;    /* [distance_num][3] */
+} FrameView;
+
+
+class Writer
+{
+public:
+    static constexpr size_t kDefaultBufferSize = 4 * 1024 * 1024;
+
+public:
+    Writer() : fp_(nullptr), buffer_size_(kDefaultBufferSize), is_exit_(false), dropped_buffer_num_(0) {}
+    ~Writer() { Close(); }
+    bool Open(const std::string& filename, size_t buffer_size = kDefaultBufferSize);
+    void Close();
+    void Write(const FrameRecord& record);
+    int64_t GetDroppedBufferNum() const { return dropped_buffer_num_; }
+
+private:
+    void WriterThread();
+
+private:
+    static constexpr size_t kMaxPendingBufferNum = 8;   /* drop frames rather than blocking the caller when the disk is too slow */
+
+    FILE* fp_;
+    size_t buffer_size_;
+    std::vector<uint8_t> buffer_;           /* being filled by Write */
+    std::deque<std::vector<uint8_t>> pending_buffer_list_;  /* waiting to be written to the file */
+    std::vector<std::vector<uint8_t>> free_buffer_list_;    /* re-used to avoid allocation */
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool is_exit_;
+    int64_t dropped_buffer_num_;
+};
+
+
+class Reader
+{
+public:
+    Reader() : fd_(-1), data_(nullptr), size_(0) {}
+    ~Reader() { Close(); }
+    bool Open(const std::string& filename);
+    void Close();
+    size_t GetFrameNum() const { return block_offset_list_.size(); }
+    bool GetFrame(size_t index, FrameView& view) const;
+
+private:
+    int32_t fd_;
+    const uint8_t* data_;
+    size_t size_;
+    std::vector<uint8_t> file_buffer_;      /* used instead of mmap on the platform without mmap */
+    std::vector<size_t> block_offset_list_;
+};
+
+}
+
+#endif
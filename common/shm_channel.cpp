@@ -0,0 +1,448 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+#include "shm_channel.h"
+
+/*** Macro ***/
+static constexpr uint32_t kMagic = 0x4d485343;     /* "CSHM" */
+static constexpr uint32_t kVersion = 2;
+static constexpr int32_t kInodeCheckIntervalMs = 500;     /* interval to check if the segment is replaced (stat) */
+static constexpr size_t kAlignment = 64;    /* cache line */
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "atomic in shared memory must be lock free");
+
+/*** Function ***/
+static inline size_t AlignUp(size_t size)
+{
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+static inline size_t CalculateSlotStride(uint32_t slot_size)
+{
+    return AlignUp(sizeof(ShmChannel::SlotHeader)) + AlignUp(slot_size);
+}
+
+static inline size_t CalculateTotalSize(uint32_t slot_num, uint32_t slot_size)
+{
+    return AlignUp(sizeof(ShmChannel::Header)) + CalculateSlotStride(slot_size) * slot_num;
+}
+
+static inline ShmChannel::SlotHeader* GetSlot(ShmChannel::Header* header, uint64_t seq)
+{
+    uint8_t* base = reinterpret_cast<uint8_t*>(header) + AlignUp(sizeof(ShmChannel::Header));
+    return reinterpret_cast<ShmChannel::SlotHeader*>(base + CalculateSlotStride(header->slot_size) * (seq % header->slot_num));
+}
+
+static inline uint8_t* GetPayload(ShmChannel::SlotHeader* slot)
+{
+    return reinterpret_cast<uint8_t*>(slot) + AlignUp(sizeof(ShmChannel::SlotHeader));
+}
+
+#ifdef __linux__
+static void FutexWakeAll(std::atomic<uint32_t>* word)
+{
+    /* not FUTEX_PRIVATE_FLAG, because waiters are in other processes */
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+static void FutexWait(std::atomic<uint32_t>* word, uint32_t expected, int32_t timeout_ms)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeout_ms >= 0 ? &ts : nullptr, nullptr, 0);
+}
+#endif
+
+int64_t ShmChannel::GetTimestampNs()
+{
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);    /* common to all processes on the host */
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+/*** Writer ***/
+bool ShmChannel::Writer::Create(const std::string& name, uint32_t slot_num, uint32_t slot_size)
+{
+#ifdef __linux__
+    Close();
+    if (slot_num == 0) return false;
+    size_ = CalculateTotalSize(slot_num, slot_size);
+    /* Always create a new segment, so that a segment mapped by readers is never resized (SIGBUS). Readers of the old one detect the new inode */
+    shm_unlink(name.c_str());
+    fd_ = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (fd_ < 0) {
+        printf("[ShmChannel] Unable to create shared memory: %s\n", name.c_str());
+        return false;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+        printf("[ShmChannel] Unable to allocate shared memory: %s (%zu bytes)\n", name.c_str(), size_);
+        Close();
+        return false;
+    }
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        printf("[ShmChannel] Unable to map shared memory: %s\n", name.c_str());
+        Close();
+        return false;
+    }
+    name_ = name;
+    header_ = static_cast<Header*>(addr);
+
+    /* Invalidate the existing contents first, then publish the header (magic is written at last) */
+    header_->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->version = kVersion;
+    header_->slot_num = slot_num;
+    header_->slot_size = slot_size;
+    header_->generation.store(static_cast<uint64_t>(GetTimestampNs()) | 1, std::memory_order_relaxed);   /* not 0 */
+    header_->write_seq.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slot_num; i++) {
+        GetSlot(header_, i)->seq.store(0, std::memory_order_relaxed);
+    }
+    header_->futex_word.fetch_add(1, std::memory_order_release);
+    header_->magic = kMagic;
+    std::atomic_thread_fence(std::memory_order_release);
+    next_seq_ = 1;
+    return true;
+#else
+    printf("[ShmChannel] Not supported on this platform\n");
+    return false;
+#endif
+}
+
+void ShmChannel::Writer::Close()
+{
+#ifdef __linux__
+    if (header_) {
+        /* Tell the readers that this segment is not written any more */
+        header_->generation.store(0, std::memory_order_release);
+        header_->futex_word.fetch_add(1, std::memory_order_release);
+        FutexWakeAll(&header_->futex_word);
+        munmap(header_, size_);
+        header_ = nullptr;
+        /* unlink only if the name still points to this segment (a new writer may have re-created it) */
+        struct stat st_own, st_name;
+        int32_t fd = shm_open(name_.c_str(), O_RDONLY, 0);
+        if (fd >= 0) {
+            if (fstat(fd_, &st_own) == 0 && fstat(fd, &st_name) == 0 && st_own.st_ino == st_name.st_ino) {
+                shm_unlink(name_.c_str());
+            }
+            close(fd);
+        }
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+    writing_slot_ = nullptr;
+}
+
+uint8_t* ShmChannel::Writer::BeginWrite(uint32_t payload_size)
+{
+    if (!header_ || payload_size > header_->slot_size) {
+        printf("[ShmChannel] Invalid payload size (%u)\n", payload_size);
+        return nullptr;
+    }
+    writing_slot_ = GetSlot(header_, next_seq_);
+    writing_payload_size_ = payload_size;
+
+    /* seqlock: readers which are reading this slot will detect the change */
+    writing_slot_->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return GetPayload(writing_slot_);
+}
+
+uint64_t ShmChannel::Writer::EndWrite(int32_t type, int32_t rows, int32_t cols, int32_t mat_type, uint32_t element_num, int64_t timestamp_ns)
+{
+    if (!writing_slot_) return 0;
+    const uint64_t seq = next_seq_++;
+    writing_slot_->timestamp_ns = (timestamp_ns >= 0) ? timestamp_ns : GetTimestampNs();
+    writing_slot_->type = type;
+    writing_slot_->rows = rows;
+    writing_slot_->cols = cols;
+    writing_slot_->mat_type = mat_type;
+    writing_slot_->element_num = element_num;
+    writing_slot_->payload_size = writing_payload_size_;
+    writing_slot_->seq.store(seq, std::memory_order_release);
+    writing_slot_ = nullptr;
+
+    header_->write_seq.store(seq, std::memory_order_release);
+    header_->futex_word.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+    FutexWakeAll(&header_->futex_word);
+#endif
+    return seq;
+}
+
+uint64_t ShmChannel::Writer::Publish(int32_t type, const void* data, uint32_t payload_size, int64_t timestamp_ns)
+{
+    uint8_t* payload = BeginWrite(payload_size);
+    if (!payload) return 0;
+    memcpy(payload, data, payload_size);
+    return EndWrite(type, 0, 0, 0, payload_size, timestamp_ns);
+}
+
+uint64_t ShmChannel::Writer::PublishDepthMap(const cv::Mat& mat_depth, int64_t timestamp_ns)
+{
+    const uint32_t row_size = static_cast<uint32_t>(mat_depth.cols * mat_depth.elemSize());
+    uint8_t* payload = BeginWrite(row_size * mat_depth.rows);
+    if (!payload) return 0;
+    if (mat_depth.isContinuous()) {
+        memcpy(payload, mat_depth.data, static_cast<size_t>(row_size) * mat_depth.rows);
+    } else {
+        for (int32_t y = 0; y < mat_depth.rows; y++) {
+            memcpy(payload + static_cast<size_t>(row_size) * y, mat_depth.ptr(y), row_size);
+        }
+    }
+    return EndWrite(kTypeDepthMap, mat_depth.rows, mat_depth.cols, mat_depth.type(), static_cast<uint32_t>(mat_depth.total()), timestamp_ns);
+}
+
+uint64_t ShmChannel::Writer::PublishPointCloud(const std::vector<cv::Point3f>& object_point_list, int64_t timestamp_ns)
+{
+    const uint32_t payload_size = static_cast<uint32_t>(object_point_list.size() * sizeof(cv::Point3f));
+    uint8_t* payload = BeginWrite(payload_size);
+    if (!payload) return 0;
+    memcpy(payload, object_point_list.data(), payload_size);
+    return EndWrite(kTypePointCloud, 0, 0, 0, static_cast<uint32_t>(object_point_list.size()), timestamp_ns);
+}
+
+uint64_t ShmChannel::Writer::PublishFaceDetection(const std::vector<cv::Rect>& bbox_list, const std::vector<std::array<cv::Point, 5>>& landmark_list, int64_t timestamp_ns)
+{
+    const uint32_t payload_size = static_cast<uint32_t>(bbox_list.size() * sizeof(FaceRecord));
+    uint8_t* payload = BeginWrite(payload_size);
+    if (!payload) return 0;
+    FaceRecord* record_list = reinterpret_cast<FaceRecord*>(payload);
+    for (size_t i = 0; i < bbox_list.size(); i++) {
+        FaceRecord& record = record_list[i];
+        record.x = bbox_list[i].x;
+        record.y = bbox_list[i].y;
+        record.width = bbox_list[i].width;
+        record.height = bbox_list[i].height;
+        for (size_t j = 0; j < 5; j++) {
+            record.landmark[j * 2 + 0] = (i < landmark_list.size()) ? landmark_list[i][j].x : 0;
+            record.landmark[j * 2 + 1] = (i < landmark_list.size()) ? landmark_list[i][j].y : 0;
+        }
+    }
+    return EndWrite(kTypeFaceDetection, 0, 0, 0, static_cast<uint32_t>(bbox_list.size()), timestamp_ns);
+}
+
+
+/*** Reader ***/
+bool ShmChannel::Reader::Open(const std::string& name)
+{
+#ifdef __linux__
+    Close();
+    fd_ = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        Close();
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (addr == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    header_ = static_cast<Header*>(addr);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->magic != kMagic || header_->version != kVersion || CalculateTotalSize(header_->slot_num, header_->slot_size) > size_) {
+        printf("[ShmChannel] Invalid shared memory: %s\n", name.c_str());
+        Close();
+        return false;
+    }
+    generation_ = header_->generation.load(std::memory_order_acquire);
+    if (generation_ == 0) {
+        /* the writer has been closed */
+        Close();
+        return false;
+    }
+    name_ = name;
+    inode_ = static_cast<uint64_t>(st.st_ino);
+    time_inode_check_ = std::chrono::steady_clock::now();
+    last_seq_ = 0;
+    dropped_num_ = 0;
+    return true;
+#else
+    printf("[ShmChannel] Not supported on this platform\n");
+    return false;
+#endif
+}
+
+void ShmChannel::Reader::Close()
+{
+#ifdef __linux__
+    if (header_) {
+        munmap(header_, size_);
+        header_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+bool ShmChannel::Reader::Wait(int32_t timeout_ms)
+{
+    const auto time_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        if (!CheckWriter()) return false;
+        uint32_t word = header_->futex_word.load(std::memory_order_acquire);
+        if (header_->write_seq.load(std::memory_order_acquire) > last_seq_) return true;
+
+        /* wake up periodically to check if the writer has restarted (a crashed writer doesn't wake us) */
+        int32_t wait_ms = kInodeCheckIntervalMs;
+        if (timeout_ms >= 0) {
+            wait_ms = static_cast<int32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time_deadline - std::chrono::steady_clock::now()).count());
+            if (wait_ms <= 0) return false;
+            wait_ms = (std::min)(wait_ms, kInodeCheckIntervalMs);
+        }
+#ifdef __linux__
+        FutexWait(&header_->futex_word, word, wait_ms);
+#else
+        (void)word;
+        return false;
+#endif
+    }
+}
+
+uint64_t ShmChannel::Reader::GetLatestSeq() const
+{
+    return header_ ? header_->write_seq.load(std::memory_order_acquire) : 0;
+}
+
+bool ShmChannel::Reader::AcquireLatest(SlotView& view)
+{
+    if (!CheckWriter()) return false;
+    uint64_t seq = GetLatestSeq();
+    if (seq == 0 || seq == last_seq_) return false;
+    return Acquire(seq, view);
+}
+
+bool ShmChannel::Reader::AcquireNext(SlotView& view)
+{
+    if (!CheckWriter()) return false;
+    uint64_t seq = last_seq_ + 1;
+    uint64_t latest_seq = GetLatestSeq();
+    if (seq > latest_seq) return false;
+    if (latest_seq - seq >= header_->slot_num) {
+        /* already overwritten (write_seq - last_seq_ > slot_num). Resync to the latest one instead of failing forever */
+        uint64_t dropped_num = latest_seq - seq;
+        if (!Acquire(latest_seq, view)) return false;
+        dropped_num_ += dropped_num;
+        return true;
+    }
+    return Acquire(seq, view);
+}
+
+/* Reopen the channel if the writer has restarted. false if the channel is not available */
+bool ShmChannel::Reader::CheckWriter()
+{
+    if (!header_) return false;
+    if (!IsWriterChanged()) return true;
+    const std::string name = name_;
+    const uint64_t dropped_num = dropped_num_;
+    Close();
+    if (!Open(name)) return false;
+    dropped_num_ = dropped_num;
+    return true;
+}
+
+bool ShmChannel::Reader::IsWriterChanged()
+{
+    if (header_->generation.load(std::memory_order_acquire) != generation_) return true;
+#ifdef __linux__
+    /* A writer which didn't close the segment can't mark it. Check if the name points to a new segment once in a while */
+    const auto time_now = std::chrono::steady_clock::now();
+    if (time_now - time_inode_check_ < std::chrono::milliseconds(kInodeCheckIntervalMs)) return false;
+    time_inode_check_ = time_now;
+    int32_t fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;   /* the new writer hasn't created it yet */
+    struct stat st;
+    bool is_changed = fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_ino) != inode_;
+    close(fd);
+    return is_changed;
+#else
+    return false;
+#endif
+}
+
+bool ShmChannel::Reader::Acquire(uint64_t seq, SlotView& view)
+{
+    if (!header_) return false;
+    SlotHeader* slot = GetSlot(header_, seq);
+    if (slot->seq.load(std::memory_order_acquire) != seq) return false;
+    view.seq = seq;
+    view.timestamp_ns = slot->timestamp_ns;
+    view.type = slot->type;
+    view.rows = slot->rows;
+    view.cols = slot->cols;
+    view.mat_type = slot->mat_type;
+    view.element_num = slot->element_num;
+    view.payload_size = slot->payload_size;
+    view.payload = GetPayload(slot);
+    if (!Validate(view) || view.payload_size > header_->slot_size) return false;
+    last_seq_ = seq;
+    return true;
+}
+
+bool ShmChannel::Reader::Validate(const SlotView& view) const
+{
+    if (!header_) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return GetSlot(header_, view.seq)->seq.load(std::memory_order_relaxed) == view.seq;
+}
+
+cv::Mat ShmChannel::Reader::AsMat(const SlotView& view)
+{
+    if (view.type != kTypeDepthMap) return cv::Mat();
+    return cv::Mat(view.rows, view.cols, view.mat_type, const_cast<uint8_t*>(view.payload));
+}
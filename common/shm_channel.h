@@ -0,0 +1,168 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef SHM_CHANNEL_
+#define SHM_CHANNEL_
+
+/* for general */
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+
+/* for OpenCV */
+#include <opencv2/opencv.hpp>
+
+
+/***
+* Shared-memory ring buffer to pass results to other processes on the same host without serialization
+*   - POSIX shared memory (shm_open + mmap). One writer, any number of readers
+*   - Each slot has a sequence number (seqlock). Readers access the payload in place, then validate it
+*     (the payload may be overwritten if a reader is slower than slot_num frames)
+*   - Readers sleep on a futex in the shared memory, and the writer wakes them up at every publish
+*   - A restarted writer creates a new segment (a new generation). Readers detect it and reopen the channel
+*   - Linux only. On other platforms Create / Open fail
+*
+* Layout: [Header][SlotHeader + payload (slot_size)] * slot_num
+***/
+namespace ShmChannel
+{
+/* Channel names used by the samples */
+static constexpr char kNameDepthMap[] = "/opencv_sample_depth_map";
+static constexpr char kNamePointCloud[] = "/opencv_sample_point_cloud";
+static constexpr char kNameFaceDetection[] = "/opencv_sample_face_detection";
+
+enum {
+    kTypeRaw = 0,
+    kTypeDepthMap,          /* cv::Mat (rows x cols, mat_type) */
+    kTypePointCloud,        /* cv::Point3f * element_num */
+    kTypeFaceDetection,     /* FaceRecord * element_num */
+};
+
+/* One face (bbox + 5 landmarks) */
+typedef struct FaceRecord_ {
+    int32_t x, y, width, height;
+    std::array<int32_t, 10> landmark;   /* x0, y0, x1, y1, ... */
+} FaceRecord;
+
+typedef struct SlotView_ {
+    uint64_t seq;
+    int64_t timestamp_ns;   /* CLOCK_MONOTONIC */
+    int32_t type;
+    int32_t rows;
+    int32_t cols;
+    int32_t mat_type;
+    uint32_t element_num;
+    uint32_t payload_size;
+    const uint8_t* payload; /* points to the shared memory (valid until the slot is overwritten) */
+} SlotView;
+
+typedef struct Header_ {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_num;
+    uint32_t slot_size;
+    std::atomic<uint64_t> generation;   /* unique for each Create. 0 after the writer is closed */
+    std::atomic<uint32_t> futex_word;   /* incremented at every publish */
+    std::atomic<uint64_t> write_seq;    /* the latest published sequence number (0 = none) */
+} Header;
+
+typedef struct SlotHeader_ {
+    std::atomic<uint64_t> seq;          /* 0 while writing */
+    int64_t timestamp_ns;
+    int32_t type;
+    int32_t rows;
+    int32_t cols;
+    int32_t mat_type;
+    uint32_t element_num;
+    uint32_t payload_size;
+} SlotHeader;
+
+int64_t GetTimestampNs();
+
+
+class Writer
+{
+public:
+    Writer() : fd_(-1), size_(0), header_(nullptr), next_seq_(1), writing_slot_(nullptr) {}
+    ~Writer() { Close(); }
+    bool Create(const std::string& name, uint32_t slot_num, uint32_t slot_size);
+    void Close();
+
+    /* Zero copy: write the payload directly into the returned buffer, then call EndWrite */
+    uint8_t* BeginWrite(uint32_t payload_size);
+    uint64_t EndWrite(int32_t type, int32_t rows, int32_t cols, int32_t mat_type, uint32_t element_num, int64_t timestamp_ns = -1);
+
+    uint64_t Publish(int32_t type, const void* data, uint32_t payload_size, int64_t timestamp_ns = -1);
+    uint64_t PublishDepthMap(const cv::Mat& mat_depth, int64_t timestamp_ns = -1);
+    uint64_t PublishPointCloud(const std::vector<cv::Point3f>& object_point_list, int64_t timestamp_ns = -1);
+    uint64_t PublishFaceDetection(const std::vector<cv::Rect>& bbox_list, const std::vector<std::array<cv::Point, 5>>& landmark_list, int64_t timestamp_ns = -1);
+
+private:
+    std::string name_;
+    int32_t fd_;
+    size_t size_;
+    Header* header_;
+    uint64_t next_seq_;
+    SlotHeader* writing_slot_;
+    uint32_t writing_payload_size_;
+};
+
+
+class Reader
+{
+public:
+    Reader() : fd_(-1), size_(0), header_(nullptr), last_seq_(0), dropped_num_(0), generation_(0), inode_(0) {}
+    ~Reader() { Close(); }
+    bool Open(const std::string& name);
+    void Close();
+    bool IsOpened() const { return header_ != nullptr; }
+
+    /* Wait until a sequence newer than the last read one is published. timeout_ms < 0: wait forever */
+    /* Wait, AcquireLatest and AcquireNext reopen the channel when the writer has restarted, and fail if it's gone (IsOpened() = false) */
+    bool Wait(int32_t timeout_ms = -1);
+
+    /* Get the latest slot (skip older ones). Call Validate after using the payload */
+    bool AcquireLatest(SlotView& view);
+    /* Get the next slot of the last read one. false if it's not yet published */
+    /* If the writer has lapped the reader (the next slot is already overwritten), jump to the latest slot and count the skipped ones as dropped */
+    bool AcquireNext(SlotView& view);
+    bool Validate(const SlotView& view) const;
+
+    uint64_t GetLatestSeq() const;
+    uint64_t GetDroppedNum() const { return dropped_num_; }     /* total number of sequences skipped by AcquireNext */
+    static cv::Mat AsMat(const SlotView& view);     /* no copy */
+
+private:
+    bool Acquire(uint64_t seq, SlotView& view);
+    bool CheckWriter();
+    bool IsWriterChanged();
+
+private:
+    std::string name_;
+    int32_t fd_;
+    size_t size_;
+    Header* header_;
+    uint64_t last_seq_;
+    uint64_t dropped_num_;
+    uint64_t generation_;
+    uint64_t inode_;                                            /* to detect a new segment of a writer which didn't close the old one (e.g. crash) */
+    std::chrono::steady_clock::time_point time_inode_check_;
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+/* for general */
+#include <cstdint>
+#include <cstdio>
+
+#include "cpu_feature.h"
+#include "simd_kernel.h"
+
+/* Kernels for the baseline ISA (compiled with the default flags) */
+#define SIMD_KERNEL_NAMESPACE SimdKernelScalar
+#include "simd_kernel_impl.h"
+
+/*** Function ***/
+static SimdKernel::Table SelectTable()
+{
+    SimdKernel::Table table;
+    int32_t isa = CpuFeature::GetIsa();
+#ifdef SIMD_KERNEL_X86
+    switch (isa) {
+    case CpuFeature::kIsaAvx512:
+        SimdKernelAvx512::GetTable(table);
+        break;
+    case CpuFeature::kIsaAvx2:
+        SimdKernelAvx2::GetTable(table);
+        break;
+    case CpuFeature::kIsaSse42:
+        SimdKernelSse42::GetTable(table);
+        break;
+    default:
+        SimdKernelScalar::GetTable(table);
+        isa = CpuFeature::kIsaScalar;
+        break;
+    }
+#else
+    SimdKernelScalar::GetTable(table);
+    isa = CpuFeature::kIsaScalar;
+#endif
+    table.isa = isa;
+    return table;
+}
+
+const SimdKernel::Table& SimdKernel::GetTable()
+{
+    static const Table s_table = SelectTable();
+    return s_table;
+}
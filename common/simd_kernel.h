@@ -0,0 +1,121 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef SIMD_KERNEL_
+#define SIMD_KERNEL_
+
+/* for general */
+#include <cstdint>
+
+
+/***
+* Hot loops compiled for several ISA levels in one binary, and dispatched at runtime by CpuFeature
+*   - The same source (simd_kernel_impl.h) is compiled in simd_kernel_<isa>.cpp with the ISA specific flags
+*   - Use GetTable() once and call the function pointers. The table is selected at the first call
+*   - Kernels work on raw arrays only (cv::Point2f / cv::Point3f can be passed as interleaved float arrays)
+*     so that no inline function from other headers is compiled with the extended ISA
+*   - Kernels are single-threaded. Callers split the work (e.g. OpenMP over blocks or rows)
+***/
+namespace SimdKernel
+{
+/* World -> image (the same math as CameraModel::ConvertWorld2Image) */
+typedef struct ProjectionParam_ {
+    float Rt[12];           /* [R t], 3 x 4, row major */
+    float fx, fy, cx, cy;
+    float k1, k2, p1, p2;
+    int32_t is_distorted;
+} ProjectionParam;
+
+/* Undistortion map for the unified projection model (fisheye) */
+typedef struct UnifiedProjectionParam_ {
+    float f_undist, u0_undist, v0_undist;
+    float xi;
+    float f_dist, u0_dist, v0_dist;
+} UnifiedProjectionParam;
+
+/* Sums of the powers of (x, y) for regression */
+enum {
+    kMomentX = 0,
+    kMomentY,
+    kMomentXX,
+    kMomentXXX,
+    kMomentXXXX,
+    kMomentXY,
+    kMomentXXY,
+    kMomentNum,
+};
+
+typedef struct Table_ {
+    int32_t isa;    /* CpuFeature::kIsa* */
+
+    /* object_point: (x, y, z) * num -> image_point: (x, y) * num. (-1, -1) for points behind the camera */
+    void (*ProjectPoints)(const ProjectionParam& param, const float* object_point, float* image_point, int32_t num);
+
+    /* Rolling shutter: each point is projected with the pose of the row where it's projected */
+    /*   row_Rt_table: [R t] (3 x 4) * row_num. param.Rt is used for the first guess of the row */
+    void (*ProjectPointsRollingShutter)(const ProjectionParam& param, const float* row_Rt_table, int32_t row_num, const float* object_point, float* image_point, int32_t num);
+
+    /* dst = M * [src, 1] (M: 3 x 4, row major). (x, y, z) * num. src == dst is allowed (in-place) */
+    void (*TransformPoints)(const float M[12], const float* src, float* dst, int32_t num);
+
+    /* The same as TransformPoints for SoA (separate arrays of x, y, z). src_* == dst_* is allowed */
+    void (*TransformPointsSoA)(const float M[12], const float* src_x, const float* src_y, const float* src_z, float* dst_x, float* dst_y, float* dst_z, int32_t num);
+
+    /* image_point: (x, y) * num (undistorted), z: Zc * num -> object_point (in camera coordinate): (x, y, z) * num */
+    void (*UnprojectPoints)(float fx, float fy, float cx, float cy, const float* image_point, const float* z, float* object_point, int32_t num);
+
+    /* Rolling shutter: image_point (undistorted), z -> object_point in world coordinate using the pose of the row */
+    /*   row_Rt_inv_table: [R^-1 C] (3 x 4) * row_num. The row is y of image_point_raw (before undistortion) */
+    void (*UnprojectPointsRollingShutter)(float fx, float fy, float cx, float cy, const float* row_Rt_inv_table, int32_t row_num,
+        const float* image_point, const float* image_point_raw, const float* z, float* object_point, int32_t num);
+
+    /* One row of a depth map -> 3D points: M * [Zc * u, Zc * v, Zc, 1] (M: 3 x 4, camera -> output coordinate) */
+    /*   ray: (u, v) * width (Xc / Zc, Yc / Zc). nullptr: calculated from fx, fy, cx, cy and y (no distortion) */
+    /*   z: Zc * width -> xyz: (x, y, z) * width */
+    void (*UnprojectDepthRow)(const float M[12], const float* ray, float fx, float fy, float cx, float cy, int32_t y,
+        const float* z, float* xyz, int32_t width);
+
+    /* Intersection of rays and planes. The nearest plane in front of the camera is taken */
+    /*   ray: (u, v) * num (Xc / Zc, Yc / Zc: normalized undistorted image point) */
+    /*   row_Rt_inv_table: [R^-1 C] (3 x 4) * row_num. The row is y of image_point_raw (row_num = 1: global shutter) */
+    /*   plane: (nx, ny, nz, d) * plane_num (n^T * Mw + d = 0) */
+    /*   -> object_point (in world coordinate): (x, y, z) * num, plane_index: index of the plane (-1 if no plane is hit) */
+    void (*IntersectPlanes)(const float* row_Rt_inv_table, int32_t row_num, const float* ray, const float* image_point_raw,
+        const float* plane, int32_t plane_num, float* object_point, int32_t* plane_index, int32_t num);
+
+    /* one row of cv::remap maps (CV_32FC1) */
+    void (*MakeUnifiedUndistortMapRow)(const UnifiedProjectionParam& param, int32_t y, int32_t width, float* mapx, float* mapy);
+
+    /* uint8 HWC (3 channels) -> float CHW: dst[c] = src[c] * scale[c] + bias[c]. is_swap_rb: BGR -> RGB */
+    void (*ConvertImageToBlob)(const uint8_t* src, int32_t src_step, int32_t width, int32_t height, const float scale[3], const float bias[3], bool is_swap_rb, float* dst);
+
+    /* float <-> IEEE 754 half (round to nearest even). F16C on AVX2 / AVX-512 levels. For FP16 storage of depth maps */
+    void (*ConvertFloatToHalf)(const float* src, uint16_t* dst, int32_t num);
+    void (*ConvertHalfToFloat)(const uint16_t* src, float* dst, int32_t num);
+
+    /* point: (x, y) * num -> moment[kMomentNum] */
+    void (*CalculateMoments)(const float* point, int32_t num, double moment[kMomentNum]);
+} Table;
+
+const Table& GetTable();
+
+}
+
+/* Kernel tables of each ISA (defined in simd_kernel_<isa>.cpp) */
+namespace SimdKernelScalar { void GetTable(SimdKernel::Table& table); }
+namespace SimdKernelSse42 { void GetTable(SimdKernel::Table& table); }
+namespace SimdKernelAvx2 { void GetTable(SimdKernel::Table& table); }
+namespace SimdKernelAvx512 { void GetTable(SimdKernel::Table& table); }
+
+#endif
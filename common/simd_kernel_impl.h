@@ -0,0 +1,436 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/***
+* Kernel implementations shared by all ISA levels
+*   Include this file only from simd_kernel_<isa>.cpp after defining SIMD_KERNEL_NAMESPACE.
+*   Loops are written to be vectorized by the compiler (omp simd) with the flags of each translation unit.
+*   Do not include headers which have inline functions (e.g. OpenCV) here (ODR: the linker may pick the AVX version)
+***/
+#ifndef SIMD_KERNEL_NAMESPACE
+#error "define SIMD_KERNEL_NAMESPACE before including simd_kernel_impl.h"
+#endif
+
+/*** Include ***/
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+
+#include "simd_kernel.h"
+
+#if defined(_OPENMP) && (_OPENMP >= 201307)
+#define SIMD_KERNEL_OMP_SIMD
+#endif
+
+/* F16C: float <-> half conversion instructions (AVX2 and AVX-512 levels) */
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define SIMD_KERNEL_F16C
+#include <immintrin.h>
+#endif
+
+namespace SIMD_KERNEL_NAMESPACE
+{
+static constexpr int32_t kRollingShutterIterationNum = 2;
+static constexpr float kNoIntersection = 999.0f;    /* the same value as CameraModel uses for the sky */
+static constexpr float kMaxRayLength = 1.0e30f;
+static constexpr int32_t kChunkSize = 256;          /* work buffer size on the stack */
+
+static inline void ProjectPoint(const SimdKernel::ProjectionParam& param, const float* Rt, float X, float Y, float Z, float& x, float& y)
+{
+    const float Xc = Rt[0] * X + Rt[1] * Y + Rt[2] * Z + Rt[3];
+    const float Yc = Rt[4] * X + Rt[5] * Y + Rt[6] * Z + Rt[7];
+    const float Zc = Rt[8] * X + Rt[9] * Y + Rt[10] * Z + Rt[11];
+    const float Zc_inv = 1.0f / Zc;
+    float u = Xc * Zc_inv;  /* from optical center */
+    float v = Yc * Zc_inv;
+    if (param.is_distorted) {
+        const float r2 = u * u + v * v;
+        const float r4 = r2 * r2;
+        u = u + u * (param.k1 * r2 + param.k2 * r4) + (2 * param.p1 * u * v) + param.p2 * (r2 + 2 * u * u);
+        v = v + v * (param.k1 * r2 + param.k2 * r4) + (2 * param.p2 * u * v) + param.p1 * (r2 + 2 * v * v);
+    }
+    /* Do not project points behind the camera */
+    x = (Zc > 0) ? u * param.fx + param.cx : -1.0f;
+    y = (Zc > 0) ? v * param.fy + param.cy : -1.0f;
+}
+
+static inline int32_t ClampRow(float y, int32_t row_num)
+{
+    /* fmaxf returns 0 for NaN */
+    return static_cast<int32_t>(fminf(fmaxf(y + 0.5f, 0.0f), static_cast<float>(row_num - 1)));
+}
+
+static void ProjectPoints(const SimdKernel::ProjectionParam& param_org, const float* object_point, float* image_point, int32_t num)
+{
+    const SimdKernel::ProjectionParam param = param_org;    /* local copy: not aliased with the output */
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        ProjectPoint(param, param.Rt, object_point[i * 3 + 0], object_point[i * 3 + 1], object_point[i * 3 + 2], image_point[i * 2 + 0], image_point[i * 2 + 1]);
+    }
+}
+
+static void ProjectPointsRollingShutter(const SimdKernel::ProjectionParam& param_org, const float* row_Rt_table, int32_t row_num, const float* object_point, float* image_point, int32_t num)
+{
+    const SimdKernel::ProjectionParam param = param_org;    /* local copy: not aliased with the output */
+    /* The row depends on the pose, and the pose depends on the row. Iterate a few times (the pose changes slowly between rows) */
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const float X = object_point[i * 3 + 0];
+        const float Y = object_point[i * 3 + 1];
+        const float Z = object_point[i * 3 + 2];
+        float x, y;
+        ProjectPoint(param, param.Rt, X, Y, Z, x, y);
+        for (int32_t iteration = 0; iteration < kRollingShutterIterationNum; iteration++) {
+            ProjectPoint(param, row_Rt_table + ClampRow(y, row_num) * 12, X, Y, Z, x, y);
+        }
+        image_point[i * 2 + 0] = x;
+        image_point[i * 2 + 1] = y;
+    }
+}
+
+static void TransformPoints(const float M_org[12], const float* src, float* dst, int32_t num)
+{
+    float M[12];
+    for (int32_t i = 0; i < 12; i++) M[i] = M_org[i];
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const float x = src[i * 3 + 0];
+        const float y = src[i * 3 + 1];
+        const float z = src[i * 3 + 2];
+        dst[i * 3 + 0] = M[0] * x + M[1] * y + M[2] * z + M[3];
+        dst[i * 3 + 1] = M[4] * x + M[5] * y + M[6] * z + M[7];
+        dst[i * 3 + 2] = M[8] * x + M[9] * y + M[10] * z + M[11];
+    }
+}
+
+static void TransformPointsSoA(const float M_org[12], const float* src_x, const float* src_y, const float* src_z, float* dst_x, float* dst_y, float* dst_z, int32_t num)
+{
+    float M[12];
+    for (int32_t i = 0; i < 12; i++) M[i] = M_org[i];
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const float x = src_x[i];
+        const float y = src_y[i];
+        const float z = src_z[i];
+        dst_x[i] = M[0] * x + M[1] * y + M[2] * z + M[3];
+        dst_y[i] = M[4] * x + M[5] * y + M[6] * z + M[7];
+        dst_z[i] = M[8] * x + M[9] * y + M[10] * z + M[11];
+    }
+}
+
+static void UnprojectPoints(float fx, float fy, float cx, float cy, const float* image_point, const float* z, float* object_point, int32_t num)
+{
+    const float fx_inv = 1.0f / fx;
+    const float fy_inv = 1.0f / fy;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const float Zc = z[i];
+        object_point[i * 3 + 0] = Zc * (image_point[i * 2 + 0] - cx) * fx_inv;
+        object_point[i * 3 + 1] = Zc * (image_point[i * 2 + 1] - cy) * fy_inv;
+        object_point[i * 3 + 2] = Zc;
+    }
+}
+
+static void UnprojectPointsRollingShutter(float fx, float fy, float cx, float cy, const float* row_Rt_inv_table, int32_t row_num,
+    const float* image_point, const float* image_point_raw, const float* z, float* object_point, int32_t num)
+{
+    const float fx_inv = 1.0f / fx;
+    const float fy_inv = 1.0f / fy;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const float* Rt_inv = row_Rt_inv_table + ClampRow(image_point_raw[i * 2 + 1], row_num) * 12;
+        const float Zc = z[i];
+        const float Xc = Zc * (image_point[i * 2 + 0] - cx) * fx_inv;
+        const float Yc = Zc * (image_point[i * 2 + 1] - cy) * fy_inv;
+        object_point[i * 3 + 0] = Rt_inv[0] * Xc + Rt_inv[1] * Yc + Rt_inv[2] * Zc + Rt_inv[3];
+        object_point[i * 3 + 1] = Rt_inv[4] * Xc + Rt_inv[5] * Yc + Rt_inv[6] * Zc + Rt_inv[7];
+        object_point[i * 3 + 2] = Rt_inv[8] * Xc + Rt_inv[9] * Yc + Rt_inv[10] * Zc + Rt_inv[11];
+    }
+}
+
+static void UnprojectDepthRow(const float M_org[12], const float* ray, float fx, float fy, float cx, float cy, int32_t y,
+    const float* z, float* xyz, int32_t width)
+{
+    float M[12];
+    for (int32_t i = 0; i < 12; i++) M[i] = M_org[i];
+    if (ray) {
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+        for (int32_t x = 0; x < width; x++) {
+            const float Zc = z[x];
+            const float Xc = Zc * ray[x * 2 + 0];
+            const float Yc = Zc * ray[x * 2 + 1];
+            xyz[x * 3 + 0] = M[0] * Xc + M[1] * Yc + M[2] * Zc + M[3];
+            xyz[x * 3 + 1] = M[4] * Xc + M[5] * Yc + M[6] * Zc + M[7];
+            xyz[x * 3 + 2] = M[8] * Xc + M[9] * Yc + M[10] * Zc + M[11];
+        }
+    } else {
+        const float fx_inv = 1.0f / fx;
+        const float v = (y - cy) / fy;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+        for (int32_t x = 0; x < width; x++) {
+            const float Zc = z[x];
+            const float Xc = Zc * (x - cx) * fx_inv;
+            const float Yc = Zc * v;
+            xyz[x * 3 + 0] = M[0] * Xc + M[1] * Yc + M[2] * Zc + M[3];
+            xyz[x * 3 + 1] = M[4] * Xc + M[5] * Yc + M[6] * Zc + M[7];
+            xyz[x * 3 + 2] = M[8] * Xc + M[9] * Yc + M[10] * Zc + M[11];
+        }
+    }
+}
+
+static void IntersectPlanes(const float* row_Rt_inv_table, int32_t row_num, const float* ray, const float* image_point_raw,
+    const float* plane, int32_t plane_num, float* object_point, int32_t* plane_index, int32_t num)
+{
+    /* M = C + s * d, where d = R^-1 * [u, v, 1] (ray in world coordinate) */
+    /* n^T * (C + s * d) + D = 0 -> s = -(n^T * C + D) / (n^T * d) */
+    /* Points are processed in chunks, and planes are the outer loop so that the loop over points is vectorized */
+    float cx[kChunkSize], cy[kChunkSize], cz[kChunkSize];
+    float dx[kChunkSize], dy[kChunkSize], dz[kChunkSize];
+    float s_nearest[kChunkSize];
+    int32_t index_nearest[kChunkSize];
+    for (int32_t i_start = 0; i_start < num; i_start += kChunkSize) {
+        const int32_t chunk_num = (i_start + kChunkSize < num) ? kChunkSize : num - i_start;
+        const float* ray_chunk = ray + i_start * 2;
+        const float* image_point_raw_chunk = image_point_raw + i_start * 2;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+        for (int32_t i = 0; i < chunk_num; i++) {
+            /* row_num = 1: the same pose for all points */
+            const float* Rt_inv = row_Rt_inv_table + ((row_num > 1) ? ClampRow(image_point_raw_chunk[i * 2 + 1], row_num) * 12 : 0);
+            const float u = ray_chunk[i * 2 + 0];
+            const float v = ray_chunk[i * 2 + 1];
+            dx[i] = Rt_inv[0] * u + Rt_inv[1] * v + Rt_inv[2];
+            dy[i] = Rt_inv[4] * u + Rt_inv[5] * v + Rt_inv[6];
+            dz[i] = Rt_inv[8] * u + Rt_inv[9] * v + Rt_inv[10];
+            cx[i] = Rt_inv[3];
+            cy[i] = Rt_inv[7];
+            cz[i] = Rt_inv[11];
+            s_nearest[i] = kMaxRayLength;
+            index_nearest[i] = -1;
+        }
+
+        for (int32_t p = 0; p < plane_num; p++) {
+            const float nx = plane[p * 4 + 0];
+            const float ny = plane[p * 4 + 1];
+            const float nz = plane[p * 4 + 2];
+            const float nd = plane[p * 4 + 3];
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+            for (int32_t i = 0; i < chunk_num; i++) {
+                const float s = -(nx * cx[i] + ny * cy[i] + nz * cz[i] + nd) / (nx * dx[i] + ny * dy[i] + nz * dz[i]);
+                /* s <= 0: behind the camera, NaN / inf: parallel to the plane */
+                const bool is_nearer = (s > 0) && (s < s_nearest[i]);
+                s_nearest[i] = is_nearer ? s : s_nearest[i];
+                index_nearest[i] = is_nearer ? p : index_nearest[i];
+            }
+        }
+
+        float* object_point_chunk = object_point + i_start * 3;
+        int32_t* plane_index_chunk = plane_index + i_start;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+        for (int32_t i = 0; i < chunk_num; i++) {
+            const bool is_hit = index_nearest[i] >= 0;
+            object_point_chunk[i * 3 + 0] = is_hit ? cx[i] + s_nearest[i] * dx[i] : kNoIntersection;
+            object_point_chunk[i * 3 + 1] = is_hit ? cy[i] + s_nearest[i] * dy[i] : kNoIntersection;
+            object_point_chunk[i * 3 + 2] = is_hit ? cz[i] + s_nearest[i] * dz[i] : kNoIntersection;
+            plane_index_chunk[i] = index_nearest[i];
+        }
+    }
+}
+
+static void MakeUnifiedUndistortMapRow(const SimdKernel::UnifiedProjectionParam& param, int32_t y, int32_t width, float* mapx, float* mapy)
+{
+    /* reference: https://github.com/alexvbogdan/DeepCalib/blob/master/undistortion/undistSphIm.m */
+    const float f_undist_inv = 1.0f / param.f_undist;
+    const float Y_Cam = (y - param.v0_undist) * f_undist_inv;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+    for (int32_t x = 0; x < width; x++) {
+        /* Point on the undistorted image plane (Z = 1) -> point on the unit sphere -> point on the distorted image */
+        const float X_Cam = (x - param.u0_undist) * f_undist_inv;
+        const float alpha = 1.0f / sqrtf(X_Cam * X_Cam + Y_Cam * Y_Cam + 1.0f);
+        const float X_Sph = X_Cam * alpha;
+        const float Y_Sph = Y_Cam * alpha;
+        const float Z_Sph = alpha;
+        const float den = param.xi * sqrtf(X_Sph * X_Sph + Y_Sph * Y_Sph + Z_Sph * Z_Sph) + Z_Sph;
+        const float den_inv = 1.0f / den;
+        mapx[x] = X_Sph * param.f_dist * den_inv + param.u0_dist;
+        mapy[x] = Y_Sph * param.f_dist * den_inv + param.v0_dist;
+    }
+}
+
+static void ConvertImageToBlob(const uint8_t* src, int32_t src_step, int32_t width, int32_t height, const float scale[3], const float bias[3], bool is_swap_rb, float* dst)
+{
+    const int32_t plane_size = width * height;
+    const int32_t c_src0 = is_swap_rb ? 2 : 0;
+    const int32_t c_src2 = is_swap_rb ? 0 : 2;
+    const float scale0 = scale[0], scale1 = scale[1], scale2 = scale[2];
+    const float bias0 = bias[0], bias1 = bias[1], bias2 = bias[2];
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t* src_row = src + static_cast<int64_t>(y) * src_step;
+        float* dst0 = dst + y * width;
+        float* dst1 = dst0 + plane_size;
+        float* dst2 = dst1 + plane_size;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd
+#endif
+        for (int32_t x = 0; x < width; x++) {
+            dst0[x] = src_row[x * 3 + c_src0] * scale0 + bias0;
+            dst1[x] = src_row[x * 3 + 1] * scale1 + bias1;
+            dst2[x] = src_row[x * 3 + c_src2] * scale2 + bias2;
+        }
+    }
+}
+
+/* IEEE 754 binary16, round to nearest even (the same result as F16C) */
+static inline uint16_t FloatToHalf(float value)
+{
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7FFFFFFF;
+    uint32_t h;
+    if (x >= 0x7F800000) {
+        h = (x > 0x7F800000) ? (0x7E00 | ((x & 0x7FFFFF) >> 13)) : 0x7C00;  /* NaN (quiet, payload kept), Inf */
+    } else if (x >= 0x477FF000) {
+        h = 0x7C00;                                 /* >= 65520: overflow to Inf */
+    } else if (x < 0x38800000) {
+        /* subnormal half (< 2^-14): value / 2^-24 */
+        if (x < 0x33000000) {
+            h = 0;                                  /* <= 2^-25: zero */
+        } else {
+            const uint32_t shift = 126 - (x >> 23);
+            const uint32_t m = (x & 0x7FFFFF) | 0x800000;
+            const uint32_t rem = m & ((1u << shift) - 1);
+            const uint32_t half = 1u << (shift - 1);
+            h = m >> shift;
+            if (rem > half || (rem == half && (h & 1))) h++;
+        }
+    } else {
+        /* normal. Carry of the rounding goes into the exponent */
+        const uint32_t rem = x & 0x1FFF;
+        h = (x - 0x38000000) >> 13;
+        if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+    }
+    return static_cast<uint16_t>(sign | h);
+}
+
+static inline float HalfToFloat(uint16_t h)
+{
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    const uint32_t e = (h >> 10) & 0x1F;
+    const uint32_t m = h & 0x3FF;
+    uint32_t x;
+    if (e == 0) {
+        const float value = m * (1.0f / 16777216.0f);   /* subnormal: m * 2^-24 */
+        memcpy(&x, &value, sizeof(x));
+        x |= sign;
+    } else if (e == 31) {
+        x = sign | 0x7F800000 | (m << 13) | (m ? 0x400000 : 0);  /* Inf, NaN (quiet) */
+    } else {
+        x = sign | ((e + 112) << 23) | (m << 13);
+    }
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+static void ConvertFloatToHalf(const float* src, uint16_t* dst, int32_t num)
+{
+    int32_t i = 0;
+#ifdef SIMD_KERNEL_F16C
+    for (; i + 8 <= num; i += 8) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < num; i++) dst[i] = FloatToHalf(src[i]);
+}
+
+static void ConvertHalfToFloat(const uint16_t* src, float* dst, int32_t num)
+{
+    int32_t i = 0;
+#ifdef SIMD_KERNEL_F16C
+    for (; i + 8 <= num; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+    }
+#endif
+    for (; i < num; i++) dst[i] = HalfToFloat(src[i]);
+}
+
+static void CalculateMoments(const float* point, int32_t num, double moment[SimdKernel::kMomentNum])
+{
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xxx = 0, sum_xxxx = 0, sum_xy = 0, sum_xxy = 0;
+#ifdef SIMD_KERNEL_OMP_SIMD
+#pragma omp simd reduction(+:sum_x, sum_y, sum_xx, sum_xxx, sum_xxxx, sum_xy, sum_xxy)
+#endif
+    for (int32_t i = 0; i < num; i++) {
+        const double x = point[i * 2 + 0];
+        const double y = point[i * 2 + 1];
+        const double xx = x * x;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += xx;
+        sum_xxx += xx * x;
+        sum_xxxx += xx * xx;
+        sum_xy += x * y;
+        sum_xxy += xx * y;
+    }
+    moment[SimdKernel::kMomentX] = sum_x;
+    moment[SimdKernel::kMomentY] = sum_y;
+    moment[SimdKernel::kMomentXX] = sum_xx;
+    moment[SimdKernel::kMomentXXX] = sum_xxx;
+    moment[SimdKernel::kMomentXXXX] = sum_xxxx;
+    moment[SimdKernel::kMomentXY] = sum_xy;
+    moment[SimdKernel::kMomentXXY] = sum_xxy;
+}
+
+void GetTable(SimdKernel::Table& table)
+{
+    table.ProjectPoints = ProjectPoints;
+    table.ProjectPointsRollingShutter = ProjectPointsRollingShutter;
+    table.TransformPoints = TransformPoints;
+    table.TransformPointsSoA = TransformPointsSoA;
+    table.UnprojectPoints = UnprojectPoints;
+    table.UnprojectPointsRollingShutter = UnprojectPointsRollingShutter;
+    table.UnprojectDepthRow = UnprojectDepthRow;
+    table.IntersectPlanes = IntersectPlanes;
+    table.MakeUnifiedUndistortMapRow = MakeUnifiedUndistortMapRow;
+    table.ConvertImageToBlob = ConvertImageToBlob;
+    table.ConvertFloatToHalf = ConvertFloatToHalf;
+    table.ConvertHalfToFloat = ConvertHalfToFloat;
+    table.CalculateMoments = CalculateMoments;
+}
+
+}
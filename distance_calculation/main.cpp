@@ -20,6 +20,7 @@ limitations under the License.
 #include <cmath>
 #include <string>
 #include <vector>
+#include <chrono>
 
 #include <opencv2/opencv.hpp>
 
@@ -27,6 +28,7 @@ limitations under the License.
 #include "cvui.h"
 
 #include "camera_model.h"
+#include "result_log.h"
 
 /*** Macro ***/
 static constexpr char kInputFilename[] = RESOURCE_DIR"/dashcam_00.jpg";
@@ -36,11 +38,13 @@ static constexpr char kWindowParam[] = "WindowParam";
 static constexpr int32_t kWidth = 1280;
 static constexpr int32_t kHeight = 720;
 static constexpr float kFovDeg = 130.0f;
+static constexpr char kResultLogFilename[] = "distance_calculation_result.rlog";
 
 
 /*** Global variable ***/
 static CameraModel camera;
 static std::vector<cv::Point2f> selecting_point_list;
+static ResultLog::Writer result_log;
 
 /*** Function ***/
 void ResetCameraPose()
@@ -74,6 +78,16 @@ static void loop_main(const cv::Mat& image_org)
             snprintf(text, sizeof(text), "%.1f, %.1f[m]", object_point_list[i].x, object_point_list[i].z);
             cv::putText(image, text, image_point, cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(255, 0, 0), 2);
         }
+
+        /* Log distances when they are changed */
+        static ResultLog::FrameRecord s_record;
+        if (s_record.distance_image_point_list != selecting_point_list || s_record.distance_object_point_list != object_point_list) {
+            s_record.frame_id++;
+            s_record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            s_record.distance_image_point_list = selecting_point_list;
+            s_record.distance_object_point_list = object_point_list;
+            result_log.Write(s_record);
+        }
     } else {
         std::vector<cv::Point3f> original_object_point_list;
         for (float x = -10; x <= 10; x += 1) {
@@ -82,7 +96,7 @@ static void loop_main(const cv::Mat& image_org)
             }
         }
         std::vector<cv::Point2f> image_point_list;
-        cv::projectPoints(original_object_point_list, camera.rvec, camera.tvec, camera.K, camera.dist_coeff, image_point_list);
+        cv::projectPoints(original_object_point_list, camera.GetRvec(), camera.GetTvec(), camera.K, camera.dist_coeff, image_point_list);
         image = cv::Mat(kHeight, kWidth, CV_8UC3, cv::Scalar(70, 70, 70));
 
         /* Re-convert image point to object poitn(world) */
@@ -100,7 +114,14 @@ static void loop_main(const cv::Mat& image_org)
         }
     }
 
-    cv::line(image, cv::Point(0, camera.EstimateVanishmentY()), cv::Point(image.cols, camera.EstimateVanishmentY()), cv::Scalar(0, 0, 0), 1);
+    /* Draw the horizon (a * x + b * y + c = 0) */
+    float a, b, c;
+    camera.GetHorizonLine(a, b, c);
+    if (std::abs(b) > std::abs(a)) {
+        cv::line(image, cv::Point2f(0, -c / b), cv::Point2f(static_cast<float>(image.cols), -(a * image.cols + c) / b), cv::Scalar(0, 0, 0), 1);
+    } else if (a != 0) {
+        cv::line(image, cv::Point2f(-c / a, 0), cv::Point2f(-(b * image.rows + c) / a, static_cast<float>(image.rows)), cv::Scalar(0, 0, 0), 1);
+    }
     cvui::imshow(kWindowMain, image);
 }
 
@@ -228,6 +249,8 @@ int main(int argc, char* argv[])
 
     cv::setMouseCallback(kWindowMain, CallbackMouseMain);
 
+    result_log.Open(kResultLogFilename);
+
     cv::Mat image_org = cv::imread(kInputFilename);
     if (!image_org.empty()) {
         ResetCamera(image_org.cols, image_org.rows);
@@ -243,5 +266,6 @@ int main(int argc, char* argv[])
         TreatKeyInputMain(key);
     }
 
+    result_log.Close();
     return 0;
 }
@@ -32,32 +32,14 @@ limitations under the License.
 
 
 /*** Function ***/
-/* reference: https://github.com/opencv/opencv_zoo/blob/dev/models/face_detection_yunet/yunet.py */
-bool DepthEngine::Initialize()
+bool DepthEngine::Initialize(const Config& config)
 {
-    /*  Read Model */
-    try {
-        net_ = cv::dnn::readNetFromONNX(kModelFilename);
-    } catch (std::exception &e) {
-        printf("%s\n", e.what());
-        exit(-1);
-    }
-    
-    if (net_.empty() == true) {
-        printf("Failed to create inference engine (%s)\n", kModelFilename);
-        return false;
-    }
-
-    /*  Set backend */
-    net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-
-    /* Display model information */
-    for (const auto& layer_name : net_.getUnconnectedOutLayersNames()) {
-        printf("Output layer: %s\n", layer_name.c_str());
-    }
+    return InitializeEngine(kModelFilename, { "797" }, config);
+}
 
-    return true;
+bool DepthEngine::Initialize(const std::vector<uchar>& model_buffer, const Config& config)
+{
+    return InitializeEngine(model_buffer, { "797" }, config);
 }
 
 bool DepthEngine::Finalize()
@@ -67,18 +49,13 @@ bool DepthEngine::Finalize()
 
 bool DepthEngine::Process(const cv::Mat& image_input, cv::Mat& mat_depth)
 {
-    /* PreProcess */
-    cv::Mat blob_input;
-    PreProcess(image_input, blob_input);
-
-    /* Inference */
-    std::vector<cv::Mat> output_mat_list;
-    Inference(blob_input, { "797" }, output_mat_list);
+    /* PreProcess + Inference */
+    if (!RunInference(image_input)) return false;
 
     /* Post Process */
     /* Inverse relative depth (Far = small Value, Near = huge value) */
-    mat_depth = cv::Mat(kModelInputHeight, kModelInputWidth, CV_32FC1, output_mat_list[0].data);
-    mat_depth = mat_depth.clone();  /* I need to clone it because output_mat_list is destroyed */
+    /* Copy because the output is overwritten at the next call (mat_depth's buffer is re-used if it has the same size) */
+    cv::Mat(kModelInputHeight, kModelInputWidth, CV_32FC1, output_mat_list_[0].data).copyTo(mat_depth);
 
     return true;
 }
@@ -115,29 +92,106 @@ bool DepthEngine::NormalizeScaleShift(const cv::Mat& mat_depth, cv::Mat& mat_dep
     return true;
 }
 
-void DepthEngine::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
+bool DepthEngine::FitScaleShift(const cv::Mat& mat_depth, const cv::Size& image_size, const std::vector<cv::Point2f>& image_point_list, const std::vector<float>& depth_list, float& scale, float& shift)
 {
-    cv::Mat image_normalize;
-    cv::resize(image_input, image_normalize, cv::Size(kModelInputWidth, kModelInputHeight));
-    cv::cvtColor(image_normalize, image_normalize, cv::COLOR_BGR2RGB);
-    image_normalize.convertTo(image_normalize, CV_32FC3, 1.0 / 255.0);
-    cv::subtract(image_normalize, cv::Scalar(cv::Vec<float, 3>(kMeanList[0], kMeanList[1], kMeanList[2])), image_normalize);
-    cv::divide(image_normalize, cv::Scalar(cv::Vec<float, 3>(kNormList[0], kNormList[1], kNormList[2])), image_normalize);
-
-    /*
-    const std::vector<int> sizes = { 1, image_normalize.rows, image_normalize.cols, image_normalize.channels() };
-    cv::Mat mat(sizes, CV_32F, image_normalize.data);
-    blob_input = mat.clone();
-    printf(" % d, \n", mat.size().width);
-    */
-
-    /* NHWC(image) -> NCHW */
-    blob_input = cv::dnn::blobFromImage(image_normalize);
+    /***
+    * Fit Estimated Depth(inverse relative depth) to the known metric depth of some pixels (e.g. ground plane)
+    *   1 / depth = value * scale + shift   (the same model as NormalizeScaleShift)
+    * Robust least squares (IRLS) so that pixels which are not on the reference (e.g. objects on the ground) are ignored
+    *   Huber weight for the first iterations to get a stable start, then Tukey's biweight to reject the outliers completely
+    * image_point_list: position in the input image (image_size), depth_list: metric depth (<= 0: unknown)
+    ***/
+    static constexpr int32_t kIterationNum = 8;
+    static constexpr int32_t kHuberIterationNum = 2;
+    static constexpr double kHuberK = 1.345;
+    static constexpr double kTukeyC = 4.685;
+    static constexpr int32_t kMinPointNum = 16;
+    if (image_point_list.size() != depth_list.size() || image_size.width <= 0 || image_size.height <= 0) {
+        printf("[FitScaleShift] invalid size\n");
+        return false;
+    }
+
+    const float ratio_x = static_cast<float>(mat_depth.cols) / image_size.width;
+    const float ratio_y = static_cast<float>(mat_depth.rows) / image_size.height;
+    std::vector<double> x_list;
+    std::vector<double> y_list;
+    x_list.reserve(image_point_list.size());
+    y_list.reserve(image_point_list.size());
+    for (size_t i = 0; i < image_point_list.size(); i++) {
+        if (depth_list[i] <= 0) continue;
+        const int32_t x = static_cast<int32_t>(image_point_list[i].x * ratio_x);
+        const int32_t y = static_cast<int32_t>(image_point_list[i].y * ratio_y);
+        if (x < 0 || x >= mat_depth.cols || y < 0 || y >= mat_depth.rows) continue;
+        x_list.push_back(mat_depth.at<float>(y, x));
+        y_list.push_back(1.0 / depth_list[i]);
+    }
+    const size_t num = x_list.size();
+    if (num < static_cast<size_t>(kMinPointNum)) {
+        printf("[FitScaleShift] not enough points (%zu)\n", num);
+        return false;
+    }
 
+    std::vector<double> weight_list(num, 1.0);
+    std::vector<double> residual_list(num);
+    double a = 0;
+    double b = 0;
+    for (int32_t iteration = 0; iteration < kIterationNum; iteration++) {
+        /* Weighted least squares */
+        double sum_w = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+        for (size_t i = 0; i < num; i++) {
+            const double w = weight_list[i];
+            sum_w += w;
+            sum_x += w * x_list[i];
+            sum_y += w * y_list[i];
+            sum_xx += w * x_list[i] * x_list[i];
+            sum_xy += w * x_list[i] * y_list[i];
+        }
+        const double det = sum_w * sum_xx - sum_x * sum_x;
+        if (det <= 0) {
+            printf("[FitScaleShift] degenerate\n");
+            return false;
+        }
+        a = (sum_w * sum_xy - sum_x * sum_y) / det;
+        b = (sum_y - a * sum_x) / sum_w;
+
+        /* Update weight. sigma is estimated by MAD */
+        for (size_t i = 0; i < num; i++) residual_list[i] = std::abs(y_list[i] - (a * x_list[i] + b));
+        std::vector<double> residual_sorted = residual_list;
+        std::nth_element(residual_sorted.begin(), residual_sorted.begin() + num / 2, residual_sorted.end());
+        const double sigma = 1.4826 * residual_sorted[num / 2];
+        if (sigma <= 0) break;
+        if (iteration < kHuberIterationNum) {
+            const double threshold = kHuberK * sigma;
+            for (size_t i = 0; i < num; i++) {
+                weight_list[i] = (residual_list[i] <= threshold) ? 1.0 : threshold / residual_list[i];
+            }
+        } else {
+            const double threshold = kTukeyC * sigma;
+            for (size_t i = 0; i < num; i++) {
+                const double u = residual_list[i] / threshold;
+                weight_list[i] = (u < 1.0) ? (1.0 - u * u) * (1.0 - u * u) : 0.0;
+            }
+        }
+    }
+
+    /* Larger value = nearer. Otherwise, the reference is not consistent with the estimation */
+    if (a <= 0) {
+        printf("[FitScaleShift] invalid scale (%f)\n", a);
+        return false;
+    }
+    scale = static_cast<float>(a);
+    shift = static_cast<float>(b);
+    return true;
 }
 
-void DepthEngine::Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list)
+bool DepthEngine::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
 {
-    net_.setInput(blob_input);
-    net_.forward(output_mat_list, output_name_list);
+    /* BGR(CV_8UC3) -> RGB, (x / 255 - mean) / norm and NHWC(image) -> NCHW in one pass */
+    float scale[3];
+    float bias[3];
+    for (int32_t c = 0; c < 3; c++) {
+        scale[c] = 1.0f / (255.0f * kNormList[c]);
+        bias[c] = -kMeanList[c] / kNormList[c];
+    }
+    return ConvertImageToBlob(image_input, cv::Size(kModelInputWidth, kModelInputHeight), scale, bias, true, blob_input);
 }
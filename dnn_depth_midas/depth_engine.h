@@ -23,8 +23,9 @@ limitations under the License.
 
 #include <opencv2/opencv.hpp>
 
+#include "inference_engine.h"
 
-class DepthEngine
+class DepthEngine : public InferenceEngine
 {
 public:
     typedef std::array<cv::Point, 5> Landmark;
@@ -39,19 +40,16 @@ private:
 public:
     DepthEngine() {}
     ~DepthEngine() {}
-    bool Initialize();
+    bool Initialize(const Config& config = Config());
+    bool Initialize(const std::vector<uchar>& model_buffer, const Config& config = Config());    /* to share the weights read once among instances */
     bool Finalize();
     bool Process(const cv::Mat& image_input, cv::Mat& mat_depth);
     bool NormalizeMinMax(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized);
     bool NormalizeScaleShift(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized, float scale, float shift);
+    bool FitScaleShift(const cv::Mat& mat_depth, const cv::Size& image_size, const std::vector<cv::Point2f>& image_point_list, const std::vector<float>& depth_list, float& scale, float& shift);
 
 private:
-    void PreProcess(const cv::Mat& image_input, cv::Mat& blob_input);
-    void Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list);
-
-private:
-    cv::dnn::Net net_;
-
+    bool PreProcess(const cv::Mat& image_input, cv::Mat& blob_input) override;
 };
 
 #endif
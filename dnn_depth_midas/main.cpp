@@ -31,9 +31,12 @@ limitations under the License.
 
 #include "common_helper_cv.h"
 #include "depth_engine.h"
+#include "shm_channel.h"
 
 /*** Macro ***/
 static constexpr char kInputImageFilename[] = RESOURCE_DIR"/parrot.jpg";
+static constexpr uint32_t kShmSlotNum = 4;
+static constexpr uint32_t kShmSlotSize = 1024 * 1024 * 4;
 
 
 /*** Global variable ***/
@@ -48,6 +51,12 @@ int main(int argc, char *argv[])
     DepthEngine depth_engine;
     depth_engine.Initialize();
 
+    /* Publish depth maps to other processes */
+    ShmChannel::Writer shm_writer;
+    if (!shm_writer.Create(ShmChannel::kNameDepthMap, kShmSlotNum, kShmSlotSize)) {
+        printf("Depth map is not published\n");
+    }
+
     /* Find source image */
     std::string input_name = (argc > 1) ? argv[1] : kInputImageFilename;
     cv::VideoCapture cap;   /* if cap is not opened, src is still image */
@@ -71,7 +80,9 @@ int main(int argc, char *argv[])
 
         /* Estimate depth */
         cv::Mat mat_depth;
+        int64_t timestamp_ns = ShmChannel::GetTimestampNs();
         depth_engine.Process(image_input, mat_depth);
+        shm_writer.PublishDepthMap(mat_depth, timestamp_ns);
 
         /* Draw Depth */
         cv::Mat mat_depth_normlized255;
@@ -33,25 +33,14 @@ limitations under the License.
 
 /*** Function ***/
 /* reference: https://github.com/opencv/opencv_zoo/blob/dev/models/face_detection_yunet/yunet.py */
-bool FaceDetection::Initialize(const std::string& model_filename)
+bool FaceDetection::Initialize(const std::string& model_filename, const Config& config)
 {
-    /*  Read Model */
-    net_ = cv::dnn::readNetFromONNX(model_filename);
-    if (net_.empty() == true) {
-        printf("Failed to create inference engine (%s)\n", model_filename.c_str());
-        return false;
-    }
-
-    /*  Set backend */
-    net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-
-    /* Display model information */
-    for (const auto& layer_name : net_.getUnconnectedOutLayersNames()) {
-        printf("Output layer: %s\n", layer_name.c_str());
-    }
+    return InitializeEngine(model_filename, { "loc", "conf", "iou" }, config);
+}
 
-    return true;
+bool FaceDetection::Initialize(const std::vector<uchar>& model_buffer, const Config& config)
+{
+    return InitializeEngine(model_buffer, { "loc", "conf", "iou" }, config);
 }
 
 bool FaceDetection::Finalize()
@@ -61,24 +50,26 @@ bool FaceDetection::Finalize()
 
 bool FaceDetection::Process(const cv::Mat& image_input, std::vector<cv::Rect>& bbox_list, std::vector<Landmark>& landmark_list)
 {
-    /* Initialize for image size */
-    if (prior_list_.empty() || model_input_size_.width == 0) {
-        model_input_size_.width = kModelInputWidth;
-        model_input_size_.height = kModelInputWidth * image_input.rows / image_input.cols;
-        model_input_size_.height = (model_input_size_.height / 32) * 32;    /* just in case */
-        GeneratePriors(model_input_size_);
+    if (image_input.empty()) {
+        printf("[FaceDetection::Process] empty input\n");
+        return false;
     }
 
-    /* PreProcess */
-    cv::Mat blob_input;
-    PreProcess(image_input, blob_input);
+    /* Initialize for image size (re-generate priors when the model input size or the aspect ratio is changed) */
+    cv::Size model_input_size;
+    model_input_size.width = model_input_width_;
+    model_input_size.height = model_input_width_ * image_input.rows / image_input.cols;
+    model_input_size.height = (std::max)(32, (model_input_size.height / 32) * 32);    /* just in case */
+    if (prior_list_.empty() || model_input_size != model_input_size_) {
+        model_input_size_ = model_input_size;
+        GeneratePriors(model_input_size_);
+    }
 
-    /* Inference */
-    std::vector<cv::Mat> output_mat_list;
-    Inference(blob_input, { "loc", "conf", "iou" }, output_mat_list);
+    /* PreProcess + Inference */
+    if (!RunInference(image_input)) return false;
 
     /* Post Process */
-    PostProcess(output_mat_list[0], output_mat_list[1], output_mat_list[2], image_input.size(), bbox_list, landmark_list);
+    PostProcess(output_mat_list_[0], output_mat_list_[1], output_mat_list_[2], image_input.size(), bbox_list, landmark_list);
 
     return true;
 }
@@ -112,16 +103,12 @@ void FaceDetection::GeneratePriors(const cv::Size& model_input_size)
     }
 }
 
-void FaceDetection::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
-{
-    cv::resize(image_input, blob_input, model_input_size_);
-    blob_input = cv::dnn::blobFromImage(blob_input);
-}
-
-void FaceDetection::Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list)
+bool FaceDetection::PreProcess(const cv::Mat& image_input, cv::Mat& blob_input)
 {
-    net_.setInput(blob_input);
-    net_.forward(output_mat_list, output_name_list);
+    /* NHWC(image, CV_8UC3) -> NCHW without scaling */
+    static const float kScale[3] = { 1.0f, 1.0f, 1.0f };
+    static const float kBias[3] = { 0.0f, 0.0f, 0.0f };
+    return ConvertImageToBlob(image_input, model_input_size_, kScale, kBias, false, blob_input);
 }
 
 void FaceDetection::PostProcess(const cv::Mat& mat_loc, const cv::Mat& mat_conf, const cv::Mat& mat_iou, const cv::Size image_size, std::vector<cv::Rect>& bbox_list, std::vector<Landmark>& landmark_list)
@@ -20,11 +20,13 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include <array>
+#include <algorithm>
 
 #include <opencv2/opencv.hpp>
 
+#include "inference_engine.h"
 
-class FaceDetection
+class FaceDetection : public InferenceEngine
 {
 public:
     typedef std::array<cv::Point, 5> Landmark;
@@ -38,20 +40,22 @@ private:
     const std::vector<int32_t> step_list = { 8, 16, 32, 64 };
 
 public:
-    FaceDetection() {}
+    FaceDetection() : model_input_width_(kModelInputWidth) {}
     ~FaceDetection() {}
-    bool Initialize(const std::string& model_filename);
+    bool Initialize(const std::string& model_filename, const Config& config = Config());
+    bool Initialize(const std::vector<uchar>& model_buffer, const Config& config = Config());    /* to share the weights read once among instances */
     bool Finalize();
     bool Process(const cv::Mat& image_input, std::vector<cv::Rect>& bbox_list, std::vector<Landmark>& landmark_list);
+    void SetModelInputWidth(int32_t width) { model_input_width_ = (std::max)(32, (width / 32) * 32); }     /* smaller = faster but less accurate */
+    int32_t GetDefaultModelInputWidth() const { return kModelInputWidth; }
 
 private:
     void GeneratePriors(const cv::Size& model_input_size);
-    void PreProcess(const cv::Mat& image_input, cv::Mat& blob_input);
-    void Inference(const cv::Mat& blob_input, const std::vector<cv::String> output_name_list, std::vector<cv::Mat>& output_mat_list);
+    bool PreProcess(const cv::Mat& image_input, cv::Mat& blob_input) override;
     void PostProcess(const cv::Mat& mat_loc, const cv::Mat& mat_conf, const cv::Mat& mat_iou, const cv::Size image_size, std::vector<cv::Rect>& bbox_list, std::vector<Landmark>& landmark_list);
 
 private:
-    cv::dnn::Net net_;
+    int32_t model_input_width_;
     cv::Size model_input_size_;
     std::vector<std::vector<float>> prior_list_;
 };
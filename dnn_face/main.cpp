@@ -23,24 +23,36 @@ limitations under the License.
 #include <array>
 #include <numeric>
 #include <algorithm>
+#include <chrono>
 
 #include <opencv2/opencv.hpp>
 
 #include "common_helper_cv.h"
 #include "face_detection.h"
 #include "camera_model.h"
+#include "instrumentation.h"
+#include "frame_scheduler.h"
+#include "shm_channel.h"
+#include "result_log.h"
+#include "overlay_3d.h"
 
 /*** Macro ***/
 static constexpr char kInputImageFilename[] = RESOURCE_DIR"/lena.jpg";
 static constexpr char kModelFilename[] = RESOURCE_DIR"/model/face_detection_yunet.onnx";
 static constexpr float kFovDeg = 60.0f;
+static constexpr double kTargetLatencyMs = 50.0;
+static constexpr char kResultLogFilename[] = "dnn_face_result.rlog";
+static constexpr uint32_t kShmSlotNum = 8;
+static constexpr uint32_t kShmSlotSize = 256 * sizeof(ShmChannel::FaceRecord);
+static constexpr float kRoiMarginScale = 2.0f;      /* search area around the previous face in RoiOnly / Track mode */
+static constexpr float kHeadAxisLength = 500.0f;    /* the same unit as the face model */
 
 /*** Global variable ***/
 static CameraModel camera;
 
 
 /*** Function ***/
-void EstimateHeadPose(cv::Mat& image, const FaceDetection::Landmark& landmark)
+void EstimateHeadPose(cv::Mat& image, const FaceDetection::Landmark& landmark, cv::Vec3f& rvec_head, cv::Vec3f& tvec_head)
 {
     /* reference: https://qiita.com/TaroYamada/items/e3f3d0ea4ecc0a832fac */
     /* reference: https://github.com/spmallick/learnopencv/blob/master/HeadPose/headPose.cpp */
@@ -74,14 +86,11 @@ void EstimateHeadPose(cv::Mat& image, const FaceDetection::Landmark& landmark)
     cv::Mat rvec = cv::Mat_<float>(3, 1);
     cv::Mat tvec = cv::Mat_<float>(3, 1);
     cv::solvePnP(face_object_point_for_pnp_list, face_image_point_list, camera.K, camera.dist_coeff, rvec, tvec, false, cv::SOLVEPNP_ITERATIVE);
+    rvec_head = cv::Vec3f(rvec.at<float>(0), rvec.at<float>(1), rvec.at<float>(2));
+    tvec_head = cv::Vec3f(tvec.at<float>(0), tvec.at<float>(1), tvec.at<float>(2));
     char text[128];
     snprintf(text, sizeof(text), "Pitch = %-+4.0f, Yaw = %-+4.0f, Roll = %-+4.0f", Rad2Deg(rvec.at<float>(0, 0)), Rad2Deg(rvec.at<float>(1, 0)), Rad2Deg(rvec.at<float>(2, 0)));
     CommonHelper::DrawText(image, text, cv::Point(10, 10), 0.7, 3, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255), false);
-    
-    std::vector<cv::Point3f> nose_end_point3D = { { 0.0f, 0.0f, 500.0f } };
-    std::vector<cv::Point2f> nose_end_point2D;
-    cv::projectPoints(nose_end_point3D, rvec, tvec, camera.K, camera.dist_coeff, nose_end_point2D);
-    cv::arrowedLine(image, face_image_point_list[0], nose_end_point2D[0], cv::Scalar(0, 255, 0), 5);
 
     /* Calculate Euler Angle */
     cv::Mat R;
@@ -130,7 +139,7 @@ void EstimateHeadPose(cv::Mat& image, const FaceDetection::Landmark& landmark)
     CameraModel::RotateObject(Rad2Deg(rvec.ptr<float>()[0]), Rad2Deg(rvec.ptr<float>()[1]), Rad2Deg(rvec.ptr<float>()[2]), object_point_list);
 
     std::vector<cv::Point2f> image_point_list;
-    cv::projectPoints(object_point_list, camera.rvec, tvec, camera.K, camera.dist_coeff, image_point_list);
+    cv::projectPoints(object_point_list, camera.GetRvec(), tvec, camera.K, camera.dist_coeff, image_point_list);
 
     cv::Point2f pts1[] = { cv::Point2f(0, 0), cv::Point2f(image_icon.cols - 1.0f, 0) , cv::Point2f(image_icon.cols - 1.0f, image_icon.rows - 1.0f) , cv::Point2f(0, image_icon.rows - 1.0f) };
     cv::Mat mat_affine = cv::getPerspectiveTransform(pts1, &image_point_list[0]);
@@ -145,6 +154,63 @@ void EstimateHeadPose(cv::Mat& image, const FaceDetection::Landmark& landmark)
 #endif
 }
 
+/* Detect faces only in the area around the previous faces. The area keeps the aspect ratio of the image so that priors are re-used */
+static cv::Rect CalculateSearchArea(const cv::Size& image_size, const std::vector<cv::Rect>& bbox_list)
+{
+    cv::Rect area = bbox_list[0];
+    for (const auto& bbox : bbox_list) area |= bbox;
+    float cx = area.x + area.width / 2.0f;
+    float cy = area.y + area.height / 2.0f;
+    float w = area.width * kRoiMarginScale;
+    float h = area.height * kRoiMarginScale;
+    float aspect = static_cast<float>(image_size.width) / image_size.height;
+    if (w / h > aspect) {
+        h = w / aspect;
+    } else {
+        w = h * aspect;
+    }
+    area = cv::Rect(static_cast<int32_t>(cx - w / 2), static_cast<int32_t>(cy - h / 2), static_cast<int32_t>(w), static_cast<int32_t>(h));
+    return area & cv::Rect(0, 0, image_size.width, image_size.height);
+}
+
+static void DetectInRoi(FaceDetection& face_detection, const cv::Mat& image, std::vector<cv::Rect>& bbox_list, std::vector<FaceDetection::Landmark>& landmark_list)
+{
+    cv::Rect area = CalculateSearchArea(image.size(), bbox_list);
+    if (area.width <= 0 || area.height <= 0) {
+        /* the previous faces are at or outside the border. Detect in the whole image */
+        face_detection.Process(image, bbox_list, landmark_list);
+        return;
+    }
+    face_detection.Process(image(area), bbox_list, landmark_list);
+    for (auto& bbox : bbox_list) {
+        bbox.x += area.x;
+        bbox.y += area.y;
+    }
+    for (auto& landmark : landmark_list) {
+        for (auto& p : landmark) p += area.tl();
+    }
+}
+
+/* Track the previous faces by template matching instead of detection */
+static void TrackFaces(const cv::Mat& image_previous, const cv::Mat& image, std::vector<cv::Rect>& bbox_list, std::vector<FaceDetection::Landmark>& landmark_list)
+{
+    const cv::Rect image_area(0, 0, image.cols, image.rows);
+    for (int32_t i = 0; i < static_cast<int32_t>(bbox_list.size()); i++) {
+        cv::Rect bbox = bbox_list[i] & image_area;
+        if (bbox.width < 4 || bbox.height < 4) continue;
+        cv::Rect search_area(bbox.x - bbox.width / 2, bbox.y - bbox.height / 2, bbox.width * 2, bbox.height * 2);
+        search_area &= image_area;
+        cv::Mat result;
+        cv::matchTemplate(image(search_area), image_previous(bbox), result, cv::TM_CCOEFF_NORMED);
+        cv::Point max_loc;
+        cv::minMaxLoc(result, nullptr, nullptr, nullptr, &max_loc);
+        cv::Point offset = search_area.tl() + max_loc - bbox.tl();
+        bbox_list[i].x += offset.x;
+        bbox_list[i].y += offset.y;
+        for (auto& p : landmark_list[i]) p += offset;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     /* Initialize Model */
@@ -158,6 +224,30 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    /* Publish detection results to other processes */
+    ShmChannel::Writer shm_writer;
+    if (!shm_writer.Create(ShmChannel::kNameFaceDetection, kShmSlotNum, kShmSlotSize)) {
+        printf("Detection result is not published\n");
+    }
+
+    /* Log results of all frames for offline analytics */
+    ResultLog::Writer result_log;
+    result_log.Open(kResultLogFilename);
+    ResultLog::FrameRecord record;
+
+    /* Head pose axes of all faces are projected and drawn at once */
+    Overlay3D overlay;
+
+    /* Scheduler to keep the end-to-end latency under the target */
+    FrameScheduler scheduler(kTargetLatencyMs, &Instrumentation::Global());
+    const bool is_video_file = cap.isOpened() && cap.get(cv::CAP_PROP_FRAME_COUNT) > 0;
+    const double frame_interval_ms = (is_video_file && cap.get(cv::CAP_PROP_FPS) > 0) ? 1000.0 / cap.get(cv::CAP_PROP_FPS) : 0;
+    FrameScheduler::Clock::time_point time_start;
+    bool is_initialized = false;
+    cv::Mat image_previous;
+    std::vector<cv::Rect> bbox_list;
+    std::vector<FaceDetection::Landmark> landmark_list;
+
     /* Process for each frame */
     int32_t frame_cnt = 0;
     for (frame_cnt = 0; cap.isOpened() || frame_cnt < 1; frame_cnt++) {
@@ -170,18 +260,36 @@ int main(int argc, char *argv[])
         }
         if (image_input.empty()) break;
 
-        if (frame_cnt == 0) {
+        /* Initialize with the first frame, before the scheduler may skip it */
+        if (!is_initialized) {
             camera.SetIntrinsic(image_input.cols, image_input.rows, FocalLength(image_input.cols, kFovDeg));
             camera.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
             camera.SetExtrinsic(
                 { 0.0f, 0.0f, 0.0f },    /* rvec [deg] */
                 { 0.0f, 0.0f, 0.0f }, true);   /* tvec (in world coordinate) */
+            time_start = FrameScheduler::Clock::now();  /* after the first decode, so that its time doesn't count as latency */
+            is_initialized = true;
         }
 
+        /* Video file is treated as a live source: the frame is captured at its timestamp */
+        auto time_capture = FrameScheduler::Clock::now();
+        if (frame_interval_ms > 0) {
+            time_capture = time_start + std::chrono::microseconds(static_cast<int64_t>(frame_cnt * frame_interval_ms * 1000));
+        }
+        FrameScheduler::Decision decision = scheduler.BeginFrame(time_capture);
+        if (decision.is_skip) continue;
+
         /* Detect face */
-        std::vector<cv::Rect> bbox_list;
-        std::vector<FaceDetection::Landmark> landmark_list;
-        face_detection.Process(image_input, bbox_list, landmark_list);
+        face_detection.SetModelInputWidth(face_detection.GetDefaultModelInputWidth() * decision.model_input_scale_percent / 100);
+        if (decision.is_full_detection || bbox_list.empty() || image_previous.empty()) {
+            face_detection.Process(image_input, bbox_list, landmark_list);
+        } else if (decision.mode == FrameScheduler::kModeRoiOnly) {
+            DetectInRoi(face_detection, image_input, bbox_list, landmark_list);
+        } else {
+            TrackFaces(image_previous, image_input, bbox_list, landmark_list);
+        }
+        image_previous = image_input.clone();
+        shm_writer.PublishFaceDetection(bbox_list, landmark_list);
 
         /* Draw Result */
         for (int32_t i = 0; i < static_cast<int32_t>(bbox_list.size()); i++) {
@@ -196,15 +304,40 @@ int main(int argc, char *argv[])
         }
 
         /* Draw HeadPose */
+        record.Clear();
+        record.rvec_list.resize(landmark_list.size());
+        record.tvec_list.resize(landmark_list.size());
+        overlay.Clear();
         for (int32_t i = 0; i < static_cast<int32_t>(landmark_list.size()); i++) {
-            EstimateHeadPose(image_input, landmark_list[i]);
+            EstimateHeadPose(image_input, landmark_list[i], record.rvec_list[i], record.tvec_list[i]);
+            const cv::Vec3f& r = record.rvec_list[i];
+            const cv::Vec3f& t = record.tvec_list[i];
+            overlay.AddAxes(Pose(Quaternion::FromRotationVector(r[0], r[1], r[2]), cv::Point3f(t[0], t[1], t[2])), kHeadAxisLength);
         }
+        overlay.Project(camera);
+        overlay.Draw(image_input, 5);
+        record.frame_id = frame_cnt;
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time_capture - time_start).count();
+        record.bbox_list = bbox_list;
+        record.landmark_list = landmark_list;
+        result_log.Write(record);
+
+        scheduler.EndFrame();
+        char text[64];
+        snprintf(text, sizeof(text), "Mode = %s, Latency = %.1f [ms]", FrameScheduler::GetModeName(decision.mode), scheduler.GetLatencyMs());
+        CommonHelper::DrawText(image_input, text, cv::Point(10, image_input.rows - 30), 0.7, 3, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255), false);
 
         cv::imshow("Result", image_input);
         int32_t key = cv::waitKey(1);
         if (key == 'q') break;
     }
 
+    for (const auto& event : Instrumentation::Global().GetEventList()) {
+        printf("[%9.1f ms] %s: %s\n", event.time_ms, event.name.c_str(), event.detail.c_str());
+    }
+    Instrumentation::Global().Print();
+
+    result_log.Close();
     face_detection.Finalize();
     cv::waitKey(-1);
 
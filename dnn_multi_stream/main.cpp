@@ -0,0 +1,168 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "common_helper_cv.h"
+#include "face_detection.h"
+#include "depth_engine.h"
+#include "depth_query.h"
+#include "stream_runner.h"
+
+/*** Macro ***/
+static constexpr char kInputImageFilename[] = RESOURCE_DIR"/lena.jpg";
+static constexpr char kFaceModelFilename[] = RESOURCE_DIR"/model/face_detection_yunet.onnx";
+static constexpr char kDepthModelFilename[] = RESOURCE_DIR"/model/midasv2_small_256x256.onnx";
+static constexpr int32_t kDefaultWorkerNum = 4;
+static constexpr int32_t kDefaultMaxFrameNumPerStream = -1;    /* -1 = until the end of stream */
+static constexpr int32_t kFaceDepthLogIntervalFrame = 100;     /* print the depth of each face every N frames of each stream */
+
+
+/*** Global variable ***/
+
+
+/*** Function ***/
+class FaceDepthWorker : public StreamWorker
+{
+public:
+    bool Initialize(const std::vector<uint8_t>& face_model_buffer, const std::vector<uint8_t>& depth_model_buffer)
+    {
+        if (!face_detection_.Initialize(face_model_buffer)) return false;
+        use_depth_ = !depth_model_buffer.empty();
+        if (use_depth_) {
+            if (!depth_engine_.Initialize(depth_model_buffer)) return false;
+        }
+        return true;
+    }
+
+    void SetInstrumentation(Instrumentation* instrumentation)
+    {
+        face_detection_.SetInstrumentation(instrumentation, "face_detection");
+        depth_engine_.SetInstrumentation(instrumentation, "depth");
+    }
+
+    bool Process(int32_t stream_id, int32_t frame_id, cv::Mat& image) override
+    {
+        std::vector<cv::Rect> bbox_list;
+        std::vector<FaceDetection::Landmark> landmark_list;
+        face_detection_.Process(image, bbox_list, landmark_list);
+
+        if (use_depth_) {
+            cv::Mat mat_depth;
+            depth_engine_.Process(image, mat_depth);
+
+            /* Depth of each face (inverse relative depth. Larger = nearer). O(1) per face after Build */
+            /* It's used only for the log, so the tables are built only for the logged frames */
+            if (frame_id % kFaceDepthLogIntervalFrame == 0 && !bbox_list.empty()) {
+                depth_query_.Build(mat_depth, image.size());
+                for (int32_t i = 0; i < static_cast<int32_t>(bbox_list.size()); i++) {
+                    const auto& bbox = bbox_list[i];
+                    const float depth = depth_query_.GetMedian(bbox);
+                    printf("[stream %d, frame %d] face %d (%d, %d, %d, %d): depth = %.3f\n", stream_id, frame_id, i, bbox.x, bbox.y, bbox.width, bbox.height, depth);
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    FaceDetection face_detection_;
+    DepthEngine depth_engine_;
+    DepthQuery depth_query_;
+    bool use_depth_ = false;
+};
+
+
+static void PrintUsage(const char* program_name)
+{
+    printf("usage: %s [-w worker_num] [-n max_frame_num_per_stream] [--no-depth] input0 [input1 ...]\n", program_name);
+    printf("    input: video file (mp4/avi/webm), image file, camera id\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int32_t worker_num = kDefaultWorkerNum;
+    int32_t max_frame_num_per_stream = kDefaultMaxFrameNumPerStream;
+    bool use_depth = true;
+    std::vector<std::string> input_name_list;
+    for (int32_t i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-w" && i + 1 < argc) {
+            worker_num = (std::max)(1, std::atoi(argv[++i]));
+        } else if (arg == "-n" && i + 1 < argc) {
+            max_frame_num_per_stream = std::atoi(argv[++i]);
+        } else if (arg == "--no-depth") {
+            use_depth = false;
+        } else if (arg == "-h" || arg == "--help") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else {
+            input_name_list.push_back(arg);
+        }
+    }
+    if (input_name_list.empty()) {
+        input_name_list.push_back(kInputImageFilename);
+    }
+
+    /* Read the weights only once. Each worker creates its own net from the shared buffer */
+    std::vector<uint8_t> face_model_buffer;
+    if (!CommonHelper::ReadBinaryFile(kFaceModelFilename, face_model_buffer)) {
+        return -1;
+    }
+    std::vector<uint8_t> depth_model_buffer;
+    if (use_depth && !CommonHelper::ReadBinaryFile(kDepthModelFilename, depth_model_buffer)) {
+        printf("Depth model is not found. Run face detection only\n");
+        depth_model_buffer.clear();
+    }
+
+    /* Workers already run in parallel, so divide the threads of OpenCV among them */
+    int32_t thread_num_per_worker = (std::max)(1, static_cast<int32_t>(std::thread::hardware_concurrency()) / worker_num);
+    cv::setNumThreads(thread_num_per_worker);
+
+    StreamRunner stream_runner;
+    bool ret = stream_runner.Initialize(input_name_list, worker_num, [&](int32_t worker_id) {
+        std::unique_ptr<FaceDepthWorker> worker(new FaceDepthWorker());
+        if (!worker->Initialize(face_model_buffer, depth_model_buffer)) {
+            return std::unique_ptr<StreamWorker>();
+        }
+        worker->SetInstrumentation(&stream_runner.GetInstrumentation());
+        return std::unique_ptr<StreamWorker>(std::move(worker));
+    });
+    if (!ret) {
+        return -1;
+    }
+
+    stream_runner.Run(max_frame_num_per_stream);
+    stream_runner.PrintStatistics();
+
+    /* Time of each stage of the engines (all workers) */
+    printf("=== Engine stages [ms] ===\n");
+    for (const char* name : { "face_detection.pre_process", "face_detection.inference", "depth.pre_process", "depth.inference" }) {
+        Instrumentation::Summary summary;
+        if (!stream_runner.GetInstrumentation().GetSummary(name, summary)) continue;
+        printf("%-28s %9.2f %9.2f %9.2f\n", name, summary.mean, summary.p50, summary.p95);
+    }
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include <opencv2/opencv.hpp>
+
+#include "common_helper_cv.h"
+#include "instrumentation.h"
+#include "stream_runner.h"
+
+
+/*** Function ***/
+bool StreamRunner::Initialize(const std::vector<std::string>& input_name_list, int32_t worker_num, const WorkerFactory& worker_factory)
+{
+    stream_list_.clear();
+    for (const auto& input_name : input_name_list) {
+        Stream stream;
+        stream.input_name = input_name;
+        if (!CommonHelper::FindSourceImage(input_name, stream.cap)) {
+            return false;
+        }
+        stream.is_busy = false;
+        stream.is_finished = false;
+        stream.frame_cnt = 0;
+        stream_list_.push_back(std::move(stream));
+    }
+
+    /* Create engines in the main thread, so that an error is reported before starting */
+    worker_list_.clear();
+    for (int32_t i = 0; i < worker_num; i++) {
+        auto worker = worker_factory(i);
+        if (!worker) {
+            printf("[StreamRunner] Failed to create worker %d\n", i);
+            return false;
+        }
+        worker_list_.push_back(std::move(worker));
+    }
+
+    next_stream_index_ = 0;
+    processed_frame_num_ = 0;
+    elapsed_time_ms_ = 0;
+    instrumentation_.Reset();
+    return true;
+}
+
+void StreamRunner::Run(int32_t max_frame_num_per_stream)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> thread_list;
+    for (int32_t i = 0; i < static_cast<int32_t>(worker_list_.size()); i++) {
+        thread_list.push_back(std::thread(&StreamRunner::WorkerThread, this, i, max_frame_num_per_stream));
+    }
+    for (auto& thread : thread_list) {
+        thread.join();
+    }
+
+    const auto time_end = std::chrono::steady_clock::now();
+    elapsed_time_ms_ = std::chrono::duration<double, std::milli>(time_end - time_start).count();
+}
+
+void StreamRunner::PrintStatistics() const
+{
+    printf("=== Per-stream latency [ms] ===\n");
+    printf("%-4s %-32s %8s %9s %9s %9s %9s %8s\n", "id", "input", "frames", "mean", "p50", "p95", "max", "fps");
+    for (int32_t i = 0; i < static_cast<int32_t>(stream_list_.size()); i++) {
+        Instrumentation::Summary summary;
+        if (!instrumentation_.GetSummary("stream" + std::to_string(i) + ".latency", summary)) continue;
+        double fps = (elapsed_time_ms_ > 0) ? summary.count * 1000.0 / elapsed_time_ms_ : 0;
+        printf("%-4d %-32s %8lld %9.2f %9.2f %9.2f %9.2f %8.2f\n", i, stream_list_[i].input_name.c_str(),
+            static_cast<long long>(summary.count), summary.mean, summary.p50, summary.p95, summary.max, fps);
+    }
+
+    printf("=== Aggregate ===\n");
+    double throughput = (elapsed_time_ms_ > 0) ? processed_frame_num_ * 1000.0 / elapsed_time_ms_ : 0;
+    printf("streams = %d, workers = %d, frames = %lld, time = %.1f [ms], throughput = %.2f [fps]\n",
+        static_cast<int32_t>(stream_list_.size()), static_cast<int32_t>(worker_list_.size()),
+        static_cast<long long>(processed_frame_num_), elapsed_time_ms_, throughput);
+}
+
+void StreamRunner::WorkerThread(int32_t worker_id, int32_t max_frame_num_per_stream)
+{
+    auto& worker = worker_list_[worker_id];
+    int32_t stream_id;
+    int32_t frame_id;
+    while (AcquireStream(max_frame_num_per_stream, stream_id, frame_id)) {
+        /* The stream is exclusively owned by this worker until ReleaseStream */
+        Stream& stream = stream_list_[stream_id];
+        const auto time_read = std::chrono::steady_clock::now();
+        cv::Mat image;
+        if (stream.cap.isOpened()) {
+            stream.cap.read(image);
+        } else if (frame_id == 0) {
+            image = cv::imread(stream.input_name);
+        }
+        if (image.empty()) {
+            ReleaseStream(stream_id, true);
+            continue;
+        }
+
+        bool ret = worker->Process(stream_id, frame_id, image);
+
+        const auto time_done = std::chrono::steady_clock::now();
+        double latency_ms = std::chrono::duration<double, std::milli>(time_done - time_read).count();
+        instrumentation_.Record("stream" + std::to_string(stream_id) + ".latency", latency_ms);
+        instrumentation_.Record("worker" + std::to_string(worker_id) + ".latency", latency_ms);
+        ReleaseStream(stream_id, !ret);
+    }
+}
+
+bool StreamRunner::AcquireStream(int32_t max_frame_num_per_stream, int32_t& stream_id, int32_t& frame_id)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int32_t stream_num = static_cast<int32_t>(stream_list_.size());
+    while (true) {
+        bool is_all_finished = true;
+        for (int32_t i = 0; i < stream_num; i++) {
+            int32_t index = (next_stream_index_ + i) % stream_num;
+            Stream& stream = stream_list_[index];
+            if (stream.is_finished) continue;
+            if (max_frame_num_per_stream >= 0 && stream.frame_cnt >= max_frame_num_per_stream) {
+                stream.is_finished = true;
+                continue;
+            }
+            is_all_finished = false;
+            if (stream.is_busy) continue;
+
+            /* Take this stream, and start the next search from the next stream (round robin) */
+            stream.is_busy = true;
+            stream_id = index;
+            frame_id = stream.frame_cnt++;
+            next_stream_index_ = (index + 1) % stream_num;
+            return true;
+        }
+        if (is_all_finished) {
+            cond_.notify_all();
+            return false;
+        }
+        cond_.wait(lock);
+    }
+}
+
+void StreamRunner::ReleaseStream(int32_t stream_id, bool is_finished)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stream& stream = stream_list_[stream_id];
+        stream.is_busy = false;
+        if (is_finished) {
+            stream.is_finished = true;
+            stream.frame_cnt--;     /* the last acquired frame was not processed */
+        } else {
+            processed_frame_num_++;
+        }
+    }
+    cond_.notify_all();
+}
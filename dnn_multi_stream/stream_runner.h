@@ -0,0 +1,86 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef STREAM_RUNNER_
+#define STREAM_RUNNER_
+
+/*** Include ***/
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <opencv2/opencv.hpp>
+
+#include "instrumentation.h"
+
+
+/* Per-thread processing unit. Each worker owns its own inference engines (cv::dnn::Net is not thread-safe) */
+class StreamWorker
+{
+public:
+    virtual ~StreamWorker() {}
+    virtual bool Process(int32_t stream_id, int32_t frame_id, cv::Mat& image) = 0;
+};
+
+
+/***
+* Process frames from N sources with M worker threads
+*   - Each stream has at most one frame in flight, so frames of a stream are processed in order
+*   - A free worker takes the next frame in round-robin order over the streams, so no stream starves
+*   - Latency (read -> processed) is recorded per stream, throughput is calculated over all streams
+***/
+class StreamRunner
+{
+public:
+    typedef std::function<std::unique_ptr<StreamWorker>(int32_t worker_id)> WorkerFactory;
+
+public:
+    StreamRunner() : next_stream_index_(0), processed_frame_num_(0), elapsed_time_ms_(0) {}
+    ~StreamRunner() {}
+    bool Initialize(const std::vector<std::string>& input_name_list, int32_t worker_num, const WorkerFactory& worker_factory);
+    void Run(int32_t max_frame_num_per_stream = -1);
+    void PrintStatistics() const;
+    Instrumentation& GetInstrumentation() { return instrumentation_; }
+
+private:
+    typedef struct Stream_ {
+        std::string input_name;
+        cv::VideoCapture cap;   /* if cap is not opened, src is still image */
+        bool is_busy;
+        bool is_finished;
+        int32_t frame_cnt;
+    } Stream;
+
+private:
+    void WorkerThread(int32_t worker_id, int32_t max_frame_num_per_stream);
+    bool AcquireStream(int32_t max_frame_num_per_stream, int32_t& stream_id, int32_t& frame_id);
+    void ReleaseStream(int32_t stream_id, bool is_finished);
+
+private:
+    std::vector<Stream> stream_list_;
+    std::vector<std::unique_ptr<StreamWorker>> worker_list_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int32_t next_stream_index_;
+    int64_t processed_frame_num_;
+    double elapsed_time_ms_;
+    Instrumentation instrumentation_;
+};
+
+#endif
@@ -76,13 +76,11 @@ static void loop_main(const cv::Mat& image_org)
     y_deg += 1.2f;
     r_deg += 1.3f;
 
-    /* Convert to image points (2D) */
-    std::vector<cv::Point2f> image_point_list;
-    cv::projectPoints(object_point_list, camera.rvec, camera.tvec, camera.K, camera.dist_coeff, image_point_list);
-
-    /* Affine transform */
-    cv::Point2f pts1[] = { cv::Point2f(0, 0), cv::Point2f(image_org.cols - 1.0f, 0) , cv::Point2f(image_org.cols - 1.0f, image_org.rows - 1.0f) , cv::Point2f(0, image_org.rows - 1.0f) };
-    cv::Mat mat_affine = cv::getPerspectiveTransform(pts1, &image_point_list[0]);
+    /* Homography from the image (texture) on the plane to the camera image */
+    /* object_point_list[0]: top-left, [1]: top-right, [3]: bottom-left of the texture */
+    cv::Point3f axis_u = (object_point_list[1] - object_point_list[0]) * (1.0f / (image_org.cols - 1));
+    cv::Point3f axis_v = (object_point_list[3] - object_point_list[0]) * (1.0f / (image_org.rows - 1));
+    cv::Mat mat_affine = camera.GetTextureHomography(object_point_list[0], axis_u, axis_v);
     cv::Mat mat_output = cv::Mat(kHeight, kWidth, CV_8UC3, cv::Scalar(70, 70, 70));
     cv::warpPerspective(image_org, mat_output, mat_affine, mat_output.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
 
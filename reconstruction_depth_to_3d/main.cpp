@@ -30,7 +30,13 @@ limitations under the License.
 
 #include "common_helper_cv.h"
 #include "depth_engine.h"
+#include "depth_upsampler.h"
 #include "camera_model.h"
+#include "shm_channel.h"
+#include "point_cloud_codec.h"
+#include "ground_plane_estimator.h"
+#include "point_cloud_filter.h"
+#include "bev_grid.h"
 
 /*** Macro ***/
 static constexpr char kInputImageFilename[] = RESOURCE_DIR"/room_02.jpg";
@@ -38,7 +44,25 @@ static constexpr float   kCamera2d3dFovDeg = 80.0f;
 static constexpr int32_t kCamera3d2dWidth = 640;
 static constexpr int32_t kCamera3d2dHeight = 480;
 static constexpr float   kCamera3d2dFovDeg = 80.0f;
-#define NORMALIZE_BY_255
+static constexpr uint32_t kShmSlotNum = 2;
+static constexpr float   kPointCloudPrecision = 0.005f;   /* [m] voxel size of the compressed point cloud */
+//#define NORMALIZE_BY_255
+#define NORMALIZE_BY_GROUND_PLANE     /* metric depth. Fit to the depth of the ground plane of camera_2d_to_3d (its height and pitch must be correct) */
+static constexpr float   kCamera2d3dHeight = 1.0f;      /* [m] */
+static constexpr int32_t kGroundSampleStride = 8;       /* [px] */
+static constexpr float   kGroundSampleMaxDepth = 20.0f; /* [m] far ground is not reliable */
+static constexpr float   kMetricDepthMax = 100.0f;      /* [m] */
+#define SELF_CALIBRATE_GROUND_PLANE   /* estimate pitch and roll of camera_2d_to_3d from the ground plane of the point cloud (RANSAC), and fit the depth again */
+static constexpr int32_t kSelfCalibrationIterationNum = 2;
+#define UPSAMPLE_BY_GUIDED_FILTER     /* edge-aware upsampling of the depth map with the input image as guidance (otherwise, bilinear cv::resize) */
+//#define BENCHMARK_UPSAMPLE          /* compare the upsampling methods at 720p and 1080p */
+#define DEPTH_FP16                    /* store the depth map of the image size in FP16 (half memory traffic to the point cloud) */
+//#define REPORT_FP16_ACCURACY        /* with DEPTH_FP16: compare the depth map and the point cloud with FP32 (the depth map is upsampled again in FP32) */
+#define REMOVE_FLYING_PIXEL           /* remove points at depth discontinuities (neighbourhood depth-variance test on the depth map) */
+//#define REMOVE_OUTLIER_BY_RADIUS    /* remove isolated points (the sky clamped at kMetricDepthMax is sparse, so it's removed too) */
+static constexpr float   kOutlierRadius = 0.1f;         /* [m] */
+#define BUILD_BEV_GRID                /* bird's-eye-view obstacle map (max height / count / distance per cell). Needs metric depth with the ground at Y = 0 */
+//#define SKIP_SKY     /* reconstruct only the ground region (below the horizon) of camera_2d_to_3d. Set its height and pitch for road scenes */
 
 /*** Global variable ***/
 static CameraModel camera_2d_to_3d;
@@ -72,6 +96,26 @@ static void SaveAsPly(const cv::Mat& image_input, const std::vector<cv::Point3f>
     of.close();
 }
 
+static void SaveAsCompressed(const cv::Mat& image_input, const std::vector<cv::Point3f>& object_point_list, const std::string filename)
+{
+    const auto& t0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> data;
+    if (!PointCloudCodec::Encode(object_point_list, image_input, kPointCloudPrecision, data)) return;
+    const auto& t1 = std::chrono::steady_clock::now();
+    std::vector<cv::Point3f> object_point_list_decoded;
+    std::vector<cv::Vec3b> color_list_decoded;
+    if (!PointCloudCodec::Decode(data, object_point_list_decoded, color_list_decoded)) return;
+    const auto& t2 = std::chrono::steady_clock::now();
+    PointCloudCodec::WriteFile(filename, data);
+
+    /* binary PLY: 3 floats + 3 uchars per point */
+    const size_t size_ply = object_point_list.size() * (3 * sizeof(float) + 3);
+    printf("[SaveAsCompressed] %zu points -> %zu voxels (precision = %.3f [m])\n", object_point_list.size(), object_point_list_decoded.size(), kPointCloudPrecision);
+    printf("[SaveAsCompressed] binary PLY = %zu [byte], compressed = %zu [byte] (x%.1f)\n", size_ply, data.size(), static_cast<double>(size_ply) / data.size());
+    printf("[SaveAsCompressed] encode = %.1f [ms], decode = %.1f [ms]\n",
+        std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0, std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0);
+}
+
 void InitializeCamera(int32_t width, int32_t height)
 {
     camera_2d_to_3d.SetIntrinsic(width, height, FocalLength(width, kCamera2d3dFovDeg));
@@ -79,13 +123,13 @@ void InitializeCamera(int32_t width, int32_t height)
     //camera_2d_to_3d.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
     camera_2d_to_3d.SetExtrinsic(
         { 0.0f, 0.0f, 0.0f },    /* rvec [deg] */
-        { 0.0f, 0.0f, 0.0f }, true);   /* tvec (Oc - Ow in world coordinate. X+= Right, Y+ = down, Z+ = far) */
+        { 0.0f, -kCamera2d3dHeight, 0.0f }, true);   /* tvec (Oc - Ow in world coordinate. X+= Right, Y+ = down, Z+ = far) */
 
     camera_3d_to_2d.SetIntrinsic(kCamera3d2dWidth, kCamera3d2dHeight, FocalLength(kCamera3d2dWidth, kCamera3d2dFovDeg));
     camera_3d_to_2d.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
     camera_3d_to_2d.SetExtrinsic(
         { 0.0f, 0.0f, 0.0f },    /* rvec [deg] */
-        { 0.0f, 0.0f, 0.0f }, true);   /* tvec (Oc - Ow in world coordinate. X+= Right, Y+ = down, Z+ = far) */
+        { 0.0f, -kCamera2d3dHeight, 0.0f }, true);   /* tvec (Oc - Ow in world coordinate. X+= Right, Y+ = down, Z+ = far) */
 
 }
 
@@ -113,8 +157,10 @@ static void CallbackMouseMain(int32_t event, int32_t x, int32_t y, int32_t flags
 
 static void TreatKeyInputMain(int32_t key)
 {
-#ifdef NORMALIZE_BY_255
+#if defined(NORMALIZE_BY_255)
     static constexpr float kIncPosPerFrame = 10.0f;
+#elif defined(NORMALIZE_BY_GROUND_PLANE)
+    static constexpr float kIncPosPerFrame = 0.05f;
 #else
     static constexpr float kIncPosPerFrame = 0.0005f;
 #endif
@@ -165,6 +211,122 @@ static void TreatKeyInputMain(int32_t key)
     }
 }
 
+/* Metric scale recovery: the depth of the pixels below the horizon is known if they are on the ground plane */
+static bool EstimateScaleShiftByGroundPlane(DepthEngine& depth_engine, const cv::Mat& mat_depth, float& scale, float& shift)
+{
+    /* Sample pixels below the horizon (strided, to keep it well under 1 ms) */
+    int32_t row_start, row_end;
+    camera_2d_to_3d.GetGroundRowRange(row_start, row_end);
+    std::vector<cv::Point2f> image_point_list;
+    for (int32_t y = row_start + kGroundSampleStride / 2; y < row_end; y += kGroundSampleStride) {
+        for (int32_t x = kGroundSampleStride / 2; x < camera_2d_to_3d.width; x += kGroundSampleStride) {
+            if (camera_2d_to_3d.IsGround(static_cast<float>(x), static_cast<float>(y))) {
+                image_point_list.push_back(cv::Point2f(static_cast<float>(x), static_cast<float>(y)));
+            }
+        }
+    }
+
+    /* Depth(Zc) of the ground plane at the pixels */
+    std::vector<cv::Point3f> object_point_list;
+    camera_2d_to_3d.ConvertImage2GroundPlane(image_point_list, object_point_list);
+    std::vector<cv::Point3f> object_point_in_camera_list;
+    camera_2d_to_3d.ConvertWorld2Camera(object_point_list, object_point_in_camera_list);
+    std::vector<float> depth_list(image_point_list.size());
+    for (size_t i = 0; i < image_point_list.size(); i++) {
+        const cv::Point3f& object_point = object_point_list[i];
+        const float depth = object_point_in_camera_list[i].z;
+        const bool is_valid = object_point.x != CameraModel::kNoIntersection && object_point.z != CameraModel::kNoIntersection && depth > 0 && depth < kGroundSampleMaxDepth;
+        depth_list[i] = is_valid ? depth : 0.0f;    /* 0 = unknown */
+    }
+
+    return depth_engine.FitScaleShift(mat_depth, cv::Size(camera_2d_to_3d.width, camera_2d_to_3d.height), image_point_list, depth_list, scale, shift);
+}
+
+#ifdef SELF_CALIBRATE_GROUND_PLANE
+static void SelfCalibrateGroundPlane(DepthEngine& depth_engine, const cv::Mat& mat_depth, cv::Mat& mat_depth_normlized)
+{
+    /* The scale of the depth comes from kCamera2d3dHeight, so only pitch and roll are updated */
+    GroundPlaneEstimator ground_plane_estimator(kGroundSampleStride, 0.05f * kCamera2d3dHeight, GroundPlaneEstimator::kDefaultIterationNum, kGroundSampleMaxDepth);
+    for (int32_t i = 0; i < kSelfCalibrationIterationNum; i++) {
+        const auto& t0 = std::chrono::steady_clock::now();
+        GroundPlaneEstimator::Result result;
+        if (!ground_plane_estimator.Estimate(camera_2d_to_3d, mat_depth_normlized, result)) return;
+        const auto& t1 = std::chrono::steady_clock::now();
+        printf("Ground plane: height = %.3f [m], pitch = %.2f [deg], roll = %.2f [deg], inlier = %d / %d (%.3f [ms])\n",
+            result.distance, result.pitch_deg, result.roll_deg, result.inlier_num, result.sample_num, std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0);
+        GroundPlaneEstimator::ApplyToCamera(result, camera_2d_to_3d, false);
+
+        float scale, shift;
+        if (!EstimateScaleShiftByGroundPlane(depth_engine, mat_depth, scale, shift)) return;
+        depth_engine.NormalizeScaleShift(mat_depth, mat_depth_normlized, scale, shift);
+        mat_depth_normlized.setTo(kMetricDepthMax, mat_depth_normlized < 0);
+        cv::min(mat_depth_normlized, kMetricDepthMax, mat_depth_normlized);
+    }
+}
+#endif
+
+#ifdef BENCHMARK_UPSAMPLE
+static void BenchmarkUpsample(DepthUpsampler& depth_upsampler, const cv::Mat& mat_depth, const cv::Mat& image_input)
+{
+    static constexpr int32_t kLoopNum = 20;
+    for (const cv::Size& size : { cv::Size(1280, 720), cv::Size(1920, 1080) }) {
+        cv::Mat image_guide;
+        cv::resize(image_input, image_guide, size);
+        cv::Mat mat_depth_upsampled;
+        cv::resize(mat_depth, mat_depth_upsampled, size);     /* warm up */
+        depth_upsampler.Process(mat_depth, image_guide, mat_depth_upsampled);
+
+        const auto& t0 = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < kLoopNum; i++) {
+            cv::resize(mat_depth, mat_depth_upsampled, size);
+        }
+        const auto& t1 = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < kLoopNum; i++) {
+            depth_upsampler.Process(mat_depth, image_guide, mat_depth_upsampled);
+        }
+        const auto& t2 = std::chrono::steady_clock::now();
+        printf("Upsample to %dx%d: resize = %.2f [ms], guided filter = %.2f [ms]\n", size.width, size.height,
+            std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0 / kLoopNum,
+            std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0 / kLoopNum);
+    }
+}
+#endif
+
+#if defined(DEPTH_FP16) && defined(REPORT_FP16_ACCURACY)
+/* Accuracy of FP16 storage: compare the depth map and the point cloud with FP32 */
+static void ReportFp16Accuracy(const cv::Mat& mat_depth_float, const cv::Mat& mat_depth_half)
+{
+    cv::Mat mat_depth_half_float;
+    mat_depth_half.convertTo(mat_depth_half_float, CV_32FC1);
+    cv::Mat mat_xyz_float;
+    cv::Mat mat_xyz_half;
+    camera_2d_to_3d.ConvertImage2World(mat_depth_float, mat_xyz_float);
+    camera_2d_to_3d.ConvertImage2World(mat_depth_half, mat_xyz_half);
+
+    double depth_error_sum = 0;
+    double depth_error_max = 0;
+    double point_error_max = 0;
+    int32_t num = 0;
+    for (int32_t i = 0; i < static_cast<int32_t>(mat_depth_float.total()); i++) {
+        const float d = mat_depth_float.at<float>(i);
+        if (d <= 0) continue;
+        const double depth_error = std::abs(mat_depth_half_float.at<float>(i) - d) / d;
+        const cv::Vec3f& p_float = mat_xyz_float.at<cv::Vec3f>(i);
+        const cv::Vec3f& p_half = mat_xyz_half.at<cv::Vec3f>(i);
+        const double dx = p_half[0] - p_float[0];
+        const double dy = p_half[1] - p_float[1];
+        const double dz = p_half[2] - p_float[2];
+        const double point_error = std::sqrt(dx * dx + dy * dy + dz * dz) / d;
+        depth_error_sum += depth_error;
+        depth_error_max = (std::max)(depth_error_max, depth_error);
+        point_error_max = (std::max)(point_error_max, point_error);
+        num++;
+    }
+    printf("FP16 depth: relative error mean = %.2e, max = %.2e (half precision: %.2e). Point cloud: max error / depth = %.2e\n",
+        (num > 0) ? depth_error_sum / num : 0.0, depth_error_max, std::pow(2.0, -11), point_error_max);
+}
+#endif
+
 static bool CheckIfPointInArea(const cv::Point& p, const cv::Size& r)
 {
     if (p.x < 0 || p.y < 0 || p.x >= r.width || p.y >= r.height) return false;
@@ -211,27 +373,108 @@ int main(int argc, char* argv[])
 
     /* Normalize depth for 3D reconstruction */
     cv::Mat mat_depth_normlized;
-#ifdef NORMALIZE_BY_255
+#if defined(NORMALIZE_BY_255)
     mat_depth_normlized255.convertTo(mat_depth_normlized, CV_32FC1);
+#elif defined(NORMALIZE_BY_GROUND_PLANE)
+    float scale = 1.0f;
+    float shift = 0.0f;
+    const auto& time_fit0 = std::chrono::steady_clock::now();
+    bool is_fitted = EstimateScaleShiftByGroundPlane(depth_engine, mat_depth, scale, shift);
+    const auto& time_fit1 = std::chrono::steady_clock::now();
+    if (is_fitted) {
+        printf("Scale/Shift by ground plane: %f, %f (%.3f [ms])\n", scale, shift, std::chrono::duration_cast<std::chrono::microseconds>(time_fit1 - time_fit0).count() / 1000.0);
+    } else {
+        printf("Failed to fit to the ground plane. Relative depth is used\n");
+        scale = 1.0f;
+        shift = 0.0f;
+    }
+    depth_engine.NormalizeScaleShift(mat_depth, mat_depth_normlized, scale, shift);
+    mat_depth_normlized.setTo(kMetricDepthMax, mat_depth_normlized < 0);   /* beyond the vanishing point (e.g. sky) */
+    cv::min(mat_depth_normlized, kMetricDepthMax, mat_depth_normlized);
+#ifdef SELF_CALIBRATE_GROUND_PLANE
+    if (is_fitted) SelfCalibrateGroundPlane(depth_engine, mat_depth, mat_depth_normlized);
+#endif
 #else
     depth_engine.NormalizeScaleShift(mat_depth, mat_depth_normlized, 1.0f, 0.0f);
 #endif
+#ifdef BENCHMARK_UPSAMPLE
+    DepthUpsampler depth_upsampler_benchmark;
+    BenchmarkUpsample(depth_upsampler_benchmark, mat_depth_normlized, image_input);
+#endif
+#ifdef UPSAMPLE_BY_GUIDED_FILTER
+    /* Depth edges follow the color edges, so points are not smeared between objects (flying pixels) */
+    DepthUpsampler depth_upsampler;
+#ifdef DEPTH_FP16
+#ifdef REPORT_FP16_ACCURACY
+    cv::Mat mat_depth_float;    /* only for the accuracy report */
+    depth_upsampler.Process(mat_depth_normlized, image_input, mat_depth_float, CV_32FC1);
+#endif
+    depth_upsampler.Process(mat_depth_normlized, image_input, mat_depth_normlized, CV_16FC1);
+#else
+    depth_upsampler.Process(mat_depth_normlized, image_input, mat_depth_normlized, CV_32FC1);
+#endif
+#else
     cv::resize(mat_depth_normlized, mat_depth_normlized, image_input.size());
+#ifdef DEPTH_FP16
+#ifdef REPORT_FP16_ACCURACY
+    cv::Mat mat_depth_float = mat_depth_normlized.clone();
+#endif
+    mat_depth_normlized.convertTo(mat_depth_normlized, CV_16FC1);
+#endif
+#endif
+#if defined(DEPTH_FP16) && defined(REPORT_FP16_ACCURACY)
+    ReportFp16Accuracy(mat_depth_float, mat_depth_normlized);
+#endif
 
-    /* Generate depth list */
-    std::vector<float> depth_list;
-    for (int32_t y = 0; y < mat_depth_normlized.rows; y ++) {
-        for (int32_t x = 0; x < mat_depth_normlized.cols; x ++) {
-            float Z = mat_depth_normlized.at<float>(cv::Point(x, y));
-            depth_list.push_back(Z);
-        }
-    }
+    /* Select rows to convert */
+    int32_t row_start = 0;
+    int32_t row_end = mat_depth_normlized.rows;
+#ifdef SKIP_SKY
+    camera_2d_to_3d.GetGroundRowRange(row_start, row_end);
+#endif
 
     /* Convert px,py,depth(Zc) -> Xc,Yc,Zc(in camera_2d_to_3d)(=Xw,Yw,Zw) */
-    std::vector<cv::Point3f> object_point_list;
-    camera_2d_to_3d.ConvertImage2World(std::vector<cv::Point2f>(), depth_list, object_point_list);
+    /* The depth map is read in place, and the result is written directly into object_point_list (as CV_32FC3) */
+    std::vector<cv::Point3f> object_point_list((row_end - row_start) * mat_depth_normlized.cols);
+    cv::Mat mat_xyz(row_end - row_start, mat_depth_normlized.cols, CV_32FC3, object_point_list.data());
+    camera_2d_to_3d.ConvertImage2World(mat_depth_normlized.rowRange(row_start, row_end), mat_xyz, row_start);
+    cv::Mat image_color = image_input.rowRange(row_start, row_end);     /* color of each point */
+
+#if defined(REMOVE_FLYING_PIXEL) || defined(REMOVE_OUTLIER_BY_RADIUS)
+    /* Points and their colors are compacted */
+    const size_t point_num_org = object_point_list.size();
+    const auto& time_filter0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> is_inlier_list;
+#ifdef REMOVE_FLYING_PIXEL
+    PointCloudFilter::FilterByDepthVariance(mat_depth_normlized.rowRange(row_start, row_end), PointCloudFilter::kDefaultVarianceRadius, PointCloudFilter::kDefaultVarianceThreshold, is_inlier_list);
+    PointCloudFilter::Compact(object_point_list, image_color, is_inlier_list, object_point_list, image_color);
+#endif
+#ifdef REMOVE_OUTLIER_BY_RADIUS
+    PointCloudFilter::FilterByRadius(object_point_list, kOutlierRadius, PointCloudFilter::kDefaultMinNeighborNum, is_inlier_list);
+    PointCloudFilter::Compact(object_point_list, image_color, is_inlier_list, object_point_list, image_color);
+#endif
+    const auto& time_filter1 = std::chrono::steady_clock::now();
+    printf("Outlier removal: %zu -> %zu points (%.3f [ms])\n", point_num_org, object_point_list.size(), std::chrono::duration_cast<std::chrono::microseconds>(time_filter1 - time_filter0).count() / 1000.0);
+#endif
+
+#ifdef BUILD_BEV_GRID
+    BevGrid bev_grid;
+    const auto& time_bev0 = std::chrono::steady_clock::now();
+    bev_grid.Build(object_point_list, camera_2d_to_3d);
+    const auto& time_bev1 = std::chrono::steady_clock::now();
+    printf("BEV grid: nearest obstacle = %.2f [m] (%.3f [ms])\n", bev_grid.GetNearestObstacleDistance(), std::chrono::duration_cast<std::chrono::microseconds>(time_bev1 - time_bev0).count() / 1000.0);
+    cv::Mat image_bev;
+    bev_grid.Draw(image_bev);
+#endif
 
-    SaveAsPly(image_input, object_point_list, "my_point_cloud.ply");
+    SaveAsPly(image_color, object_point_list, "my_point_cloud.ply");
+    SaveAsCompressed(image_color, object_point_list, "my_point_cloud.pcc");
+
+    /* Publish the point cloud to other processes */
+    ShmChannel::Writer shm_writer;
+    if (shm_writer.Create(ShmChannel::kNamePointCloud, kShmSlotNum, static_cast<uint32_t>(object_point_list.size() * sizeof(cv::Point3f)))) {
+        shm_writer.PublishPointCloud(object_point_list);
+    }
 
     while(true) {
         /* Project 3D to 2D(new image) */
@@ -253,13 +496,16 @@ int main(int argc, char* argv[])
         cv::Mat mat_output = cv::Mat(camera_3d_to_2d.height, camera_3d_to_2d.width, CV_8UC3, cv::Scalar(0, 0, 0));
         for (int32_t i : indices_depth) {
             if (CheckIfPointInArea(image_point_list[i], mat_output.size())) {
-                cv::circle(mat_output, image_point_list[i], 4, image_input.at<cv::Vec3b>(i), -1);
+                cv::circle(mat_output, image_point_list[i], 4, image_color.at<cv::Vec3b>(i), -1);
             }
         }
 
         cv::imshow("Input", image_input);
         cv::imshow("Depth", image_depth);
         cv::imshow("Reconstruction", mat_output);
+#ifdef BUILD_BEV_GRID
+        cv::imshow("BEV", image_bev);
+#endif
         
         int32_t key = cv::waitKey(1);
         if (key == 27) break;   /* ESC to quit */
@@ -0,0 +1,290 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include <opencv2/opencv.hpp>
+
+#include "common_helper_cv.h"
+#include "camera_model.h"
+#include "depth_engine.h"
+#include "stereo_depth_engine.h"
+#include "icp_registration.h"
+
+/*** Macro ***/
+static constexpr char kInputImageFilename[] = RESOURCE_DIR"/baboon.jpg";    /* texture of the synthetic scene */
+static constexpr char kMidasModelFilename[] = RESOURCE_DIR"/model/midasv2_small_256x256.onnx";
+static constexpr int32_t kWidth = 640;
+static constexpr int32_t kHeight = 480;
+static constexpr float kFovDeg = 70.0f;
+static constexpr float kBaseline = 0.12f;           /* [m] */
+static constexpr float kCameraHeight = 1.5f;        /* [m] */
+static constexpr float kTexturePxPerMeter = 100.0f;
+static constexpr int32_t kBenchmarkLoopNum = 10;
+static constexpr float kBadPixelThreshold = 0.1f;   /* relative error */
+static constexpr int32_t kIcpDepthWidth = 160;     /* ICP runs on subsampled depth */
+static constexpr int32_t kIcpDepthHeight = 120;
+
+
+/*** Function ***/
+/* Synthetic scene (corridor): ground (Y = 0), walls (X = -3, X = 3) and back wall (Z = 30). All planes are textured */
+static void RenderSyntheticScene(CameraModel& camera, const cv::Mat& image_texture, cv::Mat& image, cv::Mat& mat_depth)
+{
+    static const std::vector<cv::Vec4f> plane_list = {
+        { 0, 1, 0, 0 },         /* ground */
+        { 1, 0, 0, 3 },         /* left wall */
+        { 1, 0, 0, -3 },        /* right wall */
+        { 0, 0, 1, -30 },       /* back wall */
+    };
+
+    std::vector<cv::Point2f> image_point_list;
+    for (int32_t y = 0; y < camera.height; y++) {
+        for (int32_t x = 0; x < camera.width; x++) {
+            image_point_list.push_back(cv::Point2f(static_cast<float>(x), static_cast<float>(y)));
+        }
+    }
+    std::vector<cv::Point3f> object_point_list;
+    std::vector<int32_t> plane_index_list;
+    camera.ConvertImage2Plane(image_point_list, plane_list, object_point_list, plane_index_list);
+    std::vector<cv::Point3f> object_point_in_camera_list;
+    camera.ConvertWorld2Camera(object_point_list, object_point_in_camera_list);
+
+    /* texture coordinate on each plane */
+    cv::Mat map_x(camera.height, camera.width, CV_32FC1);
+    cv::Mat map_y(camera.height, camera.width, CV_32FC1);
+    mat_depth = cv::Mat(camera.height, camera.width, CV_32FC1);
+    for (int32_t i = 0; i < static_cast<int32_t>(object_point_list.size()); i++) {
+        const cv::Point3f& p = object_point_list[i];
+        float u = 0, v = 0;
+        switch (plane_index_list[i]) {
+        case 0: u = p.x; v = p.z; break;
+        case 1: case 2: u = p.z; v = p.y; break;
+        case 3: u = p.x; v = p.y; break;
+        default: break;
+        }
+        map_x.at<float>(i) = std::abs(std::fmod(u * kTexturePxPerMeter, 2.0f * (image_texture.cols - 1)) - (image_texture.cols - 1));    /* mirrored repeat */
+        map_y.at<float>(i) = std::abs(std::fmod(v * kTexturePxPerMeter, 2.0f * (image_texture.rows - 1)) - (image_texture.rows - 1));
+        mat_depth.at<float>(i) = (plane_index_list[i] >= 0) ? object_point_in_camera_list[i].z : 0.0f;
+    }
+    cv::remap(image_texture, image, map_x, map_y, cv::INTER_LINEAR);
+}
+
+/* Only the image (e.g. the right camera, whose depth is not evaluated) */
+static void RenderSyntheticScene(CameraModel& camera, const cv::Mat& image_texture, cv::Mat& image)
+{
+    cv::Mat mat_depth;
+    RenderSyntheticScene(camera, image_texture, image, mat_depth);
+}
+
+/* AbsRel = mean(|d - d_gt| / d_gt), bad = ratio of pixels whose relative error > threshold, valid = ratio of pixels with depth */
+static void Evaluate(const cv::Mat& mat_depth, const cv::Mat& mat_depth_gt, double& abs_rel, double& bad_ratio, double& valid_ratio)
+{
+    double sum_rel = 0;
+    int32_t bad_num = 0;
+    int32_t valid_num = 0;
+    int32_t gt_num = 0;
+    for (int32_t i = 0; i < static_cast<int32_t>(mat_depth_gt.total()); i++) {
+        const float d_gt = mat_depth_gt.at<float>(i);
+        if (d_gt <= 0) continue;
+        gt_num++;
+        const float d = mat_depth.at<float>(i);
+        if (d <= 0) continue;
+        valid_num++;
+        const double rel = std::abs(d - d_gt) / d_gt;
+        sum_rel += rel;
+        if (rel > kBadPixelThreshold) bad_num++;
+    }
+    abs_rel = (valid_num > 0) ? sum_rel / valid_num : 0;
+    bad_ratio = (valid_num > 0) ? static_cast<double>(bad_num) / valid_num : 0;
+    valid_ratio = (gt_num > 0) ? static_cast<double>(valid_num) / gt_num : 0;
+}
+
+/* MiDaS outputs inverse relative depth. Fit 1 / depth_gt = scale * value + shift (robust least squares on strided pixels) to compare in metric */
+static void ConvertMidasToMetric(DepthEngine& depth_engine, const cv::Mat& mat_inverse_depth, const cv::Mat& mat_depth_gt, cv::Mat& mat_depth)
+{
+    static constexpr int32_t kSampleStride = 4;
+    std::vector<cv::Point2f> image_point_list;
+    std::vector<float> depth_list;
+    for (int32_t y = 0; y < mat_depth_gt.rows; y += kSampleStride) {
+        for (int32_t x = 0; x < mat_depth_gt.cols; x += kSampleStride) {
+            image_point_list.push_back(cv::Point2f(static_cast<float>(x), static_cast<float>(y)));
+            depth_list.push_back(mat_depth_gt.at<float>(y, x));
+        }
+    }
+    float scale = 0.0f;
+    float shift = 0.0f;
+    depth_engine.FitScaleShift(mat_inverse_depth, mat_depth_gt.size(), image_point_list, depth_list, scale, shift);
+
+    cv::Mat mat_inverse_depth_resized;
+    cv::resize(mat_inverse_depth, mat_inverse_depth_resized, mat_depth_gt.size());
+    mat_depth = cv::Mat(mat_depth_gt.size(), CV_32FC1);
+    for (int32_t i = 0; i < static_cast<int32_t>(mat_depth.total()); i++) {
+        const double inv = scale * mat_inverse_depth_resized.at<float>(i) + shift;
+        mat_depth.at<float>(i) = (inv > 0) ? static_cast<float>(1.0 / inv) : 0.0f;
+    }
+}
+
+/* Frame-to-frame ICP: render the next frame with a known camera motion, and compare the registered pose with it */
+static void BenchmarkIcp(CameraModel& camera, const cv::Mat& image_texture, const cv::Mat& mat_depth)
+{
+    CameraModel camera_next;
+    camera_next.SetIntrinsic(camera.width, camera.height, camera.fx());
+    camera_next.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    camera_next.SetExtrinsic({ 1.0f, 3.0f, 0.0f }, { 0.05f, -kCameraHeight, 0.25f }, true);
+    cv::Mat image_next, mat_depth_next;
+    RenderSyntheticScene(camera_next, image_texture, image_next, mat_depth_next);
+
+    cv::Mat mat_depth_small, mat_depth_next_small;
+    cv::resize(mat_depth, mat_depth_small, cv::Size(kIcpDepthWidth, kIcpDepthHeight), 0, 0, cv::INTER_NEAREST);
+    cv::resize(mat_depth_next, mat_depth_next_small, cv::Size(kIcpDepthWidth, kIcpDepthHeight), 0, 0, cv::INTER_NEAREST);
+
+    IcpRegistration icp_registration;
+    IcpRegistration::Result result;
+    icp_registration.Align(camera, mat_depth_next_small, mat_depth_small, Pose(), result);     /* warm up */
+    const auto& t0 = std::chrono::steady_clock::now();
+    bool is_aligned = true;
+    for (int32_t i = 0; i < kBenchmarkLoopNum; i++) {
+        is_aligned = icp_registration.Align(camera, mat_depth_next_small, mat_depth_small, Pose(), result);
+    }
+    const auto& t1 = std::chrono::steady_clock::now();
+    if (!is_aligned) {
+        printf("ICP: failed\n");
+        return;
+    }
+
+    /* Error against the ground truth (next camera -> current camera) */
+    const Pose pose_gt = camera.GetPose() * camera_next.GetPose().Inverse();
+    const Pose pose_error = result.pose * pose_gt.Inverse();
+    const float error_rotation_deg = Rad2Deg(2 * std::acos((std::min)(1.0f, std::abs(pose_error.q().w))));
+    const cv::Point3f& e = pose_error.t();
+    printf("ICP (%dx%d): %.2f [ms], %d iterations, inlier = %d, rmse = %.4f [m], error = %.3f [deg], %.4f [m]\n", kIcpDepthWidth, kIcpDepthHeight,
+        std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0 / kBenchmarkLoopNum, result.iteration_num, result.inlier_num, result.rmse,
+        error_rotation_deg, std::sqrt(e.x * e.x + e.y * e.y + e.z * e.z));
+
+    /* Pose of the next camera for CameraModel::SetExtrinsic */
+    std::array<float, 3> rvec_deg, tvec;
+    IcpRegistration::ConvertPose2Extrinsic(result.pose.Inverse() * camera.GetPose(), rvec_deg, tvec);
+    CameraModel camera_estimated;
+    camera_estimated.SetExtrinsic(rvec_deg, tvec, false);
+    camera_estimated.GetExtrinsic(rvec_deg, tvec, true);
+    printf("ICP: next camera rvec = (%.2f, %.2f, %.2f) [deg], position = (%.3f, %.3f, %.3f) [m]\n", rvec_deg[0], rvec_deg[1], rvec_deg[2], tvec[0], tvec[1], tvec[2]);
+}
+
+int main(int argc, char* argv[])
+{
+    /*** Synthetic stereo pair ***/
+    std::string input_name = (argc > 1) ? argv[1] : kInputImageFilename;
+    cv::Mat image_texture = cv::imread(input_name);
+    if (image_texture.empty()) {
+        printf("Failed to read %s\n", input_name.c_str());
+        return -1;
+    }
+
+    CameraModel camera_left;
+    CameraModel camera_right;
+    camera_left.SetIntrinsic(kWidth, kHeight, FocalLength(kWidth, kFovDeg));
+    camera_right.SetIntrinsic(kWidth, kHeight, FocalLength(kWidth, kFovDeg));
+    camera_left.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    camera_right.SetDist({ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f });
+    camera_left.SetExtrinsic({ 0.0f, 0.0f, 0.0f }, { 0.0f, -kCameraHeight, 0.0f }, true);
+    camera_right.SetExtrinsic({ 0.0f, 0.0f, 0.0f }, { kBaseline, -kCameraHeight, 0.0f }, true);
+
+    cv::Mat image_left, image_right, mat_depth_gt;
+    RenderSyntheticScene(camera_left, image_texture, image_left, mat_depth_gt);
+    RenderSyntheticScene(camera_right, image_texture, image_right);
+    cv::Mat image_stereo;
+    cv::hconcat(image_left, image_right, image_stereo);
+
+    /*** Benchmark ***/
+    typedef struct Result_ {
+        std::string name;
+        double time_ms;
+        cv::Mat mat_depth;
+    } Result;
+    std::vector<Result> result_list;
+
+    for (int32_t method : { StereoDepthEngine::kMethodBm, StereoDepthEngine::kMethodSgbm }) {
+        StereoDepthEngine::Config config;
+        config.method = method;
+        config.disparity_num = 64;
+        config.block_size = (method == StereoDepthEngine::kMethodBm) ? 15 : 5;
+        StereoDepthEngine stereo_depth_engine;
+        if (!stereo_depth_engine.Initialize(camera_left, camera_right, config)) return -1;
+        Result result;
+        result.name = (method == StereoDepthEngine::kMethodBm) ? "Stereo BM" : "Stereo SGBM";
+        stereo_depth_engine.Process(image_stereo, result.mat_depth);     /* warm up */
+        const auto& t0 = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < kBenchmarkLoopNum; i++) {
+            stereo_depth_engine.Process(image_stereo, result.mat_depth);
+        }
+        const auto& t1 = std::chrono::steady_clock::now();
+        result.time_ms = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0 / kBenchmarkLoopNum;
+        result_list.push_back(result);
+        stereo_depth_engine.Finalize();
+    }
+
+    if (std::ifstream(kMidasModelFilename).good()) {
+        DepthEngine depth_engine;
+        depth_engine.Initialize();
+        Result result;
+        result.name = "MiDaS (scale/shift fitted to GT)";
+        cv::Mat mat_inverse_depth;
+        depth_engine.Process(image_left, mat_inverse_depth);     /* warm up */
+        const auto& t0 = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < kBenchmarkLoopNum; i++) {
+            depth_engine.Process(image_left, mat_inverse_depth);
+        }
+        const auto& t1 = std::chrono::steady_clock::now();
+        result.time_ms = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0 / kBenchmarkLoopNum;
+        ConvertMidasToMetric(depth_engine, mat_inverse_depth, mat_depth_gt, result.mat_depth);
+        result_list.push_back(result);
+        depth_engine.Finalize();
+    } else {
+        printf("MiDaS is skipped (%s is not found)\n", kMidasModelFilename);
+    }
+
+    printf("%-34s %10s %10s %10s %10s\n", "Method", "Time[ms]", "AbsRel", "Bad[%]", "Valid[%]");
+    for (const auto& result : result_list) {
+        double abs_rel, bad_ratio, valid_ratio;
+        Evaluate(result.mat_depth, mat_depth_gt, abs_rel, bad_ratio, valid_ratio);
+        printf("%-34s %10.2f %10.3f %10.1f %10.1f\n", result.name.c_str(), result.time_ms, abs_rel, bad_ratio * 100, valid_ratio * 100);
+    }
+
+    BenchmarkIcp(camera_left, image_texture, mat_depth_gt);
+
+    /*** Draw ***/
+    cv::imshow("Input", image_stereo);
+    for (const auto& result : result_list) {
+        cv::Mat mat_depth_normalized = cv::Mat(result.mat_depth.size(), CV_8UC1, cv::Scalar(255));
+        result.mat_depth.convertTo(mat_depth_normalized, CV_8UC1, 255.0 / 30.0);   /* 0 - 30 [m] */
+        mat_depth_normalized.setTo(255, result.mat_depth <= 0);
+        cv::Mat image_depth;
+        cv::applyColorMap(mat_depth_normalized, image_depth, cv::COLORMAP_JET);
+        cv::imshow(result.name, image_depth);
+    }
+    cv::waitKey(-1);
+
+    return 0;
+}
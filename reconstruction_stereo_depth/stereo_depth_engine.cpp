@@ -0,0 +1,198 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "camera_model.h"
+#include "stereo_depth_engine.h"
+
+/*** Macro ***/
+static constexpr int32_t kDisparityScale = 16;     /* cv::StereoMatcher outputs disparity * 16 (CV_16S) */
+static constexpr int32_t kSgbmBandMargin = 32;     /* [px] extra rows for each band in SGBM (the cost is aggregated along the paths beyond the block) */
+
+
+/*** Function ***/
+bool StereoDepthEngine::Initialize(CameraModel& camera_left, CameraModel& camera_right, const Config& config)
+{
+    if (camera_left.width != camera_right.width || camera_left.height != camera_right.height) {
+        printf("[StereoDepthEngine] Image size of the two cameras must be the same\n");
+        return false;
+    }
+    if (config.disparity_num <= 0 || config.disparity_num % 16 != 0 || config.block_size % 2 == 0) {
+        printf("[StereoDepthEngine] Invalid config (disparity_num = %d, block_size = %d)\n", config.disparity_num, config.block_size);
+        return false;
+    }
+    config_ = config;
+    image_size_ = cv::Size(camera_left.width, camera_left.height);
+
+    /*** Relative pose: left camera coordinate -> right camera coordinate ***/
+    const Pose pose_left2right = camera_right.GetPose() * camera_left.GetPose().Inverse();
+    const std::array<float, 9>& R_f = pose_left2right.R();
+    cv::Mat R = cv::Mat(3, 3, CV_64FC1);
+    for (int32_t i = 0; i < 9; i++) R.at<double>(i) = R_f[i];
+    cv::Mat T = (cv::Mat_<double>(3, 1) << pose_left2right.t().x, pose_left2right.t().y, pose_left2right.t().z);
+
+    /*** Rectification LUT ***/
+    cv::Mat K_left, K_right, dist_left, dist_right;
+    camera_left.K.convertTo(K_left, CV_64FC1);
+    camera_right.K.convertTo(K_right, CV_64FC1);
+    camera_left.dist_coeff.convertTo(dist_left, CV_64FC1);
+    camera_right.dist_coeff.convertTo(dist_right, CV_64FC1);
+    cv::Mat R1, R2, P1, P2, Q;
+    cv::stereoRectify(K_left, dist_left, K_right, dist_right, image_size_, R, T, R1, R2, P1, P2, Q, cv::CALIB_ZERO_DISPARITY, 0);
+    if (std::abs(P2.at<double>(1, 3)) > std::abs(P2.at<double>(0, 3))) {
+        printf("[StereoDepthEngine] Vertical stereo is not supported\n");
+        return false;
+    }
+    /* P2[0][3] = -f * B (the right camera is on the right side of the left camera) */
+    focal_baseline_ = static_cast<float>(-P2.at<double>(0, 3));
+    if (focal_baseline_ <= 0) {
+        printf("[StereoDepthEngine] The right camera must be on the right side of the left camera\n");
+        return false;
+    }
+    cv::initUndistortRectifyMap(K_left, dist_left, R1, P1, image_size_, CV_16SC2, map_left_[0], map_left_[1]);
+    rectify_rotation_ = R1;
+    rectify_projection_ = P1;
+    cv::initUndistortRectifyMap(K_right, dist_right, R2, P2, image_size_, CV_16SC2, map_right_[0], map_right_[1]);
+
+    matcher_list_.clear();
+    return true;
+}
+
+bool StereoDepthEngine::Finalize()
+{
+    matcher_list_.clear();
+    return true;
+}
+
+bool StereoDepthEngine::Process(const cv::Mat& image_input, cv::Mat& mat_depth)
+{
+    if (image_input.cols != image_size_.width * 2 || image_input.rows != image_size_.height) {
+        printf("[StereoDepthEngine] Invalid input size (%d x %d)\n", image_input.cols, image_input.rows);
+        return false;
+    }
+    return Process(image_input.colRange(0, image_size_.width), image_input.colRange(image_size_.width, image_size_.width * 2), mat_depth);
+}
+
+bool StereoDepthEngine::Process(const cv::Mat& image_left, const cv::Mat& image_right, cv::Mat& mat_depth)
+{
+    if (image_left.size() != image_size_ || image_right.size() != image_size_ || image_left.type() != image_right.type()) {
+        printf("[StereoDepthEngine] Invalid input image\n");
+        return false;
+    }
+
+    int32_t band_num = config_.band_num;
+    if (band_num <= 0) {
+#ifdef _OPENMP
+        band_num = omp_get_max_threads();
+#else
+        band_num = 1;
+#endif
+    }
+    while (static_cast<int32_t>(matcher_list_.size()) < band_num) matcher_list_.push_back(CreateMatcher());
+
+    mat_depth.create(image_size_, CV_32FC1);
+    image_left_rectified_.create(image_size_, image_left.type());
+
+    /***
+    * Each band is processed with extra rows above and below
+    *   - BM: the result is the same as the whole image (each pixel depends only on the block and the prefilter window)
+    *   - SGBM: the result differs slightly near the border of bands, because the cost is aggregated along the paths and the speckle filter works on regions.
+    *           A wider margin keeps the seams small but doesn't remove them (set band_num = 1 for the exact result)
+    ***/
+    const int32_t margin = (config_.method == kMethodBm) ? config_.block_size : (std::max)(config_.block_size, kSgbmBandMargin);
+    const float focal_baseline_scaled = focal_baseline_ * kDisparityScale;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t band = 0; band < band_num; band++) {
+        const int32_t row_start = image_size_.height * band / band_num;
+        const int32_t row_end = image_size_.height * (band + 1) / band_num;
+        if (row_start >= row_end) continue;
+        const int32_t row_start_ext = (std::max)(0, row_start - margin);
+        const int32_t row_end_ext = (std::min)(image_size_.height, row_end + margin);
+
+        /*** Rectify ***/
+        cv::Mat image_left_band, image_right_band;
+        cv::remap(image_left, image_left_band, map_left_[0].rowRange(row_start_ext, row_end_ext), map_left_[1].rowRange(row_start_ext, row_end_ext), cv::INTER_LINEAR);
+        cv::remap(image_right, image_right_band, map_right_[0].rowRange(row_start_ext, row_end_ext), map_right_[1].rowRange(row_start_ext, row_end_ext), cv::INTER_LINEAR);
+        image_left_band.rowRange(row_start - row_start_ext, row_end - row_start_ext).copyTo(image_left_rectified_.rowRange(row_start, row_end));
+        if (image_left_band.channels() == 3) {
+            cv::cvtColor(image_left_band, image_left_band, cv::COLOR_BGR2GRAY);
+            cv::cvtColor(image_right_band, image_right_band, cv::COLOR_BGR2GRAY);
+        }
+
+        /*** Disparity -> Depth ***/
+        cv::Mat mat_disparity;
+        matcher_list_[band]->compute(image_left_band, image_right_band, mat_disparity);
+        for (int32_t y = row_start; y < row_end; y++) {
+            const int16_t* disparity = mat_disparity.ptr<int16_t>(y - row_start_ext);
+            float* depth = mat_depth.ptr<float>(y);
+            for (int32_t x = 0; x < image_size_.width; x++) {
+                depth[x] = (disparity[x] > 0) ? focal_baseline_scaled / disparity[x] : 0.0f;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool StereoDepthEngine::NormalizeMinMax(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized)
+{
+    /***
+    * Normalize to uint8_t(0-255) (Far = 255, Near = 0)
+    * Normalized Value  = 255 * (value - min) / (max - min)
+    ***/
+    cv::Mat mask_valid = mat_depth > 0;
+    double depth_min, depth_max;
+    cv::minMaxLoc(mat_depth, &depth_min, &depth_max, nullptr, nullptr, mask_valid);
+    double range = depth_max - depth_min;
+    mat_depth_normalized = cv::Mat(mat_depth.size(), CV_8UC1, cv::Scalar(255));
+    if (range > 0) {
+        cv::Mat mat_temp;
+        mat_depth.convertTo(mat_temp, CV_8UC1, 255. / range, (-255. * depth_min) / range);
+        mat_temp.copyTo(mat_depth_normalized, mask_valid);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+cv::Ptr<cv::StereoMatcher> StereoDepthEngine::CreateMatcher() const
+{
+    if (config_.method == kMethodBm) {
+        cv::Ptr<cv::StereoBM> matcher = cv::StereoBM::create(config_.disparity_num, config_.block_size);
+        matcher->setMinDisparity(config_.min_disparity);
+        matcher->setUniquenessRatio(10);
+        matcher->setTextureThreshold(10);
+        return matcher;
+    } else {
+        const int32_t area = config_.block_size * config_.block_size;
+        return cv::StereoSGBM::create(config_.min_disparity, config_.disparity_num, config_.block_size,
+            8 * area, 32 * area, 1, 63, 10, 100, 2, cv::StereoSGBM::MODE_SGBM_3WAY);
+    }
+}
@@ -0,0 +1,86 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef STEREO_DEPTH_ENGINE_
+#define STEREO_DEPTH_ENGINE_
+
+/*** Include ***/
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+
+#include <opencv2/opencv.hpp>
+
+#include "camera_model.h"
+
+
+/***
+* Metric depth from a stereo pair (alternative to DepthEngine (MiDaS) when two cameras are available)
+*   - Rectification maps are made from the parameters of two CameraModels (intrinsic, distortion and pose)
+*   - Disparity is calculated by block matching (BM) or semi-global block matching (SGBM)
+*   - Rows are split into bands which are rectified and matched in parallel
+*   - Depth = f * B / disparity (Zc of the rectified left camera, the same unit as the camera position)
+***/
+class StereoDepthEngine
+{
+public:
+    enum {
+        kMethodBm = 0,
+        kMethodSgbm,
+    };
+
+    typedef struct Config_ {
+        int32_t method;
+        int32_t min_disparity;
+        int32_t disparity_num;      /* disparity range [px] (multiple of 16) */
+        int32_t block_size;         /* odd number */
+        int32_t band_num;           /* number of row bands processed in parallel (0 = number of threads) */
+        Config_() : method(kMethodSgbm), min_disparity(0), disparity_num(64), block_size(9), band_num(0) {}
+    } Config;
+
+public:
+    StereoDepthEngine() : focal_baseline_(0) {}
+    ~StereoDepthEngine() {}
+    bool Initialize(CameraModel& camera_left, CameraModel& camera_right, const Config& config = Config());
+    bool Finalize();
+    /* image_input: the left image and the right image side by side. The same interface as DepthEngine */
+    bool Process(const cv::Mat& image_input, cv::Mat& mat_depth);
+    /* mat_depth: CV_32FC1, metric depth. 0 = invalid (no match) */
+    bool Process(const cv::Mat& image_left, const cv::Mat& image_right, cv::Mat& mat_depth);
+    /* Normalize to uint8_t(0-255) (Far = 255, Near = 0, Invalid = 255) */
+    bool NormalizeMinMax(const cv::Mat& mat_depth, cv::Mat& mat_depth_normalized);
+    /* The left image after rectification (mat_depth is aligned to this image) */
+    const cv::Mat& GetImageRectified() const { return image_left_rectified_; }
+    /* R1 of cv::stereoRectify (CV_64FC1 3x3): left camera coordinate -> rectified coordinate (the coordinate of mat_depth) */
+    const cv::Mat& GetRectifyRotation() const { return rectify_rotation_; }
+    /* P1 of cv::stereoRectify (CV_64FC1 3x4): projection of the rectified left image. Use P1(0:3, 0:3) as K to convert mat_depth to 3D */
+    const cv::Mat& GetRectifyProjection() const { return rectify_projection_; }
+
+private:
+    cv::Ptr<cv::StereoMatcher> CreateMatcher() const;
+
+private:
+    Config config_;
+    cv::Size image_size_;
+    std::array<cv::Mat, 2> map_left_;       /* cv::remap maps (CV_16SC2, CV_16UC1) */
+    std::array<cv::Mat, 2> map_right_;
+    float focal_baseline_;                  /* f * B */
+    cv::Mat rectify_rotation_;              /* R1 */
+    cv::Mat rectify_projection_;            /* P1 */
+    std::vector<cv::Ptr<cv::StereoMatcher>> matcher_list_;     /* one for each band (not thread-safe) */
+    cv::Mat image_left_rectified_;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "result_log.h"
+
+/*** Macro ***/
+static constexpr char kDefaultInputFilename[] = "dnn_face_result.rlog";
+static constexpr float kRad2Deg = 180.0f / 3.14159265358979323846f;
+
+
+/*** Function ***/
+static void PrintFrame(const ResultLog::FrameView& view)
+{
+    printf("frame = %lld, time = %.3f [s]", static_cast<long long>(view.frame_id), view.timestamp_ns * 1e-9);
+    for (uint32_t i = 0; i < view.face_num; i++) {
+        const int32_t* bbox = view.bbox + i * 4;
+        printf(", face(%d, %d, %d, %d)", bbox[0], bbox[1], bbox[2], bbox[3]);
+    }
+    for (uint32_t i = 0; i < view.head_pose_num; i++) {
+        const float* rvec = view.rvec + i * 3;
+        const float* tvec = view.tvec + i * 3;
+        printf(", pose(%.1f, %.1f, %.1f [deg], %.2f [m])", rvec[0] * kRad2Deg, rvec[1] * kRad2Deg, rvec[2] * kRad2Deg, tvec[2]);
+    }
+    for (uint32_t i = 0; i < view.distance_num; i++) {
+        const float* world = view.distance_world + i * 3;
+        printf(", distance(%.1f, %.1f [m])", world[0], world[2]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input_name = (argc > 1) ? argv[1] : kDefaultInputFilename;
+    bool is_verbose = (argc > 2) && (strcmp(argv[2], "-v") == 0);
+
+    ResultLog::Reader reader;
+    if (!reader.Open(input_name)) {
+        printf("Usage: %s [result_log_file] [-v]\n", argv[0]);
+        return -1;
+    }
+
+    /* Columns are used directly from the mapped file */
+    size_t face_num_total = 0;
+    size_t frame_num_with_face = 0;
+    size_t distance_num_total = 0;
+    float distance_min = 1e9f;
+    float distance_max = 0;
+    int64_t time_first = 0;
+    int64_t time_last = 0;
+    for (size_t i = 0; i < reader.GetFrameNum(); i++) {
+        ResultLog::FrameView view;
+        if (!reader.GetFrame(i, view)) break;
+        if (is_verbose) PrintFrame(view);
+        if (i == 0) time_first = view.timestamp_ns;
+        time_last = view.timestamp_ns;
+        face_num_total += view.face_num;
+        if (view.face_num > 0) frame_num_with_face++;
+        distance_num_total += view.distance_num;
+        for (uint32_t j = 0; j < view.distance_num; j++) {
+            const float* world = view.distance_world + j * 3;
+            float distance = std::sqrt(world[0] * world[0] + world[2] * world[2]);
+            distance_min = (std::min)(distance_min, distance);
+            distance_max = (std::max)(distance_max, distance);
+        }
+    }
+
+    printf("file = %s\n", input_name.c_str());
+    printf("frames = %zu, duration = %.3f [s]\n", reader.GetFrameNum(), (time_last - time_first) * 1e-9);
+    printf("faces = %zu, frames with face = %zu\n", face_num_total, frame_num_with_face);
+    if (distance_num_total > 0) {
+        printf("distances = %zu, min = %.2f [m], max = %.2f [m]\n", distance_num_total, distance_min, distance_max);
+    }
+
+    return 0;
+}
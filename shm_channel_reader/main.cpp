@@ -0,0 +1,95 @@
+/* Copyright 2021 iwatake2222
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+/*** Include ***/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "shm_channel.h"
+
+/*** Macro ***/
+static constexpr int32_t kWaitTimeMs = 10;
+
+
+/*** Function ***/
+static void TreatDepthMap(const ShmChannel::SlotView& view)
+{
+    /* Use the shared memory directly without copy */
+    cv::Mat mat_depth = ShmChannel::Reader::AsMat(view);
+    double depth_min, depth_max;
+    cv::minMaxLoc(mat_depth, &depth_min, &depth_max);
+    printf("[DepthMap]   seq = %llu, %d x %d, min = %.3f, max = %.3f", static_cast<unsigned long long>(view.seq), view.cols, view.rows, depth_min, depth_max);
+}
+
+static void TreatPointCloud(const ShmChannel::SlotView& view)
+{
+    const cv::Point3f* object_point_list = reinterpret_cast<const cv::Point3f*>(view.payload);
+    cv::Point3f center(0, 0, 0);
+    for (uint32_t i = 0; i < view.element_num; i++) {
+        center += object_point_list[i];
+    }
+    if (view.element_num > 0) center = center * (1.0f / view.element_num);
+    printf("[PointCloud] seq = %llu, points = %u, center = (%.2f, %.2f, %.2f)", static_cast<unsigned long long>(view.seq), view.element_num, center.x, center.y, center.z);
+}
+
+static void TreatFaceDetection(const ShmChannel::SlotView& view)
+{
+    const ShmChannel::FaceRecord* record_list = reinterpret_cast<const ShmChannel::FaceRecord*>(view.payload);
+    printf("[Face]       seq = %llu, faces = %u", static_cast<unsigned long long>(view.seq), view.element_num);
+    for (uint32_t i = 0; i < view.element_num; i++) {
+        printf(", (%d, %d, %d, %d)", record_list[i].x, record_list[i].y, record_list[i].width, record_list[i].height);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const std::vector<std::string> name_list = { ShmChannel::kNameDepthMap, ShmChannel::kNamePointCloud, ShmChannel::kNameFaceDetection };
+    std::vector<ShmChannel::Reader> reader_list(name_list.size());
+
+    printf("Waiting for %s, %s, %s\n", name_list[0].c_str(), name_list[1].c_str(), name_list[2].c_str());
+    while (true) {
+        for (size_t i = 0; i < name_list.size(); i++) {
+            auto& reader = reader_list[i];
+            if (!reader.IsOpened() && !reader.Open(name_list[i])) continue;     /* the writer is not running yet */
+            if (!reader.Wait(kWaitTimeMs)) continue;
+
+            ShmChannel::SlotView view;
+            if (!reader.AcquireLatest(view)) continue;
+            switch (view.type) {
+            case ShmChannel::kTypeDepthMap:
+                TreatDepthMap(view);
+                break;
+            case ShmChannel::kTypePointCloud:
+                TreatPointCloud(view);
+                break;
+            case ShmChannel::kTypeFaceDetection:
+                TreatFaceDetection(view);
+                break;
+            default:
+                break;
+            }
+
+            /* The result is invalid if the writer overwrote the slot while reading */
+            double latency_ms = (ShmChannel::GetTimestampNs() - view.timestamp_ns) / 1000000.0;
+            printf(", latency = %.2f [ms]%s\n", latency_ms, reader.Validate(view) ? "" : " (overwritten)");
+        }
+    }
+
+    return 0;
+}
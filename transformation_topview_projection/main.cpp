@@ -32,6 +32,7 @@ limitations under the License.
 static constexpr char kWindowMain[] = "WindowMain";
 static constexpr char kWindowParam[] = "WindowParam";
 static constexpr float kFovDeg = 130.0f;
+static constexpr int32_t kGroundRowMargin = 10;     /* for lens distortion and interpolation */
 
 
 /*** Global variable ***/
@@ -65,24 +66,23 @@ static void loop_main(const cv::Mat& image_org)
 {
     cvui::context(kWindowMain);
 
-    /*** Generate mapping b/w object points (3D: world coordinate) and image points (real camera) */
-    std::vector<cv::Point3f> object_point_list = {   /* Target area (possible road area) */
-        { -1.0f, 0, 10.0f },
-        {  1.0f, 0, 10.0f },
-        { -1.0f, 0,  3.0f },
-        {  1.0f, 0,  3.0f },
-    };
-    std::vector<cv::Point2f> image_point_real_list;
-    cv::projectPoints(object_point_list, camera_real.rvec, camera_real.tvec, camera_real.K, camera_real.dist_coeff, image_point_real_list);
-
-    /* Convert to image points (2D) using the top view camera (virtual camera) */
-    std::vector<cv::Point2f> image_point_top_list;
-    cv::projectPoints(object_point_list, camera_top.rvec, camera_top.tvec, camera_top.K, camera_top.dist_coeff, image_point_top_list);
-
-    /* Perspective Transform */
-    cv::Mat mat_transform = cv::getPerspectiveTransform(&image_point_real_list[0], &image_point_top_list[0]);
+    /*** Homography b/w the real camera and the top view camera (virtual camera) induced by the ground plane (Y = 0) ***/
+    cv::Mat mat_transform = camera_real.GetPlaneHomography(camera_top, cv::Point3f(0, 1, 0), 0);
     cv::Mat mat_output = cv::Mat(image_org.size(), CV_8UC3, cv::Scalar(70, 70, 70));
-    cv::warpPerspective(image_org, mat_output, mat_transform, mat_output.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+
+    /* Process only the ground region (skip the sky) of both the real image (source) and the top view image (destination) */
+    int32_t row_start_real, row_end_real;
+    camera_real.GetGroundRowRange(row_start_real, row_end_real, kGroundRowMargin);
+    int32_t row_start_top, row_end_top;
+    camera_top.GetGroundRowRange(row_start_top, row_end_top);
+    if (!mat_transform.empty() && row_start_real < row_end_real && row_start_top < row_end_top) {
+        /* dst_roi = T_dst * H * T_src * src_roi */
+        cv::Mat T_src = (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, 1, row_start_real, 0, 0, 1);
+        cv::Mat T_dst = (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, 1, -row_start_top, 0, 0, 1);
+        cv::Mat mat_transform_roi = T_dst * mat_transform * T_src;
+        cv::Mat mat_output_roi = mat_output.rowRange(row_start_top, row_end_top);
+        cv::warpPerspective(image_org.rowRange(row_start_real, row_end_real), mat_output_roi, mat_transform_roi, mat_output_roi.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+    }
 
     cvui::imshow(kWindowMain, mat_output);
 }
@@ -99,13 +99,17 @@ int main(int argc, char *argv[])
     fs << "mapy" << mapy;
     fs.release();
 
+    /* remap doesn't take FP16 maps. Fixed-point maps (CV_16SC2 + CV_16UC1: 6 bytes / px instead of 8) halve the traffic of the coordinates */
+    cv::Mat map_xy_fixed, map_interpolation;
+    cv::convertMaps(mapx, mapy, map_xy_fixed, map_interpolation, CV_16SC2);
+
     for (int32_t i = 0; i < image_path_list.size(); i++) {
         cv::Mat image_chessboard = cv::imread(image_path_list[i]);
         cv::Mat image_undistorted;
 #if 0
         cv::undistort(image_chessboard, image_undistorted, K, dist_coeff);
 #else
-        cv::remap(image_chessboard, image_undistorted, mapx, mapy, cv::INTER_LINEAR);
+        cv::remap(image_chessboard, image_undistorted, map_xy_fixed, map_interpolation, cv::INTER_LINEAR);
 #endif
         cv::imshow("image_original", image_chessboard);
         cv::imshow("image_undistorted", image_undistorted);
@@ -21,16 +21,21 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include <numeric>
+#include <chrono>
 
 #include <opencv2/opencv.hpp>
 
 #define CVUI_IMPLEMENTATION
 #include "cvui.h"
 
+#include "simd_kernel.h"
+#include "fisheye_parameter_estimator.h"
+
 
 /*** Macro ***/
 static constexpr char kWindowMain[] = "WindowMain";
 static constexpr char kWindowParam[] = "WindowParam";
+static constexpr char kWindowSegment[] = "WindowSegment";
 
 typedef struct CameraParameter_ {
     float xi;
@@ -56,6 +61,27 @@ static inline float Rad2Deg(float rad) { return static_cast<float>(rad * 180.0 /
 static void CreateUndistortMap(cv::Size undist_image_size, float f_undist, float xi, float u0_undist, float v0_undist, float f_dist, float u0_dist, float v0_dist, cv::Mat& mapx, cv::Mat& mapy);
 
 
+static void EstimateCameraParameter(const cv::Mat& image_org)
+{
+    /* Straight-line optimization on the edge points only (no remap) */
+    FisheyeParameterEstimator estimator;
+    FisheyeParameterEstimator::Result result;
+    const auto& t0 = std::chrono::steady_clock::now();
+    if (!estimator.Estimate(image_org, result)) return;
+    const auto& t1 = std::chrono::steady_clock::now();
+    printf("Estimated: xi = %.3f, focal_length = %.1f (cost = %.3f [px^2], %d segments, %d candidates, %.1f [ms])\n",
+        result.xi, result.focal_length, result.cost, result.segment_num, result.evaluation_num, std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count() / 1000.0);
+
+    camera_parameter.xi = result.xi;
+    camera_parameter.focal_length = result.focal_length;
+    update_camera_parameter = true;
+
+    cv::Mat image_segment = image_org.clone();
+    FisheyeParameterEstimator::DrawSegments(image_segment, estimator.GetSegmentList());
+    cv::imshow(kWindowSegment, image_segment);
+}
+
+
 static void loop_main(const cv::Mat& image_org)
 {
     cvui::context(kWindowMain);
@@ -98,10 +124,10 @@ if (temp_float_new != temp_float_current) VAL = temp_float_new;\
 cvui::endColumn();\
 }
 
-static void loop_param()
+static void loop_param(const cv::Mat& image_org)
 {
     cvui::context(kWindowParam);
-    cv::Mat mat = cv::Mat(400, 300, CV_8UC3, cv::Scalar(70, 70, 70));
+    cv::Mat mat = cv::Mat(450, 300, CV_8UC3, cv::Scalar(70, 70, 70));
 
     cvui::beginColumn(mat, 10, 10, -1, -1, 10);
     {
@@ -119,6 +145,9 @@ static void loop_param()
         if (cvui::button(200, 20, "Update")) {
             update_camera_parameter = true;
         }
+        if (cvui::button(200, 20, "Auto")) {
+            EstimateCameraParameter(image_org);
+        }
     }
     cvui::endColumn();
 
@@ -135,7 +164,7 @@ int main(int argc, char* argv[])
 
     while (true) {
         loop_main(image_org);
-        loop_param();
+        loop_param(image_org);
         int32_t key = cv::waitKey(1);
         if (key == 27) break;   /* ESC to quit */
     }
@@ -148,72 +177,30 @@ int main(int argc, char* argv[])
 /* Unified projection model */
 static void CreateUndistortMap(cv::Size undist_image_size, float f_undist, float xi, float u0_undist, float v0_undist, float f_dist, float u0_dist, float v0_dist, cv::Mat& mapx, cv::Mat& mapy)
 {
-    cv::Mat grid_x(undist_image_size, CV_32F);
-    cv::Mat grid_y(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            grid_x.at<float>(y, x) = x + 0.0f;
-            grid_y.at<float>(y, x) = y + 0.0f;
-        }
-    }
-
-    cv::Mat X_Cam(undist_image_size, CV_32F);
-    cv::Mat Y_Cam(undist_image_size, CV_32F);
-    cv::Mat Z_Cam(undist_image_size, CV_32F, 1.0f);
-    X_Cam = (grid_x - u0_undist) / f_undist;
-    Y_Cam = (grid_y - v0_undist) / f_undist;
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        X_Cam.at<float>(y, x) = (grid_x.at<float>(y, x) - u0_undist) / f_undist;
-    //        Y_Cam.at<float>(y, x) = (grid_y.at<float>(y, x) - v0_undist) / f_undist;
-    //        Z_Cam.at<float>(y, x) = 1.0f;
-    //    }
-    //}
-
-    cv::Mat Alpha_Cam(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            Alpha_Cam.at<float>(y, x) = 1 / sqrtf(
-                X_Cam.at<float>(y, x) * X_Cam.at<float>(y, x)
-                + Y_Cam.at<float>(y, x) * Y_Cam.at<float>(y, x)
-                + Z_Cam.at<float>(y, x) * Z_Cam.at<float>(y, x)
-            );
-        }
-    }
-
-    cv::Mat X_Sph(undist_image_size, CV_32F);
-    cv::Mat Y_Sph(undist_image_size, CV_32F);
-    cv::Mat Z_Sph(undist_image_size, CV_32F);
-    cv::multiply(X_Cam, Alpha_Cam, X_Sph);
-    cv::multiply(Y_Cam, Alpha_Cam, Y_Sph);
-    cv::multiply(Z_Cam, Alpha_Cam, Z_Sph);
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        X_Sph.at<float>(y, x) = X_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //        Y_Sph.at<float>(y, x) = Y_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //        Z_Sph.at<float>(y, x) = Z_Cam.at<float>(y, x) * Alpha_Cam.at<float>(y, x);
-    //    }
-    //}
-
-    cv::Mat den(undist_image_size, CV_32F);
-    for (int32_t y = 0; y < undist_image_size.height; y++) {
-        for (int32_t x = 0; x < undist_image_size.width; x++) {
-            den.at<float>(y, x) = xi * sqrtf(
-                X_Sph.at<float>(y, x) * X_Sph.at<float>(y, x)
-                + Y_Sph.at<float>(y, x) * Y_Sph.at<float>(y, x)
-                + Z_Sph.at<float>(y, x) * Z_Sph.at<float>(y, x)
-            ) + Z_Sph.at<float>(y, x);
-        }
-    }
+    /***
+    * For each pixel on the undistorted image:
+    *   Point on the image plane: (X_Cam, Y_Cam, Z_Cam) = ((x - u0_undist) / f_undist, (y - v0_undist) / f_undist, 1)
+    *   Point on the unit sphere: (X_Sph, Y_Sph, Z_Sph) = (X_Cam, Y_Cam, Z_Cam) / |(X_Cam, Y_Cam, Z_Cam)|
+    *   den = xi * |(X_Sph, Y_Sph, Z_Sph)| + Z_Sph
+    *   mapx = X_Sph * f_dist / den + u0_dist, mapy = Y_Sph * f_dist / den + v0_dist
+    * Each row is calculated by the SIMD kernel selected for the CPU
+    ***/
+    SimdKernel::UnifiedProjectionParam param;
+    param.f_undist = f_undist;
+    param.u0_undist = u0_undist;
+    param.v0_undist = v0_undist;
+    param.xi = xi;
+    param.f_dist = f_dist;
+    param.u0_dist = u0_dist;
+    param.v0_dist = v0_dist;
 
     mapx = cv::Mat(undist_image_size, CV_32F);
     mapy = cv::Mat(undist_image_size, CV_32F);
-    mapx = X_Sph * f_dist / den + u0_dist;
-    mapy = Y_Sph * f_dist / den + v0_dist;
-    //for (int32_t y = 0; y < undist_image_size.height; y++) {
-    //    for (int32_t x = 0; x < undist_image_size.width; x++) {
-    //        mapx.at<float>(y, x) = (X_Sph.at<float>(y, x) * f_dist) / den.at<float>(y, x) + u0_dist;
-    //        mapy.at<float>(y, x) = (Y_Sph.at<float>(y, x) * f_dist) / den.at<float>(y, x) + v0_dist;
-    //    }
-    //}
+    const SimdKernel::Table& kernel = SimdKernel::GetTable();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int32_t y = 0; y < undist_image_size.height; y++) {
+        kernel.MakeUnifiedUndistortMapRow(param, y, undist_image_size.width, mapx.ptr<float>(y), mapy.ptr<float>(y));
+    }
 }